@@ -6,8 +6,11 @@
 #include <cstring>
 #include <FFMediaPlayer.h>
 #include <render/video/VideoGLRender.h>
+#include <render/video/VsyncSource.h>
 #include <render/audio/OpenSLRender.h>
 #include "util/LogUtil.h"
+#include "util/CacheUtil.h"
+#include "decoder/MediaCache.h"
 #include "jni.h"
 
 extern "C" {
@@ -36,6 +39,34 @@ JNIEXPORT jlong JNICALL native_Init(JNIEnv *env, jobject obj, jstring jurl, jint
     return reinterpret_cast<jlong>(player);
 }
 
+JNIEXPORT void JNICALL native_SetNextDataSource(JNIEnv *env, jobject obj, jlong player_handle, jstring jurl)
+{
+    if(player_handle != 0)
+    {
+        const char* url = env->GetStringUTFChars(jurl, nullptr);
+        FFMediaPlayer* ffMediaPlayer = reinterpret_cast<FFMediaPlayer*>(player_handle);
+        ffMediaPlayer->SetNextDataSource(url);
+        env->ReleaseStringUTFChars(jurl, url);
+    }
+}
+
+JNIEXPORT void JNICALL native_SetPlaybackSpeed(JNIEnv* env,jobject obj,jlong player_handle,jfloat speed)
+{
+    if(player_handle != 0)
+    {
+        FFMediaPlayer* ffMediaPlayer = reinterpret_cast<FFMediaPlayer*>(player_handle);
+        ffMediaPlayer->SetPlaybackSpeed(speed);
+    }
+}
+
+JNIEXPORT void JNICALL native_Prepare(JNIEnv* env,jobject obj,jlong player_handle){
+    if(player_handle != 0)
+    {
+        FFMediaPlayer* ffMediaPlayer = reinterpret_cast<FFMediaPlayer*>(player_handle);
+        ffMediaPlayer->Prepare();
+    }
+}
+
 JNIEXPORT void JNICALL native_Play(JNIEnv* env,jobject obj,jlong player_handle){
     if(player_handle != 0)
     {
@@ -44,12 +75,12 @@ JNIEXPORT void JNICALL native_Play(JNIEnv* env,jobject obj,jlong player_handle){
     }
 }
 
-JNIEXPORT void JNICALL native_SeekToPosition(JNIEnv* env,jobject obj,jlong player_handle,jfloat position)
+JNIEXPORT void JNICALL native_SeekToPosition(JNIEnv* env,jobject obj,jlong player_handle,jfloat position,jint seek_mode)
 {
     if(player_handle != 0)
     {
         FFMediaPlayer* ffMediaPlayer = reinterpret_cast<FFMediaPlayer*>(player_handle);
-        ffMediaPlayer->SeekToPosition(position);
+        ffMediaPlayer->SeekToPosition(position, seek_mode);
     }
 }
 
@@ -91,6 +122,64 @@ JNIEXPORT jlong JNICALL native_GetMediaParams(JNIEnv* env,jobject obj,jlong play
     return value;
 }
 
+JNIEXPORT void JNICALL native_SetMediaParams(JNIEnv* env,jobject obj,jlong player_handle,jint param_type,jlong value)
+{
+    if(player_handle != 0)
+    {
+        FFMediaPlayer *ffMediaPlayer = reinterpret_cast<FFMediaPlayer *>(player_handle);
+        ffMediaPlayer->SetMediaParams(param_type, value);
+    }
+}
+
+JNIEXPORT void JNICALL native_SetDecoderThreadPolicy(JNIEnv* env,jobject obj,jlong player_handle,jint media_type,jint thread_type,jint thread_count)
+{
+    if(player_handle != 0)
+    {
+        FFMediaPlayer *ffMediaPlayer = reinterpret_cast<FFMediaPlayer *>(player_handle);
+        ffMediaPlayer->SetDecoderThreadPolicy(media_type, thread_type, thread_count);
+    }
+}
+
+JNIEXPORT jintArray JNICALL native_GetThumbnail(JNIEnv* env,jobject obj,jlong player_handle,jfloat position)
+{
+    if(player_handle == 0)
+        return nullptr;
+
+    FFMediaPlayer *ffMediaPlayer = reinterpret_cast<FFMediaPlayer *>(player_handle);
+    Thumbnail thumbnail;
+    if(!ffMediaPlayer->GetThumbnail(position, thumbnail))
+        return nullptr;
+
+    //BGRA 按 int 读取即为 ARGB, 宽度固定为 THUMBNAIL_WIDTH
+    jint length = thumbnail.width * thumbnail.height;
+    jintArray pixels = env->NewIntArray(length);
+    if(pixels != nullptr)
+        env->SetIntArrayRegion(pixels, 0, length, reinterpret_cast<const jint *>(&thumbnail.pixels[0]));
+    return pixels;
+}
+
+JNIEXPORT void JNICALL native_SetCacheDir(JNIEnv* env,jclass clazz,jstring jcache_dir)
+{
+    const char* cacheDir = env->GetStringUTFChars(jcache_dir, nullptr);
+    CacheUtil::SetCacheDir(cacheDir);
+    env->ReleaseStringUTFChars(jcache_dir, cacheDir);
+}
+
+JNIEXPORT void JNICALL native_SetMediaCacheBudget(JNIEnv* env,jclass clazz,jlong budget)
+{
+    MediaCache::SetBudget(budget);
+}
+
+JNIEXPORT void JNICALL native_SetTextureUploadMode(JNIEnv* env,jclass clazz,jint upload_mode)
+{
+    VideoGLRender::GetInstance()->SetUploadMode(upload_mode);
+}
+
+JNIEXPORT void JNICALL native_OnVsync(JNIEnv* env,jclass clazz,jlong frame_time_nanos)
+{
+    ChoreographerVsyncSource::GetInstance()->OnVsync(frame_time_nanos);
+}
+
 JNIEXPORT void JNICALL native_OnSurfaceCreated(JNIEnv* env,jclass clazz,jint render_type)
 {
     VideoGLRender::GetInstance()->OnSurfaceCreated();
@@ -106,6 +195,16 @@ JNIEXPORT void JNICALL native_OnDrawFrame(JNIEnv* env,jclass clazz,jint rt)
     VideoGLRender::GetInstance()->OnDrawFrame();
 }
 
+JNIEXPORT void JNICALL native_SetGesture(JNIEnv* env,jclass clazz,jint rt,jfloat x_rotate_angle,jfloat y_rotate_angle,jfloat scale)
+{
+    VideoGLRender::GetInstance()->UpdateMVPMatrix(x_rotate_angle, y_rotate_angle, scale, scale);
+}
+
+JNIEXPORT void JNICALL native_SetTouchLoc(JNIEnv* env,jclass clazz,jint rt,jfloat touch_x,jfloat touch_y)
+{
+    VideoGLRender::GetInstance()->SetTouchLoc(touch_x, touch_y);
+}
+
 JNIEXPORT void JNICALL Test(JNIEnv* env,jclass clazz){
 
 }
@@ -116,15 +215,27 @@ JNIEXPORT void JNICALL Test(JNIEnv* env,jclass clazz){
 
 static JNINativeMethod g_NativeMethod[] = {
         {"native_Init",             "(Ljava/lang/String;I)J",        (void*)native_Init},
+        {"native_SetNextDataSource", "(JLjava/lang/String;)V",       (void*)native_SetNextDataSource},
+        {"native_SetPlaybackSpeed", "(JF)V",                          (void*)native_SetPlaybackSpeed},
+        {"native_Prepare",          "(J)V",                          (void*)native_Prepare},
         {"native_Play",             "(J)V",                          (void*)native_Play},
-        {"native_SeekToPosition",   "(JF)V",                         (void*)native_SeekToPosition},
+        {"native_SeekToPosition",   "(JFI)V",                        (void*)native_SeekToPosition},
         {"native_Pause",            "(J)V",                          (void*)native_Pause},
         {"native_Stop",             "(J)V",                          (void*)native_Stop},
         {"native_UnInit",           "(J)V",                          (void*)native_UnInit},
         {"native_GetMediaParams",   "(JI)J",                         (void*)native_GetMediaParams},
+        {"native_SetMediaParams",   "(JIJ)V",                        (void*)native_SetMediaParams},
+        {"native_SetDecoderThreadPolicy", "(JIII)V",                 (void*)native_SetDecoderThreadPolicy},
+        {"native_GetThumbnail",     "(JF)[I",                        (void*)native_GetThumbnail},
+        {"native_SetCacheDir",      "(Ljava/lang/String;)V",         (void*)native_SetCacheDir},
+        {"native_SetMediaCacheBudget", "(J)V",                       (void*)native_SetMediaCacheBudget},
+        {"native_SetTextureUploadMode", "(I)V",                      (void*)native_SetTextureUploadMode},
+        {"native_OnVsync",          "(J)V",                          (void*)native_OnVsync},
         {"native_OnSurfaceCreated", "(I)V",                          (void*)native_OnSurfaceCreated},
         {"native_OnSurfaceChanged", "(III)V",                        (void*)native_OnSurfaceChanged},
-        {"native_OnDrawFrame",      "(I)V",                          (void*)native_OnDrawFrame}
+        {"native_OnDrawFrame",      "(I)V",                          (void*)native_OnDrawFrame},
+        {"native_SetGesture",       "(IFFF)V",                       (void*)native_SetGesture},
+        {"native_SetTouchLoc",      "(IFF)V",                        (void*)native_SetTouchLoc}
 };
 
 static JNINativeMethod g_test[] = {
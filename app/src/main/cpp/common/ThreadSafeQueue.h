@@ -5,6 +5,203 @@
 #ifndef FFMPEGEXERCISE_THREADSAFEQUEUE_H
 #define FFMPEGEXERCISE_THREADSAFEQUEUE_H
 
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
+//有界环形队列, 用于 解复用 -> 解码 -> 渲染 各个阶段之间传递数据.
+//容量同时受元素个数、字节数和时长限制, 生产者和消费者阻塞时由对端直接唤醒, 不做轮询.
+//元素预先分配在环形数组中, 入队出队不产生堆内存分配.
+template<typename T>
+class ThreadSafeQueue
+{
+public:
+    //maxBytes, maxDuration 为 0 时表示不限制
+    ThreadSafeQueue(int maxCount, int64_t maxBytes = 0, int64_t maxDuration = 0)
+            : m_Ring(maxCount > 0 ? maxCount : 1)
+    {
+        m_MaxCount = static_cast<int>(m_Ring.size());
+        m_MaxBytes = maxBytes;
+        m_MaxDuration = maxDuration;
+    }
+
+    //队列满时阻塞, 被 Abort 时返回 false, 元素的所有权仍归调用者
+    bool Push(const T &item, int64_t bytes = 0, int64_t duration = 0)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (!m_Abort && IsFull())
+        {
+            m_NotFullCond.wait(lock);
+        }
+
+        if(m_Abort)
+            return false;
+
+        PushLocked(item, bytes, duration);
+        return true;
+    }
+
+    //非阻塞入队, 队列满或者被 Abort 时返回 false
+    bool TryPush(const T &item, int64_t bytes = 0, int64_t duration = 0)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if(m_Abort || IsFull())
+            return false;
+
+        PushLocked(item, bytes, duration);
+        return true;
+    }
+
+    //队列空时阻塞, 被 Abort 时返回 false
+    bool Pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (!m_Abort && m_Count == 0)
+        {
+            m_NotEmptyCond.wait(lock);
+        }
+
+        if(m_Abort)
+            return false;
+
+        PopLocked(item);
+        return true;
+    }
+
+    //非阻塞出队, 队列空或者被 Abort 时返回 false
+    bool TryPop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if(m_Abort || m_Count == 0)
+            return false;
+
+        PopLocked(item);
+        return true;
+    }
+
+    //阻塞直到队列中至少有 count 个元素或者队列已满, 被 Abort 时返回 false
+    bool WaitForCount(int count)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (!m_Abort && m_Count < count && !IsFull())
+        {
+            m_NotEmptyCond.wait(lock);
+        }
+        return !m_Abort;
+    }
+
+    //清空队列, releaser 用于释放出队的元素
+    template<typename Releaser>
+    void Clear(Releaser releaser)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        T item;
+        while (m_Count > 0)
+        {
+            PopLocked(item);
+            releaser(item);
+        }
+    }
+
+    //中止队列, 唤醒所有阻塞的生产者和消费者
+    void Abort()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Abort = true;
+        m_NotFullCond.notify_all();
+        m_NotEmptyCond.notify_all();
+    }
+
+    void Reset()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Abort = false;
+    }
+
+    bool IsAborted()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Abort;
+    }
+
+    int Size()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Count;
+    }
+
+    int64_t Bytes()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Bytes;
+    }
+
+    int64_t Duration()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return m_Duration;
+    }
+
+private:
+    struct Entry
+    {
+        T item;
+        int64_t bytes;
+        int64_t duration;
+    };
+
+    //空队列总是允许入队一个元素, 避免单个超大元素永远无法入队
+    bool IsFull()
+    {
+        if(m_Count == 0) return false;
+        if(m_Count >= m_MaxCount) return true;
+        if(m_MaxBytes > 0 && m_Bytes >= m_MaxBytes) return true;
+        if(m_MaxDuration > 0 && m_Duration >= m_MaxDuration) return true;
+        return false;
+    }
+
+    void PushLocked(const T &item, int64_t bytes, int64_t duration)
+    {
+        Entry &entry = m_Ring[m_Tail];
+        entry.item = item;
+        entry.bytes = bytes;
+        entry.duration = duration;
+        m_Tail = (m_Tail + 1) % m_MaxCount;
+        m_Count++;
+        m_Bytes += bytes;
+        m_Duration += duration;
+        m_NotEmptyCond.notify_all();
+    }
+
+    void PopLocked(T &item)
+    {
+        Entry &entry = m_Ring[m_Head];
+        item = entry.item;
+        m_Head = (m_Head + 1) % m_MaxCount;
+        m_Count--;
+        m_Bytes -= entry.bytes;
+        m_Duration -= entry.duration;
+        entry.item = T();
+        m_NotFullCond.notify_all();
+    }
+
+    std::vector<Entry> m_Ring;
+    int m_Head = 0;
+    int m_Tail = 0;
+    int m_Count = 0;
+    int m_MaxCount = 0;
+
+    int64_t m_Bytes = 0;
+    int64_t m_Duration = 0;
+    int64_t m_MaxBytes = 0;
+    int64_t m_MaxDuration = 0;
+
+    bool m_Abort = false;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_NotFullCond;
+    std::condition_variable m_NotEmptyCond;
+};
 
 #endif //FFMPEGEXERCISE_THREADSAFEQUEUE_H
@@ -5,42 +5,55 @@
 #include "FFMediaPlayer.h"
 #include "OpenSLRender.h"
 #include "VideoGLRender.h"
+#include "VsyncSource.h"
 
 void FFMediaPlayer::Init(JNIEnv *jniEnv, jobject obj, char *url, int renderType, jobject surface)
 {
     jniEnv->GetJavaVM(&m_JavaVM);
     m_JavaObj = jniEnv->NewGlobalRef(obj);
 
-    m_VideoDecoder = new VideoDecoder(url);
-    m_AudioDecoder = new AudioDecoder(url);
-
-    m_VideoDecoder->SetVideoRender(VideoGLRender::GetInstance());
-
+    //音频渲染器由播放器持有, 播放列表切换条目时不重新创建 OpenSL 播放器
     m_AudioRender = new OpenSLRender();
-    m_AudioDecoder->SetAudioRender(m_AudioRender);
+    m_AudioRender->Init();
 
-    m_VideoDecoder->SetMessageCallback(this, PostMessage);
-    m_AudioDecoder->SetMessageCallback(this, PostMessage);
+    //音视频解码器共享一个解复用器, 输入只打开和读取一次
+    CreateItem(url, m_Demuxer, m_VideoDecoder, m_AudioDecoder);
+    //拖动进度条时的缩略图, 使用独立的输入和解码器
+    m_ThumbnailDecoder = new ThumbnailDecoder(url);
+
+    //准备阶段视频送显第一帧, 音频填满 OpenSL 缓冲队列
+    m_VideoDecoder->SetPrerollFrameCount(1);
+    m_AudioDecoder->SetPrerollFrameCount(MAX_QUEUE_BUFFER_SIZE);
 }
 
 void FFMediaPlayer::UnInit() {
     LOGCATE("FFMediaPlayer::UnInit");
-    if(m_VideoDecoder) {
-        delete m_VideoDecoder;
-        m_VideoDecoder = nullptr;
-    }
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    Demuxer *demuxer = m_Demuxer;
+    VideoDecoder *videoDecoder = m_VideoDecoder;
+    AudioDecoder *audioDecoder = m_AudioDecoder;
+    ThumbnailDecoder *thumbnailDecoder = m_ThumbnailDecoder;
+    m_Demuxer = nullptr;
+    m_VideoDecoder = nullptr;
+    m_AudioDecoder = nullptr;
+    m_ThumbnailDecoder = nullptr;
+    lock.unlock();
+
+    //在锁外销毁, 音频渲染线程可能正在等待 m_ItemMutex 切换条目
+    if(thumbnailDecoder)
+        delete thumbnailDecoder;
+
+    DestroyItem(demuxer, videoDecoder, audioDecoder);
+    DestroyItem(m_NextDemuxer, m_NextVideoDecoder, m_NextAudioDecoder);
+    DestroyItem(m_RetiredDemuxer, m_RetiredVideoDecoder, m_RetiredAudioDecoder);
 
     if(m_VideoRender) {
         delete m_VideoRender;
         m_VideoRender = nullptr;
     }
 
-    if(m_AudioDecoder) {
-        delete m_AudioDecoder;
-        m_AudioDecoder = nullptr;
-    }
-
     if(m_AudioRender) {
+        m_AudioRender->UnInit();
         delete m_AudioRender;
         m_AudioRender = nullptr;
     }
@@ -54,8 +67,106 @@ void FFMediaPlayer::UnInit() {
 
 }
 
+void FFMediaPlayer::SetNextDataSource(const char *url) {
+    LOGCATE("FFMediaPlayer::SetNextDataSource url=%s", url);
+    Demuxer *demuxer = nullptr;
+    VideoDecoder *videoDecoder = nullptr;
+    AudioDecoder *audioDecoder = nullptr;
+    CreateItem(url, demuxer, videoDecoder, audioDecoder);
+
+    //只解码填满解码帧队列, 不送显, 切换时可以立即输出
+    videoDecoder->SetPrerollFrameCount(0);
+    audioDecoder->SetPrerollFrameCount(0);
+    videoDecoder->SetRenderInitialized(true);
+    videoDecoder->SetWaitForMasterClock(true);
+    demuxer->Start();
+    videoDecoder->Prepare();
+    audioDecoder->Prepare();
+
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    std::swap(demuxer, m_NextDemuxer);
+    std::swap(videoDecoder, m_NextVideoDecoder);
+    std::swap(audioDecoder, m_NextAudioDecoder);
+    strncpy(m_NextUrl, url, MAX_PATH - 1);
+    lock.unlock();
+
+    //替换掉之前设置的条目, 它还没有开始播放, 可以直接销毁
+    DestroyItem(demuxer, videoDecoder, audioDecoder);
+}
+
+void FFMediaPlayer::CreateItem(const char *url, Demuxer *&demuxer, VideoDecoder *&videoDecoder, AudioDecoder *&audioDecoder) {
+    demuxer = new Demuxer(url);
+    videoDecoder = new VideoDecoder(demuxer);
+    audioDecoder = new AudioDecoder(demuxer);
+
+    videoDecoder->SetVideoRender(VideoGLRender::GetInstance());
+    videoDecoder->SetVsyncSource(ChoreographerVsyncSource::GetInstance());
+    audioDecoder->SetAudioRender(m_AudioRender);
+
+    videoDecoder->SetMessageCallback(this, PostMessage);
+    audioDecoder->SetMessageCallback(this, PostMessage);
+
+    ApplyAVSyncMode(m_AVSyncMode, videoDecoder, audioDecoder);
+    videoDecoder->SetPlaybackSpeed(m_PlaybackSpeed);
+    audioDecoder->SetPlaybackSpeed(m_PlaybackSpeed);
+
+    //视频默认按 CPU 核数自动选择帧级/slice 级多线程, 音频解码开销小, 单线程即可
+    videoDecoder->SetDecoderThreadPolicy(m_ThreadType[AVMEDIA_TYPE_VIDEO], m_ThreadCount[AVMEDIA_TYPE_VIDEO]);
+    audioDecoder->SetDecoderThreadPolicy(m_ThreadType[AVMEDIA_TYPE_AUDIO], m_ThreadCount[AVMEDIA_TYPE_AUDIO]);
+    videoDecoder->SetFrameQueueSize(m_VideoFrameQueueSize);
+    demuxer->SetReadAheadBufferSize(m_ReadAheadBufferSize);
+    demuxer->SetReadAheadWatermarks(m_ReadAheadLowWatermark, m_ReadAheadHighWatermark);
+}
+
+void FFMediaPlayer::DestroyItem(Demuxer *&demuxer, VideoDecoder *&videoDecoder, AudioDecoder *&audioDecoder) {
+    if(demuxer)
+        demuxer->Stop();
+
+    if(videoDecoder) {
+        delete videoDecoder;
+        videoDecoder = nullptr;
+    }
+
+    if(audioDecoder) {
+        delete audioDecoder;
+        audioDecoder = nullptr;
+    }
+
+    if(demuxer) {
+        delete demuxer;
+        demuxer = nullptr;
+    }
+}
+
+void FFMediaPlayer::Prepare() {
+    LOGCATE("FFMediaPlayer::Prepare");
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    if(m_PlayStartTime == -1)
+        m_PlayStartTime = GetSysCurrentTime();
+
+    if(m_Demuxer)
+        m_Demuxer->Start();
+
+    if(m_VideoDecoder)
+        m_VideoDecoder->Prepare();
+
+    if(m_AudioDecoder)
+        m_AudioDecoder->Prepare();
+}
+
 void FFMediaPlayer::Play() {
     LOGCATE("FFMediaPlayer::Play");
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    m_Playing = true;
+    if(m_PlayStartTime == -1)
+        m_PlayStartTime = GetSysCurrentTime();
+
+    if(m_Demuxer)
+        m_Demuxer->Start();
+
+    if(m_ThumbnailDecoder)
+        m_ThumbnailDecoder->Start();
+
     if(m_VideoDecoder)
         m_VideoDecoder->Start();
 
@@ -65,6 +176,8 @@ void FFMediaPlayer::Play() {
 
 void FFMediaPlayer::Pause() {
     LOGCATE("FFMediaPlayer::Pause");
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    m_Playing = false;
     if(m_VideoDecoder)
         m_VideoDecoder->Pause();
 
@@ -75,15 +188,41 @@ void FFMediaPlayer::Pause() {
 
 void FFMediaPlayer::Stop() {
     LOGCATE("FFMediaPlayer::Stop");
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    m_Playing = false;
+    if(m_Demuxer)
+        m_Demuxer->Stop();
+
+    if(m_ThumbnailDecoder)
+        m_ThumbnailDecoder->Stop();
+
     if(m_VideoDecoder)
         m_VideoDecoder->Stop();
 
     if(m_AudioDecoder)
         m_AudioDecoder->Stop();
+
+    if(m_NextDemuxer)
+        m_NextDemuxer->Stop();
+
+    if(m_NextVideoDecoder)
+        m_NextVideoDecoder->Stop();
+
+    if(m_NextAudioDecoder)
+        m_NextAudioDecoder->Stop();
+    lock.unlock();
+
+    //渲染器由播放器持有, 停止时释放 OpenSL 播放器, 同时唤醒阻塞在渲染队列上的音频渲染线程
+    if(m_AudioRender)
+        m_AudioRender->UnInit();
 }
 
-void FFMediaPlayer::SeekToPosition(float position) {
-    LOGCATE("FFMediaPlayer::SeekToPosition position=%f", position);
+void FFMediaPlayer::SeekToPosition(float position, int seekMode) {
+    LOGCATE("FFMediaPlayer::SeekToPosition position=%f, seekMode=%d", position, seekMode);
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    if(m_Demuxer)
+        m_Demuxer->SeekToPosition(position, seekMode);
+
     if(m_VideoDecoder)
         m_VideoDecoder->SeekToPosition(position);
 
@@ -92,8 +231,59 @@ void FFMediaPlayer::SeekToPosition(float position) {
 
 }
 
+bool FFMediaPlayer::OnStreamComplete(int mediaType, int &itemIndex) {
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    if(m_Demuxer == nullptr || m_NextDemuxer == nullptr)
+        return false;
+
+    //有音频时以音频播放完成为准, 下一个条目的音频紧接着送入同一个 OpenSL 缓冲队列
+    int masterType = m_Demuxer->GetStreamIndex(AVMEDIA_TYPE_AUDIO) >= 0 ? AVMEDIA_TYPE_AUDIO : AVMEDIA_TYPE_VIDEO;
+    if(mediaType != masterType)
+        return false;
+
+    LOGCATE("FFMediaPlayer::OnStreamComplete switch to item %d, url=%s", m_ItemIndex + 1, m_NextUrl);
+    Demuxer *retiredDemuxer = m_RetiredDemuxer;
+    VideoDecoder *retiredVideoDecoder = m_RetiredVideoDecoder;
+    AudioDecoder *retiredAudioDecoder = m_RetiredAudioDecoder;
+    ThumbnailDecoder *thumbnailDecoder = m_ThumbnailDecoder;
+
+    m_RetiredDemuxer = m_Demuxer;
+    m_RetiredVideoDecoder = m_VideoDecoder;
+    m_RetiredAudioDecoder = m_AudioDecoder;
+
+    m_Demuxer = m_NextDemuxer;
+    m_VideoDecoder = m_NextVideoDecoder;
+    m_AudioDecoder = m_NextAudioDecoder;
+    m_NextDemuxer = nullptr;
+    m_NextVideoDecoder = nullptr;
+    m_NextAudioDecoder = nullptr;
+    m_ThumbnailDecoder = new ThumbnailDecoder(m_NextUrl);
+    m_ItemIndex++;
+    itemIndex = m_ItemIndex;
+
+    //下一个条目的解码帧队列已经填满, 先启动它, 再停止当前条目
+    if(m_Playing) {
+        m_VideoDecoder->Start();
+        m_AudioDecoder->Start();
+        m_ThumbnailDecoder->Start();
+    }
+
+    //当前线程就是被切换条目的渲染线程, 只停止不销毁
+    m_RetiredDemuxer->Stop();
+    m_RetiredVideoDecoder->Stop();
+    m_RetiredAudioDecoder->Stop();
+    lock.unlock();
+
+    //上一次切换走的条目的线程已经退出, 销毁不会阻塞
+    DestroyItem(retiredDemuxer, retiredVideoDecoder, retiredAudioDecoder);
+    if(thumbnailDecoder)
+        delete thumbnailDecoder;
+    return true;
+}
+
 long FFMediaPlayer::GetMediaParams(int paramType) {
     LOGCATE("FFMediaPlayer::GetMediaParams paramType=%d", paramType);
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
     long value = 0;
     switch(paramType)
     {
@@ -106,10 +296,147 @@ long FFMediaPlayer::GetMediaParams(int paramType) {
         case MEDIA_PARAM_VIDEO_DURATION:
             value = m_VideoDecoder != nullptr ? m_VideoDecoder->GetDuration() : 0;
             break;
+        case MEDIA_PARAM_VIDEO_DECODE_FPS:
+            value = m_VideoDecoder != nullptr ? m_VideoDecoder->GetDecodeFps() : 0;
+            break;
+        case MEDIA_PARAM_AUDIO_DECODE_FPS:
+            value = m_AudioDecoder != nullptr ? m_AudioDecoder->GetDecodeFps() : 0;
+            break;
+        case MEDIA_PARAM_BUFFERED_BYTES:
+            value = m_Demuxer != nullptr ? m_Demuxer->GetBufferedBytes() : 0;
+            break;
+        case MEDIA_PARAM_BUFFERED_DURATION:
+            value = m_Demuxer != nullptr ? m_Demuxer->GetBufferedDuration() : 0;
+            break;
+        case MEDIA_PARAM_TIME_TO_FIRST_FRAME:
+        {
+            long firstFrameTime = -1;
+            if(m_VideoDecoder != nullptr)
+                firstFrameTime = m_VideoDecoder->GetFirstFrameTime();
+            if(firstFrameTime == -1 && m_AudioDecoder != nullptr && m_Demuxer != nullptr &&
+               m_Demuxer->GetStreamIndex(AVMEDIA_TYPE_VIDEO) < 0)
+                firstFrameTime = m_AudioDecoder->GetFirstFrameTime();
+            value = firstFrameTime != -1 && m_PlayStartTime != -1 ? firstFrameTime - m_PlayStartTime : -1;
+            break;
+        }
+        case MEDIA_PARAM_TEXTURE_UPLOAD_TIME:
+            //ANativeWindow 渲染和纯音频时没有 GL 渲染器, 不能在这里创建
+            value = VideoGLRender::GetInstanceAverageUploadTime();
+            break;
+        case MEDIA_PARAM_CADENCE_ERROR:
+            value = m_VideoDecoder != nullptr ? m_VideoDecoder->GetCadenceError() : 0;
+            break;
+        case MEDIA_PARAM_VIDEO_FRAME_QUEUE_SIZE:
+            value = m_VideoFrameQueueSize;
+            break;
+        case MEDIA_PARAM_READ_AHEAD_BUFFER_SIZE:
+            value = m_ReadAheadBufferSize;
+            break;
+        case MEDIA_PARAM_READ_AHEAD_LOW_WATERMARK:
+            value = (long)m_ReadAheadLowWatermark;
+            break;
+        case MEDIA_PARAM_READ_AHEAD_HIGH_WATERMARK:
+            value = (long)m_ReadAheadHighWatermark;
+            break;
     }
     return value;
 }
 
+void FFMediaPlayer::SetMediaParams(int paramType, long value) {
+    LOGCATE("FFMediaPlayer::SetMediaParams paramType=%d, value=%ld", paramType, value);
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    switch(paramType)
+    {
+        case MEDIA_PARAM_VIDEO_FRAME_QUEUE_SIZE:
+            m_VideoFrameQueueSize = value > 0 ? static_cast<int>(value) : 1;
+            if(m_VideoDecoder)
+                m_VideoDecoder->SetFrameQueueSize(m_VideoFrameQueueSize);
+            break;
+        case MEDIA_PARAM_READ_AHEAD_BUFFER_SIZE:
+            m_ReadAheadBufferSize = value > 0 ? static_cast<int>(value) : READ_AHEAD_DEFAULT_BUFFER_SIZE;
+            if(m_Demuxer)
+                m_Demuxer->SetReadAheadBufferSize(m_ReadAheadBufferSize);
+            break;
+        case MEDIA_PARAM_READ_AHEAD_LOW_WATERMARK:
+        case MEDIA_PARAM_READ_AHEAD_HIGH_WATERMARK:
+            if(paramType == MEDIA_PARAM_READ_AHEAD_LOW_WATERMARK)
+                m_ReadAheadLowWatermark = value;
+            else
+                m_ReadAheadHighWatermark = value;
+            if(m_Demuxer)
+                m_Demuxer->SetReadAheadWatermarks(m_ReadAheadLowWatermark, m_ReadAheadHighWatermark);
+            break;
+        default:
+            LOGCATE("FFMediaPlayer::SetMediaParams unsupported paramType=%d", paramType);
+            break;
+    }
+}
+
+bool FFMediaPlayer::GetThumbnail(float position, Thumbnail &thumbnail) {
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    if(m_ThumbnailDecoder == nullptr)
+        return false;
+    return m_ThumbnailDecoder->GetThumbnail(static_cast<long>(position * 1000), thumbnail);
+}
+
+void FFMediaPlayer::SetAVSyncMode(int syncMode) {
+    LOGCATE("FFMediaPlayer::SetAVSyncMode syncMode=%d", syncMode);
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    m_AVSyncMode = syncMode;
+    ApplyAVSyncMode(syncMode, m_VideoDecoder, m_AudioDecoder);
+    ApplyAVSyncMode(syncMode, m_NextVideoDecoder, m_NextAudioDecoder);
+}
+
+void FFMediaPlayer::SetPlaybackSpeed(float speed) {
+    LOGCATE("FFMediaPlayer::SetPlaybackSpeed speed=%f", speed);
+    if(speed < MIN_PLAYBACK_SPEED) speed = MIN_PLAYBACK_SPEED;
+    if(speed > MAX_PLAYBACK_SPEED) speed = MAX_PLAYBACK_SPEED;
+
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    m_PlaybackSpeed = speed;
+    if(m_VideoDecoder)
+        m_VideoDecoder->SetPlaybackSpeed(speed);
+
+    if(m_AudioDecoder)
+        m_AudioDecoder->SetPlaybackSpeed(speed);
+
+    if(m_NextVideoDecoder)
+        m_NextVideoDecoder->SetPlaybackSpeed(speed);
+
+    if(m_NextAudioDecoder)
+        m_NextAudioDecoder->SetPlaybackSpeed(speed);
+}
+
+void FFMediaPlayer::ApplyAVSyncMode(int syncMode, VideoDecoder *videoDecoder, AudioDecoder *audioDecoder) {
+    if(videoDecoder == nullptr || audioDecoder == nullptr)
+        return;
+
+    if(syncMode == AV_SYNC_AUDIO_MASTER) {
+        //音频时钟取自 OpenSL 的播放位置, 没有音频流时视频自动退回到系统时钟
+        audioDecoder->SetAVSyncMaster(true);
+        videoDecoder->SetAVSyncCallback(audioDecoder, AudioDecoder::GetAudioDecoderTimestampForAVSync);
+    } else {
+        audioDecoder->SetAVSyncMaster(false);
+        videoDecoder->SetAVSyncCallback(nullptr, nullptr);
+    }
+}
+
+void FFMediaPlayer::SetDecoderThreadPolicy(int mediaType, int threadType, int threadCount) {
+    LOGCATE("FFMediaPlayer::SetDecoderThreadPolicy mediaType=%d, threadType=%d, threadCount=%d", mediaType, threadType, threadCount);
+    std::unique_lock<std::mutex> lock(m_ItemMutex);
+    if(mediaType == AVMEDIA_TYPE_VIDEO && m_VideoDecoder)
+        m_VideoDecoder->SetDecoderThreadPolicy(threadType, threadCount);
+
+    if(mediaType == AVMEDIA_TYPE_AUDIO && m_AudioDecoder)
+        m_AudioDecoder->SetDecoderThreadPolicy(threadType, threadCount);
+
+    //之后设置的播放列表条目沿用
+    if(mediaType == AVMEDIA_TYPE_VIDEO || mediaType == AVMEDIA_TYPE_AUDIO) {
+        m_ThreadType[mediaType] = threadType;
+        m_ThreadCount[mediaType] = threadCount;
+    }
+}
+
 JNIEnv *FFMediaPlayer::GetJNIEnv(bool *isAttach) {
     JNIEnv *env;
     int status;
@@ -142,16 +469,68 @@ void FFMediaPlayer::PostMessage(void *context, int msgType, float msgCode) {
     if(context != nullptr)
     {
         FFMediaPlayer *player = static_cast<FFMediaPlayer *>(context);
-        bool isAttach = false;
-        JNIEnv *env = player->GetJNIEnv(&isAttach);
-        LOGCATE("FFMediaPlayer::PostMessage env=%p", env);
-        if(env == nullptr)
-            return;
-        jobject javaObj = player->GetJavaObj();
-        jmethodID mid = env->GetMethodID(env->GetObjectClass(javaObj), JAVA_PLAYER_EVENT_CALLBACK_API_NAME, "(IF)V");
-        env->CallVoidMethod(javaObj, mid, msgType, msgCode);
-        if(isAttach)
-            player->GetJavaVM()->DetachCurrentThread();
-
+        switch (msgType)
+        {
+            case MSG_DECODER_READY:
+                //音视频都准备完成后才通知上层
+                if(player->UpdateReadyState(static_cast<int>(msgCode)))
+                    player->CallJavaEventCallback(MSG_DECODER_READY, msgCode);
+                break;
+            case MSG_DECODER_COMPLETE:
+            {
+                //有下一个条目时直接切换, 上层只收到 MSG_MEDIA_ITEM_CHANGED.
+                //条目序号在切换时的锁内取得, 这里不再读 m_ItemIndex
+                int itemIndex = 0;
+                if(player->OnStreamComplete(static_cast<int>(msgCode), itemIndex))
+                    player->CallJavaEventCallback(MSG_MEDIA_ITEM_CHANGED, itemIndex);
+                else
+                    player->CallJavaEventCallback(msgType, msgCode);
+                break;
+            }
+            case MSG_DECODER_INIT_ERROR:
+                //初始化失败的流不再等待, 另一路流仍然可以播放
+                player->CallJavaEventCallback(msgType, msgCode);
+                if(player->UpdateReadyState(static_cast<int>(msgCode)))
+                    player->CallJavaEventCallback(MSG_DECODER_READY, msgCode);
+                break;
+            default:
+                player->CallJavaEventCallback(msgType, msgCode);
+                break;
+        }
     }
-}
\ No newline at end of file
+}
+
+bool FFMediaPlayer::UpdateReadyState(int mediaType) {
+    //m_Demuxer 可能被 OnStreamComplete 在其他线程替换, 与其他条目访问一样先获取 m_ItemMutex
+    std::unique_lock<std::mutex> itemLock(m_ItemMutex);
+    std::unique_lock<std::mutex> lock(m_ReadyMutex);
+    m_ReadyMask |= 1 << mediaType;
+    if(m_ReadyPosted || m_Demuxer == nullptr)
+        return false;
+
+    int requiredMask = 0;
+    if(m_Demuxer->GetStreamIndex(AVMEDIA_TYPE_VIDEO) >= 0)
+        requiredMask |= 1 << AVMEDIA_TYPE_VIDEO;
+    if(m_Demuxer->GetStreamIndex(AVMEDIA_TYPE_AUDIO) >= 0)
+        requiredMask |= 1 << AVMEDIA_TYPE_AUDIO;
+
+    if((m_ReadyMask & requiredMask) != requiredMask)
+        return false;
+
+    LOGCATE("FFMediaPlayer::UpdateReadyState ready, mask=%d", m_ReadyMask);
+    m_ReadyPosted = true;
+    return true;
+}
+
+void FFMediaPlayer::CallJavaEventCallback(int msgType, float msgCode) {
+    bool isAttach = false;
+    JNIEnv *env = GetJNIEnv(&isAttach);
+    LOGCATE("FFMediaPlayer::CallJavaEventCallback env=%p", env);
+    if(env == nullptr)
+        return;
+    jobject javaObj = GetJavaObj();
+    jmethodID mid = env->GetMethodID(env->GetObjectClass(javaObj), JAVA_PLAYER_EVENT_CALLBACK_API_NAME, "(IF)V");
+    env->CallVoidMethod(javaObj, mid, msgType, msgCode);
+    if(isAttach)
+        GetJavaVM()->DetachCurrentThread();
+}
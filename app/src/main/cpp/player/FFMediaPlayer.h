@@ -6,8 +6,10 @@
 #define FFMPEGEXERCISE_FFMEDIAPLAYER_H
 
 #include <jni.h>
+#include "decoder/Demuxer.h"
 #include "decoder/VideoDecoder.h"
 #include "decoder/AudioDecoder.h"
+#include "decoder/ThumbnailDecoder.h"
 #include "render/audio/AudioRender.h"
 
 #define JAVA_PLAYER_EVENT_CALLBACK_API_NAME "playerEventCallback"
@@ -15,6 +17,27 @@
 #define MEDIA_PARAM_VIDEO_WIDTH         0x0001
 #define MEDIA_PARAM_VIDEO_HEIGHT        0x0002
 #define MEDIA_PARAM_VIDEO_DURATION      0x0003
+#define MEDIA_PARAM_VIDEO_DECODE_FPS    0x0004
+#define MEDIA_PARAM_AUDIO_DECODE_FPS    0x0005
+#define MEDIA_PARAM_BUFFERED_BYTES      0x0006
+#define MEDIA_PARAM_BUFFERED_DURATION   0x0007
+//首帧耗时(ms), 从第一次 Play 到第一帧画面送显, 没有视频时为第一帧音频
+#define MEDIA_PARAM_TIME_TO_FIRST_FRAME 0x0008
+//渲染线程每帧纹理上传的平均耗时(us)
+#define MEDIA_PARAM_TEXTURE_UPLOAD_TIME 0x0009
+//按 vsync 送显时, 视频帧 pts 与上屏时间的平均偏差(us)
+#define MEDIA_PARAM_CADENCE_ERROR       0x000A
+//可以通过 SetMediaParams 设置的参数, 需要在 Prepare/Play 之前设置, 播放列表后续条目沿用
+//视频解码线程最多领先渲染的帧数
+#define MEDIA_PARAM_VIDEO_FRAME_QUEUE_SIZE 0x000B
+//预读缓冲区大小, 以及开始/暂停填充的未读字节数, 水位 <=0 使用默认值
+#define MEDIA_PARAM_READ_AHEAD_BUFFER_SIZE    0x000C
+#define MEDIA_PARAM_READ_AHEAD_LOW_WATERMARK  0x000D
+#define MEDIA_PARAM_READ_AHEAD_HIGH_WATERMARK 0x000E
+
+//音视频同步方式
+#define AV_SYNC_AUDIO_MASTER            0  //视频向音频同步, 默认方式
+#define AV_SYNC_SYSTEM_CLOCK            1  //音视频分别向系统时钟同步
 
 class FFMediaPlayer{
 public:
@@ -24,25 +47,84 @@ public:
     void Init(JNIEnv *jniEnv, jobject obj, char *url, int renderType, jobject surface);
     void UnInit();
 
+    //播放列表的下一个条目, 立即在后台打开并预先解码, 当前条目播放完成后无缝切换.
+    //重复调用时替换之前设置的条目
+    void SetNextDataSource(const char *url);
+
+    //后台打开输入并预先送显第一帧, 所有流准备完成后回调 MSG_DECODER_READY, 保持暂停直到 Play
+    void Prepare();
     void Play();
     void Pause();
     void Stop();
-    void SeekToPosition(float position);
+    //seekMode 取值为 SEEK_MODE_EXACT/SEEK_MODE_PREVIEW
+    void SeekToPosition(float position, int seekMode = SEEK_MODE_EXACT);
     long GetMediaParams(int paramType);
+    void SetMediaParams(int paramType, long value);
+    void SetAVSyncMode(int syncMode);
+    //倍速播放, 范围 MIN_PLAYBACK_SPEED~MAX_PLAYBACK_SPEED, 音频变速不变调
+    void SetPlaybackSpeed(float speed);
+    //mediaType 取值为 AVMEDIA_TYPE_VIDEO/AVMEDIA_TYPE_AUDIO, 需要在 Play 之前设置
+    void SetDecoderThreadPolicy(int mediaType, int threadType, int threadCount);
+    //查询 position(s) 附近的缩略图, 未命中时返回 false
+    bool GetThumbnail(float position, Thumbnail &thumbnail);
 
 private:
     JNIEnv* GetJNIEnv(bool* isAttach);
     jobject GetJavaObj();
     JavaVM* GetJavaVM();
 
+    //创建一个条目的解复用器和解码器, 共享播放器的渲染器
+    void CreateItem(const char *url, Demuxer *&demuxer, VideoDecoder *&videoDecoder, AudioDecoder *&audioDecoder);
+    static void DestroyItem(Demuxer *&demuxer, VideoDecoder *&videoDecoder, AudioDecoder *&audioDecoder);
+    static void ApplyAVSyncMode(int syncMode, VideoDecoder *videoDecoder, AudioDecoder *audioDecoder);
+    //mediaType 的最后一帧已经送显, 切换到下一个条目时返回 true, itemIndex 为切换后的条目序号
+    bool OnStreamComplete(int mediaType, int &itemIndex);
+
     static void PostMessage(void* context,int msgType, float msgCode);
+    void CallJavaEventCallback(int msgType, float msgCode);
+    //记录 mediaType 已准备完成, 存在的流都准备完成时返回 true, 只返回一次
+    bool UpdateReadyState(int mediaType);
 
     JavaVM* m_JavaVM = nullptr;
     jobject m_JavaObj = nullptr;
 
+    Demuxer* m_Demuxer = nullptr;
+
     VideoDecoder* m_VideoDecoder = nullptr;
     AudioDecoder* m_AudioDecoder = nullptr;
 
+    ThumbnailDecoder* m_ThumbnailDecoder = nullptr;
+
+    //播放列表中预先准备好的下一个条目
+    Demuxer* m_NextDemuxer = nullptr;
+    VideoDecoder* m_NextVideoDecoder = nullptr;
+    AudioDecoder* m_NextAudioDecoder = nullptr;
+    char m_NextUrl[MAX_PATH] = {0};
+    //已经切换走的条目, 切换发生在它自己的渲染线程中, 不能立即销毁, 下一次切换或者 UnInit 时释放
+    Demuxer* m_RetiredDemuxer = nullptr;
+    VideoDecoder* m_RetiredVideoDecoder = nullptr;
+    AudioDecoder* m_RetiredAudioDecoder = nullptr;
+    int m_ItemIndex = 0;
+    //保护当前条目和下一个条目, 切换条目发生在音频渲染线程
+    std::mutex m_ItemMutex;
+
+    bool m_Playing = false;
+    int m_AVSyncMode = AV_SYNC_AUDIO_MASTER;
+    float m_PlaybackSpeed = 1.0f;
+    //按媒体类型保存的解码线程策略, 后续条目沿用
+    int m_ThreadType[2] = {DECODER_THREAD_AUTO, DECODER_THREAD_SLICE};
+    int m_ThreadCount[2] = {0, 1};
+    int m_VideoFrameQueueSize = DEFAULT_FRAME_QUEUE_SIZE;
+    int m_ReadAheadBufferSize = READ_AHEAD_DEFAULT_BUFFER_SIZE;
+    int64_t m_ReadAheadLowWatermark = 0;
+    int64_t m_ReadAheadHighWatermark = 0;
+
+    long m_PlayStartTime = -1;
+
+    std::mutex m_ReadyMutex;
+    int m_ReadyMask = 0;
+    bool m_ReadyPosted = false;
+
     VideoRender* m_VideoRender = nullptr;
     AudioRender* m_AudioRender = nullptr;
 };
@@ -5,6 +5,8 @@
 #include "AudioDecoder.h"
 #include "LogUtil.h"
 
+std::atomic<int> AudioDecoder::s_TagCounter(0);
+
 void AudioDecoder::OnDecoderReady() {
     LOGCATE("AudioDecoder::OnDecoderReady");
     if(m_AudioRender) {
@@ -33,8 +35,7 @@ void AudioDecoder::OnDecoderReady() {
         LOGCATE("AudioDecoder::OnDecoderReady [m_nbSamples, m_DstFrameDataSze]=[%d, %d]", m_nbSamples, m_DstFrameDataSze);
 
         m_AudioOutBuffer = (uint8_t *) malloc(m_DstFrameDataSze);
-
-        m_AudioRender->Init();
+        m_FilterFrame = av_frame_alloc();
 
     } else {
         LOGCATE("AudioDecoder::OnDecoderReady m_AudioRender == null");
@@ -45,18 +46,206 @@ void AudioDecoder::OnDecoderReady() {
 void AudioDecoder::OnFrameAvailable(AVFrame *frame) {
     LOGCATE("AudioDecoder::OnFrameAvailable frame=%p, frame->nb_samples=%d", frame, frame->nb_samples);
     if(m_AudioRender) {
-        int result = swr_convert(m_SwrContext, &m_AudioOutBuffer, m_DstFrameDataSze / 2, (const uint8_t **) frame->data, frame->nb_samples);
-        if (result > 0 ) {
-            m_AudioRender->RenderAudioFrame(m_AudioOutBuffer, m_DstFrameDataSze);
+        if(m_FilterResetRequest) {
+            m_FilterResetRequest = false;
+            FreeFilterGraph();
+        }
+
+        long pts = (long)GetCurrentPosition();
+        UpdateFilterGraph(pts);
+        ConvertAndRender((const uint8_t **) frame->data, frame->nb_samples, pts);
+    }
+}
+
+void AudioDecoder::OnDecoderComplete() {
+    LOGCATE("AudioDecoder::OnDecoderComplete");
+    if(m_AudioRender == nullptr || m_SwrContext == nullptr)
+        return;
+
+    //输出重采样器和滤镜中缓存的采样, 下一个条目的数据紧接着送入同一个渲染队列, 中间不插入静音
+    ConvertAndRender(NULL, 0, (long)GetCurrentPosition());
+    DrainFilterGraph();
+}
+
+void AudioDecoder::ConvertAndRender(const uint8_t **in, int inCount, long pts) {
+    int bytesPerSample = AUDIO_DST_CHANNEL_COUNTS * av_get_bytes_per_sample(DST_SAMPLT_FORMAT);
+    for(;;) {
+        //1 倍速时 swr 直接写入渲染器的缓冲块, 倍速时先写入中转缓冲区再送入滤镜
+        AudioFrame *audioFrame = nullptr;
+        uint8_t *out = m_AudioOutBuffer;
+        int outCount = m_DstFrameDataSze / bytesPerSample;
+        if(m_FilterGraph == nullptr) {
+            audioFrame = m_AudioRender->ObtainAudioFrame();
+            if(audioFrame == nullptr)
+                return;
+            out = audioFrame->data;
+            outCount = audioFrame->capacity / bytesPerSample;
+        }
+
+        int result = swr_convert(m_SwrContext, &out, outCount, in, inCount);
+        if(audioFrame != nullptr) {
+            //按实际转换的采样数计算数据大小, 保证音频时钟准确
+            audioFrame->dataSize = result > 0 ? result * bytesPerSample : 0;
+            audioFrame->pts = pts;
+            audioFrame->tag = m_Tag;
+            m_AudioRender->RenderAudioFrame(audioFrame);
+        } else if(result > 0) {
+            FilterPcm(out, result);
+        }
+
+        //输出缓冲区写满时重采样器中还有数据, 不再送入新的输入继续取出
+        if(result < outCount)
+            break;
+        pts += result * 1000L / AUDIO_DST_SAMPLE_RATE;
+        inCount = 0;
+    }
+}
+
+void AudioDecoder::UpdateFilterGraph(long pts) {
+    float speed = GetPlaybackSpeed();
+    if(speed != m_FilterSpeed) {
+        //先输出旧滤镜中缓存的数据, 切换倍速时声音连续
+        DrainFilterGraph();
+        if(speed != 1.0f)
+            InitFilterGraph(speed, pts);
+        m_FilterSpeed = speed;
+    }
+}
+
+void AudioDecoder::FilterPcm(uint8_t *data, int nbSamples) {
+    int bytesPerSample = AUDIO_DST_CHANNEL_COUNTS * av_get_bytes_per_sample(DST_SAMPLT_FORMAT);
+    AVFrame *frame = av_frame_alloc();
+    frame->format = DST_SAMPLT_FORMAT;
+    frame->channel_layout = AUDIO_DST_CHANNEL_LAYOUT;
+    frame->sample_rate = AUDIO_DST_SAMPLE_RATE;
+    frame->nb_samples = nbSamples;
+    if(av_frame_get_buffer(frame, 0) == 0) {
+        memcpy(frame->data[0], data, nbSamples * bytesPerSample);
+        if(av_buffersrc_add_frame(m_BufferSrcCtx, frame) < 0)
+            LOGCATE("AudioDecoder::FilterPcm av_buffersrc_add_frame fail.");
+    }
+    av_frame_free(&frame);
+
+    RenderFilteredFrames();
+}
+
+int AudioDecoder::InitFilterGraph(float speed, long pts) {
+    int result = -1;
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    do {
+        m_FilterGraph = avfilter_graph_alloc();
+        if(m_FilterGraph == nullptr || outputs == nullptr || inputs == nullptr) {
+            LOGCATE("AudioDecoder::InitFilterGraph alloc fail.");
+            break;
+        }
+
+        char args[256];
+        snprintf(args, sizeof(args), "time_base=1/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%llx",
+                 AUDIO_DST_SAMPLE_RATE, AUDIO_DST_SAMPLE_RATE, av_get_sample_fmt_name(DST_SAMPLT_FORMAT),
+                 (unsigned long long)AUDIO_DST_CHANNEL_LAYOUT);
+        result = avfilter_graph_create_filter(&m_BufferSrcCtx, avfilter_get_by_name("abuffer"), "in", args, NULL, m_FilterGraph);
+        if(result < 0) {
+            LOGCATE("AudioDecoder::InitFilterGraph create abuffer fail. result=%d", result);
+            break;
+        }
+
+        result = avfilter_graph_create_filter(&m_BufferSinkCtx, avfilter_get_by_name("abuffersink"), "out", NULL, NULL, m_FilterGraph);
+        if(result < 0) {
+            LOGCATE("AudioDecoder::InitFilterGraph create abuffersink fail. result=%d", result);
+            break;
+        }
+
+        outputs->name = av_strdup("in");
+        outputs->filter_ctx = m_BufferSrcCtx;
+        outputs->pad_idx = 0;
+        outputs->next = NULL;
+
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = m_BufferSinkCtx;
+        inputs->pad_idx = 0;
+        inputs->next = NULL;
+
+        //atempo 单级只支持 0.5~2.0, 超出范围时串联多级, 输出格式与 OpenSL 一致
+        char filterDesc[256];
+        int length = 0;
+        float tempo = speed;
+        while (tempo > 2.0f) {
+            length += snprintf(filterDesc + length, sizeof(filterDesc) - length, "atempo=2.0,");
+            tempo /= 2.0f;
+        }
+        while (tempo < 0.5f) {
+            length += snprintf(filterDesc + length, sizeof(filterDesc) - length, "atempo=0.5,");
+            tempo /= 0.5f;
+        }
+        snprintf(filterDesc + length, sizeof(filterDesc) - length, "atempo=%.4f,aformat=sample_fmts=%s:sample_rates=%d:channel_layouts=stereo",
+                 tempo, av_get_sample_fmt_name(DST_SAMPLT_FORMAT), AUDIO_DST_SAMPLE_RATE);
+
+        result = avfilter_graph_parse_ptr(m_FilterGraph, filterDesc, &inputs, &outputs, NULL);
+        if(result < 0) {
+            LOGCATE("AudioDecoder::InitFilterGraph avfilter_graph_parse_ptr fail. result=%d, filter=%s", result, filterDesc);
+            break;
+        }
+
+        result = avfilter_graph_config(m_FilterGraph, NULL);
+        if(result < 0) {
+            LOGCATE("AudioDecoder::InitFilterGraph avfilter_graph_config fail. result=%d", result);
+            break;
         }
+
+        LOGCATE("AudioDecoder::InitFilterGraph speed=%.2f, filter=%s, pts=%ld", speed, filterDesc, pts);
+        m_FilterStartPts = pts;
+        m_FilterOutSamples = 0;
+        result = 0;
+    } while (false);
+
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+
+    //创建失败时按 1 倍速输出音频
+    if(result != 0)
+        FreeFilterGraph();
+
+    return result;
+}
+
+void AudioDecoder::RenderFilteredFrames() {
+    int bytesPerSample = AUDIO_DST_CHANNEL_COUNTS * av_get_bytes_per_sample(DST_SAMPLT_FORMAT);
+    while (av_buffersink_get_frame(m_BufferSinkCtx, m_FilterFrame) >= 0) {
+        long pts = m_FilterStartPts + static_cast<long>(m_FilterOutSamples * 1000 * m_FilterSpeed / AUDIO_DST_SAMPLE_RATE);
+        m_FilterOutSamples += m_FilterFrame->nb_samples;
+        m_AudioRender->RenderAudioFrame(m_FilterFrame->data[0], m_FilterFrame->nb_samples * bytesPerSample, pts, m_FilterSpeed, m_Tag);
+        av_frame_unref(m_FilterFrame);
     }
 }
 
+void AudioDecoder::DrainFilterGraph() {
+    if(m_FilterGraph == nullptr)
+        return;
+
+    if(av_buffersrc_add_frame(m_BufferSrcCtx, NULL) >= 0)
+        RenderFilteredFrames();
+    FreeFilterGraph();
+}
+
+void AudioDecoder::FreeFilterGraph() {
+    if(m_FilterGraph) {
+        avfilter_graph_free(&m_FilterGraph);
+        m_FilterGraph = nullptr;
+    }
+    m_BufferSrcCtx = nullptr;
+    m_BufferSinkCtx = nullptr;
+    m_FilterSpeed = 1.0f;
+}
+
 void AudioDecoder::OnDecoderDone() {
     LOGCATE("AudioDecoder::OnDecoderDone");
-    if(m_AudioRender)
-        m_AudioRender->UnInit();
+    FreeFilterGraph();
 
+    if(m_FilterFrame) {
+        av_frame_free(&m_FilterFrame);
+        m_FilterFrame = nullptr;
+    }
     if(m_AudioOutBuffer) {
         free(m_AudioOutBuffer);
         m_AudioOutBuffer = nullptr;
@@ -68,7 +257,20 @@ void AudioDecoder::OnDecoderDone() {
     }
 }
 
+void AudioDecoder::Start() {
+    if(m_AudioRender)
+        m_AudioRender->Play();
+    DecoderBase::Start();
+}
+
+void AudioDecoder::Pause() {
+    DecoderBase::Pause();
+    if(m_AudioRender)
+        m_AudioRender->Pause();
+}
+
 void AudioDecoder::ClearCache() {
+    m_FilterResetRequest = true;
     if(m_AudioRender)
         m_AudioRender->ClearAudioCache();
 }
@@ -77,7 +279,13 @@ long AudioDecoder::GetAudioDecoderTimestampForAVSync(void *context) {
     if(context != nullptr)
     {
         AudioDecoder* audioDecoder = static_cast<AudioDecoder *>(context);
-        return audioDecoder->GetCurrentPosition();
+        if(audioDecoder->m_AudioRender)
+        {
+            //播放列表切换后 OpenSL 队列里还有上一个条目的数据, 它的时间戳不属于这个条目
+            int tag = 0;
+            long clock = audioDecoder->m_AudioRender->GetAudioClock(&tag);
+            return tag == audioDecoder->m_Tag ? clock : -1;
+        }
     }
-    return 0;
+    return -1;
 }
\ No newline at end of file
@@ -10,8 +10,12 @@ extern "C" {
 #include <libswresample/swresample.h>
 #include <libavutil/opt.h>
 #include <libavutil/audio_fifo.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
 };
 
+#include <atomic>
 #include <render/audio/AudioRender.h>
 #include "Decoder.h"
 #include "DecoderBase.h"
@@ -30,34 +34,57 @@ static const int ACC_NB_SAMPLES = 1024;
 class AudioDecoder : public DecoderBase{
 
 public:
-    AudioDecoder(char *url){
-        Init(url, AVMEDIA_TYPE_AUDIO);
+    AudioDecoder(Demuxer *demuxer){
+        Init(demuxer, AVMEDIA_TYPE_AUDIO);
+        m_Tag = ++s_TagCounter;
     }
 
     virtual ~AudioDecoder(){
         UnInit();
     }
 
+    //渲染器由播放器创建和销毁, 播放列表中的各个条目共享同一个渲染器
     void SetAudioRender(AudioRender *audioRender)
     {
         m_AudioRender = audioRender;
     }
 
+    //OpenSL 的播放状态跟随解码器, 准备阶段只填充缓冲区不出声
+    virtual void Start();
+    virtual void Pause();
+
+    //音频主时钟, 来自 OpenSL 的实际播放位置, 不可用时返回 -1
     static long GetAudioDecoderTimestampForAVSync(void* context);
 
 private:
     virtual void OnDecoderReady();
     virtual void OnDecoderDone();
     virtual void OnFrameAvailable(AVFrame *frame);
+    virtual void OnDecoderComplete();
     virtual void ClearCache();
 
+    //重采样并送入渲染器, in 为 NULL 时输出重采样器中缓存的数据
+    void ConvertAndRender(const uint8_t **in, int inCount, long pts);
+    //倍速播放: swr 输出 -> atempo 滤镜 -> 渲染器, 变速不变调. 1 倍速时不经过滤镜
+    void UpdateFilterGraph(long pts);
+    void FilterPcm(uint8_t *data, int nbSamples);
+    int InitFilterGraph(float speed, long pts);
+    //输出滤镜中缓存的数据后释放滤镜
+    void DrainFilterGraph();
+    void FreeFilterGraph();
+    void RenderFilteredFrames();
+
     const AVSampleFormat DST_SAMPLT_FORMAT = AV_SAMPLE_FMT_S16;
 
     AudioRender  *m_AudioRender = nullptr;
+    //送入渲染器的数据都带有这个标识, 音频时钟只认自己送入的数据
+    int           m_Tag = 0;
+    static std::atomic<int> s_TagCounter;
 
     //audio resample context
     SwrContext   *m_SwrContext = nullptr;
 
+    //倍速播放时送入滤镜之前的中转缓冲区, 1 倍速时 swr 直接写入渲染器的缓冲块
     uint8_t      *m_AudioOutBuffer = nullptr;
 
     //number of sample per channel
@@ -65,6 +92,18 @@ private:
 
     //dst frame data size
     int           m_DstFrameDataSze = 0;
+
+    AVFilterGraph   *m_FilterGraph = nullptr;
+    AVFilterContext *m_BufferSrcCtx = nullptr;
+    AVFilterContext *m_BufferSinkCtx = nullptr;
+    AVFrame         *m_FilterFrame = nullptr;
+    //当前滤镜对应的倍速, 1 表示没有滤镜
+    float            m_FilterSpeed = 1.0f;
+    //滤镜输出的媒体时间 = 起始时间戳 + 输出采样时长 * 倍速
+    long             m_FilterStartPts = 0;
+    int64_t          m_FilterOutSamples = 0;
+    //seek 时由解码线程置位, 渲染线程丢弃滤镜中 seek 之前的数据
+    volatile bool    m_FilterResetRequest = false;
 };
 
 #endif //FFMPEGEXERCISE_AUDIODECODER_H
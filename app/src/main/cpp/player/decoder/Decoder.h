@@ -10,6 +10,7 @@ typedef long (*AVSyncCallback)(void*);
 
 class Decoder{
 public:
+    virtual void Prepare() = 0;
     virtual void Start() = 0;
     virtual void Pause() = 0;
     virtual void Stop() = 0;
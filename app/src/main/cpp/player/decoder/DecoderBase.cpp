@@ -4,16 +4,29 @@
 
 #include "DecoderBase.h"
 #include "LogUtil.h"
+#include "VsyncSource.h"
+
+void DecoderBase::Prepare()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_Thread == nullptr)
+    {
+        //线程以暂停状态启动, 渲染线程只做预先送显
+        m_DecoderState = STATE_PAUSE;
+        StartDecodingThread();
+    }
+}
 
 void DecoderBase::Start()
 {
+    std::unique_lock<std::mutex> lock(m_Mutex);
     if(m_Thread == nullptr)
     {
+        m_DecoderState = STATE_DECODING;
         StartDecodingThread();
     }
     else
     {
-        std::unique_lock<std::mutex> lock(m_Mutex);
         m_DecoderState = STATE_DECODING;
         m_Cond.notify_all();
     }
@@ -30,14 +43,34 @@ void DecoderBase::Stop()
     std::unique_lock<std::mutex> lock(m_Mutex);
     m_DecoderState = STATE_STOP;
     m_Cond.notify_all();
+    lock.unlock();
+
+    //唤醒阻塞在 packet 队列和解码帧队列上的线程
+    if(m_PacketQueue)
+        m_PacketQueue->Abort();
+
+    if(m_FrameQueue)
+        m_FrameQueue->Abort();
 }
 
 void DecoderBase::SeekToPosition(float position)
 {
     std::unique_lock<std::mutex> lock(m_Mutex);
     m_SeekPosition = position;
-    m_DecoderState = STATE_DECODING;
+    //seek 到 0 也是一次 seek, 用标志而不是位置判断; 上一次 seek 的结果不能带到这一次
+    m_SeekPending = true;
+    m_SeekSuccess = false;
+    m_EndOfStream = false;
+    //暂停时 seek 保持暂停, 只送显 seek 之后的第一帧, 拖动进度条时可以预览
+    if(m_DecoderState == STATE_PAUSE)
+        m_SeekPresentFrameCount = 1;
+    else
+        m_DecoderState = STATE_DECODING;
     m_Cond.notify_all();
+    lock.unlock();
+
+    //丢弃 seek 之前解码出来的帧, 同时唤醒因队列已满而阻塞的解码线程
+    ClearFrameQueue();
 }
 
 float DecoderBase::GetCurrentPosition()
@@ -45,10 +78,11 @@ float DecoderBase::GetCurrentPosition()
     return  m_CurTimeStamp;
 }
 
-int DecoderBase::Init(const char *url, AVMediaType mediaType)
+int DecoderBase::Init(Demuxer *demuxer, AVMediaType mediaType)
 {
-    strcpy(m_Url,url);
+    m_Demuxer = demuxer;
     m_MediaType = mediaType;
+    m_PacketQueue = demuxer->GetPacketQueue(mediaType);
     return 0;
 }
 
@@ -61,42 +95,35 @@ void DecoderBase::UnInit()
         delete m_Thread;
         m_Thread = nullptr;
     }
+
+    if(m_FrameQueue)
+    {
+        ClearFrameQueue();
+        delete m_FrameQueue;
+        m_FrameQueue = nullptr;
+    }
 }
 
 int DecoderBase::InitFFDecoder()
 {
     int result = -1;
     do{
-        m_AVFormatContext = avformat_alloc_context();
-
-        if(avformat_open_input(&m_AVFormatContext,m_Url,NULL,NULL) != 0)
-        {
-            LOGCATE("DecoderBase::InitFFDecoder avformat_open_input fail.");
-            break;
-        }
-
-        if(avformat_find_stream_info(m_AVFormatContext,NULL) < 0)
+        //等待解复用器打开输入, 音视频解码器共享同一个 AVFormatContext
+        if(m_Demuxer->WaitForOpen() != 0)
         {
-            LOGCATE("DecoderBase::InitFFDecoder avformat_find_stream_info fail.");
+            LOGCATE("DecoderBase::InitFFDecoder Demuxer open fail.");
             break;
         }
 
-        for (int i = 0; i < m_AVFormatContext->nb_streams; ++i)
-        {
-            if(m_AVFormatContext->streams[i]->codecpar->codec_type == m_MediaType)
-            {
-                m_StreamIndex = i;
-                break;
-            }
-        }
-
-        if(m_StreamIndex == -1)
+        m_StreamIndex = m_Demuxer->GetStreamIndex(m_MediaType);
+        m_AVStream = m_Demuxer->GetStream(m_MediaType);
+        if(m_StreamIndex == -1 || m_AVStream == nullptr)
         {
             LOGCATE("DecoderBase::InitFFDecoder Fail to find stream index.");
             break;
         }
 
-        AVCodecParameters* codecParameters = m_AVFormatContext->streams[m_StreamIndex]->codecpar;
+        AVCodecParameters* codecParameters = m_AVStream->codecpar;
 
         m_AVCodec = avcodec_find_decoder(codecParameters->codec_id);
         if(m_AVCodec == nullptr)
@@ -112,30 +139,45 @@ int DecoderBase::InitFFDecoder()
             break;
         }
 
-        AVDictionary *pAVDictionary = nullptr;
-        av_dict_set(&pAVDictionary, "buffer_size", "1024000", 0);
-        av_dict_set(&pAVDictionary, "stimeout", "20000000", 0);
-        av_dict_set(&pAVDictionary, "max_delay", "30000000", 0);
-        av_dict_set(&pAVDictionary, "rtsp_transport", "tcp", 0);
+        //软解码多线程
+        m_AVCodecContext->thread_count = m_ThreadCount;
+        switch (m_ThreadType)
+        {
+            case DECODER_THREAD_FRAME:
+                m_AVCodecContext->thread_type = FF_THREAD_FRAME;
+                break;
+            case DECODER_THREAD_SLICE:
+                m_AVCodecContext->thread_type = FF_THREAD_SLICE;
+                break;
+            default:
+                m_AVCodecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+                break;
+        }
 
-        result = avcodec_open2(m_AVCodecContext,m_AVCodec,&pAVDictionary);
+        //网络相关的参数属于解复用器, 在 Demuxer::OpenInput 中设置
+        result = avcodec_open2(m_AVCodecContext,m_AVCodec,NULL);
         if(result < 0)
         {
             LOGCATE("DecoderBase::InitFFDecoder avcodec_open2 fail. result=%d", result);
             break;
         }
 
+        LOGCATE("DecoderBase::InitFFDecoder m_MediaType=%d, thread_type=%d, thread_count=%d, active_thread_type=%d",
+                m_MediaType, m_AVCodecContext->thread_type, m_AVCodecContext->thread_count, m_AVCodecContext->active_thread_type);
+
         result = 0;
 
-        m_Duration = m_AVFormatContext->duration / AV_TIME_BASE * 1000; //us to ms
+        m_Duration = m_Demuxer->GetDuration();
+
+        if(m_AVStream->avg_frame_rate.num > 0 && m_AVStream->avg_frame_rate.den > 0)
+            m_FrameDuration = static_cast<long>(1000 / av_q2d(m_AVStream->avg_frame_rate));
 
-        m_Packet = av_packet_alloc();
         m_Frame = av_frame_alloc();
 
     }while (false);
 
     if(result != 0 && m_MsgContext && m_MsgCallback)
-        m_MsgCallback(m_MsgContext,MSG_DECODER_INIT_ERROR,0);
+        m_MsgCallback(m_MsgContext,MSG_DECODER_INIT_ERROR,m_MediaType);
 
     return result;
 }
@@ -149,12 +191,6 @@ void DecoderBase::UnInitDecoder()
         m_Frame = nullptr;
     }
 
-    if(m_Packet != nullptr)
-    {
-        av_packet_free(&m_Packet);
-        m_Packet = nullptr;
-    }
-
     if(m_AVCodecContext != nullptr)
     {
         avcodec_close(m_AVCodecContext);
@@ -163,36 +199,125 @@ void DecoderBase::UnInitDecoder()
         m_AVCodec = nullptr;
     }
 
-    if(m_AVFormatContext != nullptr)
-    {
-        avformat_close_input(&m_AVFormatContext);
-        avformat_free_context(m_AVFormatContext);
-        m_AVFormatContext = nullptr;
-    }
-
 }
 
 void DecoderBase::StartDecodingThread()
 {
+    m_FrameQueue = new ThreadSafeQueue<AVFrame*>(m_FrameQueueSize);
     m_Thread = new thread(DoAVDecoding,this);
 }
 
+void DecoderBase::ClearFrameQueue()
+{
+    if(m_FrameQueue)
+        m_FrameQueue->Clear(ReleaseFrame);
+}
+
+void DecoderBase::UpdateDecodeFps()
+{
+    int64_t curTime = av_gettime_relative();
+    if(m_FpsStatStartTime == -1)
+        m_FpsStatStartTime = curTime;
+
+    m_FpsStatFrameCount++;
+
+    //每秒统计一次
+    if(curTime - m_FpsStatStartTime >= 1000000)
+    {
+        int64_t busyTime = m_FpsStatDecodeTime > 0 ? m_FpsStatDecodeTime : 1;
+        m_DecodeFps = m_FpsStatFrameCount * 1000000.0f / busyTime;
+        LOGCATE("DecoderBase::UpdateDecodeFps m_MediaType=%d, decodeFps=%.1f, frames=%d, decodeTime=%lldus",
+                m_MediaType, m_DecodeFps, m_FpsStatFrameCount, (long long)m_FpsStatDecodeTime);
+        m_FpsStatStartTime = curTime;
+        m_FpsStatDecodeTime = 0;
+        m_FpsStatFrameCount = 0;
+    }
+}
+
+void DecoderBase::ReleaseFrame(AVFrame *&frame)
+{
+    av_frame_free(&frame);
+}
+
 void DecoderBase::DecodingLoop()
 {
+    for(;;)
     {
-        std::unique_lock<std::mutex> lock(m_Mutex);
-        m_DecoderState = STATE_DECODING;
-        lock.unlock();
+        //暂停时解码线程继续解码直到解码帧队列填满, 恢复播放时不需要重新解码.
+        //解码到流末尾后等待 SeekToPosition 或者 Stop 唤醒
+        if(m_EndOfStream)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            LOGCATE("DecoderBase::DecodingLoop end of stream, waiting, m_MediaType=%d", m_MediaType);
+            m_Cond.wait(lock, [this]{ return !m_EndOfStream || m_DecoderState == STATE_STOP; });
+        }
+
+        if(m_DecoderState == STATE_STOP)
+        {
+            break;
+        }
+
+        if(DecodeOnePacket() != 0)
+        {
+            //解码结束, 解码线程等待 seek, 渲染线程继续消费已解码的帧.
+            //空帧标记流结束, 渲染线程送显完之前所有的帧之后才会取到
+            if(m_DecoderState != STATE_STOP)
+                m_FrameQueue->Push(nullptr);
+
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_EndOfStream = true;
+        }
     }
+}
 
+void DecoderBase::PresentingLoop()
+{
     for(;;)
     {
         while (m_DecoderState == STATE_PAUSE)
         {
+            if(m_PresentedFrameCount < m_PrerollFrameCount || m_SeekPresentFrameCount > 0)
+            {
+                //准备阶段: 第一帧画面提前上传, 音频提前填满渲染队列, Start 时可以立即播放.
+                //暂停时 seek: 送显 seek 之后的第一帧
+                AVFrame *frame = nullptr;
+                if(!PopFrame(frame))
+                    return;
+                if(frame == nullptr)
+                {
+                    m_SeekPresentFrameCount = 0;
+                    OnStreamComplete();
+                    continue;
+                }
+                if(m_SeekPending && !m_SeekSuccess)
+                {
+                    //解码线程还没有处理到 seek, 队列里是 seek 之前解码的帧
+                    av_frame_free(&frame);
+                    continue;
+                }
+                UpdateTimeStamp(frame);
+                OnFrameAvailable(frame);
+                av_frame_free(&frame);
+                if(m_PresentedFrameCount < m_PrerollFrameCount)
+                {
+                    OnFramePresented();
+                }
+                else
+                {
+                    std::unique_lock<std::mutex> lock(m_Mutex);
+                    if(m_SeekPresentFrameCount > 0)
+                        m_SeekPresentFrameCount--;
+                }
+                continue;
+            }
+
+            //等待 Start/Stop/SeekToPosition 唤醒, 恢复播放时系统时钟从当前帧继续
             std::unique_lock<std::mutex> lock(m_Mutex);
-            LOGCATE("DecoderBase::DecodingLoop waiting, m_MediaType=%d", m_MediaType);
-            m_Cond.wait_for(lock, std::chrono::milliseconds(10));
-            m_StartTimeStamp = GetSysCurrentTime() - m_CurTimeStamp;
+            LOGCATE("DecoderBase::PresentingLoop paused, waiting, m_MediaType=%d", m_MediaType);
+            m_Cond.wait(lock, [this]{
+                return m_DecoderState != STATE_PAUSE || m_PresentedFrameCount < m_PrerollFrameCount || m_SeekPresentFrameCount > 0;
+            });
+            SetClockAnchor(m_CurTimeStamp);
         }
 
         if(m_DecoderState == STATE_STOP)
@@ -200,149 +325,462 @@ void DecoderBase::DecodingLoop()
             break;
         }
 
+        AVFrame *frame = nullptr;
+        if(!PopFrame(frame))
+        {
+            //队列被中止
+            break;
+        }
+
+        if(frame == nullptr)
+        {
+            OnStreamComplete();
+            continue;
+        }
+
+        if(m_WaitForMasterClock)
+        {
+            m_WaitForMasterClock = false;
+            WaitForMasterClock();
+        }
+
         if(m_StartTimeStamp == -1)
         {
-            m_StartTimeStamp = GetSysCurrentTime();
+            SetClockAnchor(0);
         }
 
-        if(DecodeOnePacket() != 0)
+        //更新时间戳
+        UpdateTimeStamp(frame);
+        if(m_VsyncSource != nullptr && m_MediaType == AVMEDIA_TYPE_VIDEO && !m_IsAVSyncMaster)
         {
-            //解码结束，暂停解码器
-            std::unique_lock<std::mutex> lock(m_Mutex);
-            m_DecoderState = STATE_PAUSE;
+            //按 vsync 送显, 过期的帧由调度器丢弃
+            if(!VsyncSync())
+            {
+                av_frame_free(&frame);
+                continue;
+            }
+        }
+        else
+        {
+            //同步
+            long delay = AVSync();
+            //落后主时钟的视频帧直接丢弃, 避免在已经落后的时候还做格式转换和纹理上传.
+            //倍速播放时主时钟走得更快, 丢帧阈值和连续丢帧数按倍速放大
+            float speed = m_PlaybackSpeed;
+            if(m_MediaType == AVMEDIA_TYPE_VIDEO && !m_IsAVSyncMaster &&
+               delay > AV_SYNC_DROP_THRESHOLD * speed && delay < AV_SYNC_NOSYNC_THRESHOLD &&
+               m_DroppedFrames < AV_SYNC_MAX_DROP_FRAMES * speed)
+            {
+                m_DroppedFrames++;
+                LOGCATE("DecoderBase::PresentingLoop drop frame, delay=%ld, m_DroppedFrames=%d", delay, m_DroppedFrames);
+                av_frame_free(&frame);
+                continue;
+            }
+            m_DroppedFrames = 0;
         }
+        //渲染
+        OnFrameAvailable(frame);
+        av_frame_free(&frame);
+        OnFramePresented();
     }
 }
 
-void DecoderBase::UpdateTimeStamp()
+void DecoderBase::OnFramePresented()
+{
+    if(m_FirstFrameTime == -1)
+    {
+        m_FirstFrameTime = GetSysCurrentTime();
+        LOGCATE("DecoderBase::OnFramePresented first frame, m_MediaType=%d, time=%ld", m_MediaType, m_FirstFrameTime);
+    }
+
+    //预先送显完成, 通知上层可以播放
+    if(++m_PresentedFrameCount == m_PrerollFrameCount && m_MsgContext && m_MsgCallback)
+        m_MsgCallback(m_MsgContext, MSG_DECODER_READY, m_MediaType);
+}
+
+void DecoderBase::OnStreamComplete()
+{
+    LOGCATE("DecoderBase::OnStreamComplete m_MediaType=%d, m_CurTimeStamp=%ld", m_MediaType, m_CurTimeStamp);
+    OnDecoderComplete();
+
+    //流的帧数少于预先送显的帧数, 也认为准备完成
+    if(m_PresentedFrameCount < m_PrerollFrameCount)
+    {
+        m_PresentedFrameCount = m_PrerollFrameCount;
+        if(m_MsgContext && m_MsgCallback)
+            m_MsgCallback(m_MsgContext, MSG_DECODER_READY, m_MediaType);
+    }
+
+    if(m_MsgContext && m_MsgCallback)
+        m_MsgCallback(m_MsgContext, MSG_DECODER_COMPLETE, m_MediaType);
+}
+
+void DecoderBase::UpdateTimeStamp(AVFrame* frame)
 {
     std::unique_lock<std::mutex> lock(m_Mutex);
-    if(m_Frame->pkt_dts != AV_NOPTS_VALUE)
+    m_CurTimeStamp = GetFrameTimeStamp(frame);
+    m_CurFrameTime = GetFrameTimeStampUs(frame);
+
+    //seek 之后送显的第一帧重新锚定时钟, seek 到此结束
+    if(m_SeekPending && m_SeekSuccess)
+    {
+        SetClockAnchor(m_CurTimeStamp);
+        m_SeekPending = false;
+        m_SeekSuccess = false;
+    }
+}
+
+long DecoderBase::GetFrameTimeStamp(AVFrame* frame)
+{
+    int64_t timestamp = 0;
+    //同步需要使用显示时间戳, 有 B 帧时 dts 与显示顺序不一致
+    if(frame->best_effort_timestamp != AV_NOPTS_VALUE)
     {
-        m_CurTimeStamp = m_Frame->pkt_dts;
+        timestamp = frame->best_effort_timestamp;
     }
-    else if(m_Frame->pts != AV_NOPTS_VALUE)
+    else if(frame->pts != AV_NOPTS_VALUE)
     {
-        m_CurTimeStamp = m_Frame->pts;
+        timestamp = frame->pts;
     }
-    else
+    else if(frame->pkt_dts != AV_NOPTS_VALUE)
     {
-        m_CurTimeStamp = 0;
+        timestamp = frame->pkt_dts;
     }
 
-    m_CurTimeStamp = (int64_t)((m_CurTimeStamp * av_q2d(m_AVFormatContext->streams[m_StreamIndex]->time_base)) * 1000);
+    return (long)((timestamp * av_q2d(m_AVStream->time_base)) * 1000);
+}
 
-    if(m_SeekPosition > 0 && m_SeekSuccess)
+int64_t DecoderBase::GetFrameTimeStampUs(AVFrame* frame)
+{
+    int64_t timestamp = 0;
+    if(frame->best_effort_timestamp != AV_NOPTS_VALUE)
     {
-        m_StartTimeStamp = GetSysCurrentTime() - m_CurTimeStamp;
-        m_SeekPosition = 0;
-        m_SeekSuccess = false;
+        timestamp = frame->best_effort_timestamp;
+    }
+    else if(frame->pts != AV_NOPTS_VALUE)
+    {
+        timestamp = frame->pts;
     }
+    else if(frame->pkt_dts != AV_NOPTS_VALUE)
+    {
+        timestamp = frame->pkt_dts;
+    }
+
+    return av_rescale_q(timestamp, m_AVStream->time_base, AV_TIME_BASE_Q);
 }
 
-long DecoderBase::AVSync()
+bool DecoderBase::DiscardBeforeSeekTarget(AVFrame* frame)
+{
+    if(m_SeekDiscardTarget < 0)
+        return false;
+
+    if(GetFrameTimeStamp(frame) < m_SeekDiscardTarget)
+    {
+        m_SeekDiscardFrames++;
+        return true;
+    }
+
+    LOGCATE("DecoderBase::DiscardBeforeSeekTarget reach target=%ld, discardFrames=%d, m_MediaType=%d",
+            m_SeekDiscardTarget, m_SeekDiscardFrames, m_MediaType);
+    m_SeekDiscardTarget = -1;
+    m_AVCodecContext->skip_frame = GetSkipFrame();
+    return false;
+}
+
+long DecoderBase::GetMasterClock()
 {
     long curSysTime = GetSysCurrentTime();
 
+    if(m_AVSyncCallback != nullptr) {
+        //视频向音频同步,或者音频向视频同步,视传进来的 m_AVSyncCallback 而定
+        long masterClock = m_AVSyncCallback(m_AVDecoderContext);
+        if(masterClock >= 0) {
+            if(masterClock != m_LastMasterClock) {
+                m_LastMasterClock = masterClock;
+                m_LastMasterClockUpdateTime = curSysTime;
+            }
+
+            if(curSysTime - m_LastMasterClockUpdateTime < AV_SYNC_CLOCK_STALE_THRESHOLD) {
+                //系统时钟跟随主时钟, 主时钟失效时可以平滑切换
+                SetClockAnchor(masterClock);
+                return masterClock;
+            }
+        }
+    }
+
     //基于系统时钟计算从开始播放流逝的时间
-    long elapsedTime = curSysTime - m_StartTimeStamp;
+    return GetSystemClock();
+}
+
+void DecoderBase::SetClockAnchor(long mediaTime)
+{
+    m_StartTimeStamp = GetSysCurrentTime() - static_cast<long>(mediaTime / m_PlaybackSpeed);
+}
+
+long DecoderBase::GetSystemClock()
+{
+    return static_cast<long>((GetSysCurrentTime() - m_StartTimeStamp) * m_PlaybackSpeed);
+}
+
+void DecoderBase::SetPlaybackSpeed(float speed)
+{
+    if(speed < MIN_PLAYBACK_SPEED) speed = MIN_PLAYBACK_SPEED;
+    if(speed > MAX_PLAYBACK_SPEED) speed = MAX_PLAYBACK_SPEED;
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    //切换倍速时保持系统时钟连续
+    long clock = m_StartTimeStamp == -1 ? -1 : GetSystemClock();
+    m_PlaybackSpeed = speed;
+    if(clock != -1)
+        SetClockAnchor(clock);
+    LOGCATE("DecoderBase::SetPlaybackSpeed speed=%.2f, clock=%ld, m_MediaType=%d", speed, clock, m_MediaType);
+}
+
+bool DecoderBase::DropForPlaybackSpeed(AVFrame* frame)
+{
+    if(m_MediaType != AVMEDIA_TYPE_VIDEO || m_PlaybackSpeed <= 1.0f)
+    {
+        m_LastQueuedTimeStamp = -1;
+        return false;
+    }
 
+    //每秒送显的帧数与 1 倍速相同, 被丢弃的帧不进入解码帧队列, 也不做格式转换和上传
+    long timestamp = GetFrameTimeStamp(frame);
+    if(m_LastQueuedTimeStamp >= 0 && timestamp > m_LastQueuedTimeStamp &&
+       timestamp - m_LastQueuedTimeStamp + m_FrameDuration / 2 < m_FrameDuration * m_PlaybackSpeed)
+        return true;
+
+    m_LastQueuedTimeStamp = timestamp;
+    return false;
+}
+
+AVDiscard DecoderBase::GetSkipFrame()
+{
+    //高倍速时非参考帧大多会被抽帧丢弃, 直接跳过解码
+    if(m_MediaType == AVMEDIA_TYPE_VIDEO && m_PlaybackSpeed >= SKIP_NONREF_PLAYBACK_SPEED)
+        return AVDISCARD_NONREF;
+    return AVDISCARD_DEFAULT;
+}
+
+long DecoderBase::AVSync()
+{
     if(m_MsgContext && m_MsgCallback && m_MediaType == AVMEDIA_TYPE_AUDIO)
         m_MsgCallback(m_MsgContext,MSG_DECODING_TIME,m_CurTimeStamp * 1.0f / 1000);
 
-    long delay = 0;
+    //自身就是主时钟, 或者是音频: 节奏由渲染器缓冲池的背压控制, 不做休眠.
+    //音频的实际播放速度由声卡决定, 休眠只会增加回调取不到数据的风险
+    if(m_IsAVSyncMaster || m_MediaType == AVMEDIA_TYPE_AUDIO)
+        return 0;
+
+    long masterClock = GetMasterClock();
+    if(m_CurTimeStamp - masterClock > AV_SYNC_NOSYNC_THRESHOLD) {
+        //时间戳跳变, 不做同步
+        LOGCATE("DecoderBase::AVSync no sync m_CurTimeStamp=%ld, masterClock=%ld", m_CurTimeStamp, masterClock);
+        return 0;
+    }
 
-    //向系统时钟同步
-    if(m_CurTimeStamp > elapsedTime) {
-        //休眠时间
-        auto sleepTime = static_cast<unsigned int>(m_CurTimeStamp - elapsedTime);//ms
-        //限制休眠时间不能过长
+    //提前到达的帧等待主时钟追上, 期间暂停/停止/seek 会打断等待
+    while(m_CurTimeStamp > masterClock && m_DecoderState == STATE_DECODING && !m_SeekPending) {
+        //休眠时间, 主时钟按倍速流逝
+        auto sleepTime = static_cast<unsigned int>((m_CurTimeStamp - masterClock) / m_PlaybackSpeed);//ms
+        //分段休眠, 每次醒来重新读取主时钟
         sleepTime = sleepTime > DELAY_THRESHOLD ? DELAY_THRESHOLD :  sleepTime;
+        sleepTime = sleepTime > 0 ? sleepTime : 1;
         av_usleep(sleepTime * 1000);
+        masterClock = GetMasterClock();
     }
-    delay = elapsedTime - m_CurTimeStamp;
 
+    return masterClock - m_CurTimeStamp;
+}
 
-//    if(m_AVSyncCallback != nullptr && m_SeekPosition == 0) {
-//        //视频向音频同步,或者音频向视频同步,视传进来的 m_AVSyncCallback 而定
-//        long elapsedTime = m_AVSyncCallback(m_AVDecoderContext);
-//        LOGCATE("DecoderBase::AVSync m_CurTimeStamp=%ld, elapsedTime=%ld", m_CurTimeStamp, elapsedTime);
-//
-//        if(m_CurTimeStamp > elapsedTime) {
-//            //休眠时间
-//            auto sleepTime = static_cast<unsigned int>(m_CurTimeStamp - elapsedTime);//ms
-//            //限制休眠时间不能过长
-//            sleepTime = sleepTime > DELAY_THRESHOLD ? DELAY_THRESHOLD :  sleepTime;
-//            av_usleep(sleepTime * 1000);
-//        }
-//        delay = elapsedTime - m_CurTimeStamp;
-//    }
+void DecoderBase::WaitForMasterClock()
+{
+    if(m_AVSyncCallback == nullptr || m_IsAVSyncMaster)
+        return;
 
-    return delay;
+    //主时钟只能轮询, 等待期间 Pause/Stop/seek 立即打断
+    long waitStartTime = GetSysCurrentTime();
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (m_DecoderState == STATE_DECODING && !m_SeekPending && m_AVSyncCallback(m_AVDecoderContext) < 0)
+    {
+        if(GetSysCurrentTime() - waitStartTime >= AV_SYNC_MASTER_CLOCK_TIMEOUT)
+        {
+            LOGCATE("DecoderBase::WaitForMasterClock timeout, m_MediaType=%d", m_MediaType);
+            break;
+        }
+        m_Cond.wait_for(lock, std::chrono::milliseconds(AV_SYNC_MASTER_CLOCK_INTERVAL), [this]{
+            return m_DecoderState != STATE_DECODING || m_SeekPending;
+        });
+    }
+    LOGCATE("DecoderBase::WaitForMasterClock waited %lldms, m_MediaType=%d", GetSysCurrentTime() - waitStartTime, m_MediaType);
+}
+
+bool DecoderBase::VsyncSync()
+{
+    for(;;)
+    {
+        //暂停/停止/seek 时与 AVSync 一样直接送显
+        if(m_DecoderState != STATE_DECODING || m_SeekPending)
+        {
+            m_VsyncPending = false;
+            return true;
+        }
+
+        if(!m_VsyncPending)
+        {
+            int64_t vsyncTime = 0, vsyncPeriod = 0;
+            if(!m_VsyncSource->WaitForVsync(VSYNC_WAIT_TIMEOUT, vsyncTime, vsyncPeriod))
+            {
+                //界面不可见等原因没有 vsync, 退回到按时钟同步
+                LOGCATE("DecoderBase::VsyncSync no vsync, fall back to AVSync");
+                AVSync();
+                return true;
+            }
+
+            //这个 vsync 之后绘制的画面在下一个 vsync 上屏, 换算为媒体时间
+            float speed = m_PlaybackSpeed;
+            int64_t displayDelay = vsyncTime + vsyncPeriod - av_gettime_relative();
+            int64_t displayTime = GetMasterClock() * 1000LL + static_cast<int64_t>(displayDelay * speed);
+            m_FrameScheduler.BeginVsync(displayTime, static_cast<int64_t>(vsyncPeriod * speed));
+            m_VsyncPending = true;
+        }
+
+        //时间戳跳变时不做同步
+        if(!m_FrameScheduler.IsDue(m_CurFrameTime) &&
+           m_FrameScheduler.GetFrameDelay(m_CurFrameTime) < AV_SYNC_NOSYNC_THRESHOLD * 1000LL)
+        {
+            //这个 vsync 上没有到期的帧, 屏幕重复上一帧
+            m_FrameScheduler.EndVsync();
+            m_VsyncPending = false;
+            continue;
+        }
+
+        //预读下一帧, 它在同一个 vsync 上也已经到期时丢弃当前帧, vsync 留给下一帧
+        if(!m_HasPendingFrame)
+            m_HasPendingFrame = m_FrameQueue->TryPop(m_PendingFrame);
+        if(m_HasPendingFrame && m_PendingFrame != nullptr && m_FrameScheduler.IsDue(GetFrameTimeStampUs(m_PendingFrame)))
+        {
+            m_FrameScheduler.OnFrameDropped();
+            return false;
+        }
+
+        m_FrameScheduler.OnFramePresented(m_CurFrameTime);
+        m_FrameScheduler.EndVsync();
+        m_VsyncPending = false;
+        return true;
+    }
+}
+
+bool DecoderBase::PopFrame(AVFrame *&frame)
+{
+    //seek 之前预读的帧已经过期
+    if(m_HasPendingFrame && m_SeekPending)
+        ReleasePendingFrame();
+
+    if(m_HasPendingFrame)
+    {
+        frame = m_PendingFrame;
+        m_PendingFrame = nullptr;
+        m_HasPendingFrame = false;
+        return true;
+    }
+    return m_FrameQueue->Pop(frame);
+}
+
+void DecoderBase::ReleasePendingFrame()
+{
+    if(m_PendingFrame != nullptr)
+        av_frame_free(&m_PendingFrame);
+    m_HasPendingFrame = false;
 }
 
 int DecoderBase::DecodeOnePacket() {
     LOGCATE("DecoderBase::DecodeOnePacket m_MediaType=%d", m_MediaType);
-    if(m_SeekPosition > 0) {
-        //seek to frame
-        int64_t seek_target = static_cast<int64_t>(m_SeekPosition * 1000000);//微秒
-        int64_t seek_min = INT64_MIN;
-        int64_t seek_max = INT64_MAX;
-        int seek_ret = avformat_seek_file(m_AVFormatContext, -1, seek_min, seek_target, seek_max, 0);
-        if (seek_ret < 0) {
-            m_SeekSuccess = false;
-            LOGCATE("BaseDecoder::DecodeOneFrame error while seeking m_MediaType=%d", m_MediaType);
-        } else {
-            if (-1 != m_StreamIndex) {
-                avcodec_flush_buffers(m_AVCodecContext);
-            }
+    int result = 0;
+    for(;;) {
+        //packet 由解复用线程送入队列
+        AVPacket *packet = m_PacketQueue->Get();
+        if(packet == nullptr) {
+            //队列被中止
+            return -1;
+        }
+
+        if(packet == PacketQueue::FlushPacket()) {
+            //seek 之后刷新解码器
+            avcodec_flush_buffers(m_AVCodecContext);
+            ClearFrameQueue();
             ClearCache();
             m_SeekSuccess = true;
-            LOGCATE("BaseDecoder::DecodeOneFrame seekFrame pos=%f, m_MediaType=%d", m_SeekPosition, m_MediaType);
+            //精确 seek 从目标之前的关键帧开始解码, 目标之前的帧不送显
+            m_SeekDiscardTarget = m_Demuxer->GetSeekDiscardTarget();
+            m_SeekDiscardFrames = 0;
+            m_LastQueuedTimeStamp = -1;
+            m_AVCodecContext->skip_frame = GetSkipFrame();
+            LOGCATE("BaseDecoder::DecodeOneFrame seekFrame pos=%f, discardTarget=%ld, m_MediaType=%d", m_SeekPosition, m_SeekDiscardTarget, m_MediaType);
+            continue;
         }
-    }
-    int result = av_read_frame(m_AVFormatContext, m_Packet);
-    while(result == 0) {
-        if(m_Packet->stream_index == m_StreamIndex) {
-//            UpdateTimeStamp(m_Packet);
-//            if(AVSync() > DELAY_THRESHOLD && m_CurTimeStamp > DELAY_THRESHOLD)
-//            {
-//                result = 0;
-//                goto __EXIT;
-//            }
-
-            if(avcodec_send_packet(m_AVCodecContext, m_Packet) == AVERROR_EOF) {
-                //解码结束
-                result = -1;
-                goto __EXIT;
-            }
 
-            //一个 packet 包含多少 frame?
-            int frameCount = 0;
-            while (avcodec_receive_frame(m_AVCodecContext, m_Frame) == 0) {
-                //更新时间戳
-                UpdateTimeStamp();
-                //同步
-                AVSync();
-                //渲染
-                LOGCATE("DecoderBase::DecodeOnePacket 000 m_MediaType=%d", m_MediaType);
-                OnFrameAvailable(m_Frame);
-                LOGCATE("DecoderBase::DecodeOnePacket 0001 m_MediaType=%d", m_MediaType);
-                frameCount ++;
+        if(m_SeekDiscardTarget >= 0 && packet->pts != AV_NOPTS_VALUE)
+        {
+            //目标之前的非参考帧不会被后续帧引用, 直接跳过解码
+            long packetTimeStamp = (long)((packet->pts * av_q2d(m_AVStream->time_base)) * 1000);
+            m_AVCodecContext->skip_frame = packetTimeStamp < m_SeekDiscardTarget ? AVDISCARD_NONREF : GetSkipFrame();
+        }
+        else if(m_SeekDiscardTarget < 0)
+        {
+            m_AVCodecContext->skip_frame = GetSkipFrame();
+        }
+
+        bool endOfStream = PacketQueue::IsEndOfStream(packet);
+        int64_t decodeStartTime = av_gettime_relative();
+        if(avcodec_send_packet(m_AVCodecContext, packet) == AVERROR_EOF) {
+            //解码结束
+            av_packet_free(&packet);
+            return -1;
+        }
+        av_packet_free(&packet);
+        m_FpsStatDecodeTime += av_gettime_relative() - decodeStartTime;
+
+        //一个 packet 包含多少 frame?
+        int frameCount = 0;
+        for(;;) {
+            decodeStartTime = av_gettime_relative();
+            int ret = avcodec_receive_frame(m_AVCodecContext, m_Frame);
+            m_FpsStatDecodeTime += av_gettime_relative() - decodeStartTime;
+            if(ret != 0)
+                break;
+
+            UpdateDecodeFps();
+
+            if(DiscardBeforeSeekTarget(m_Frame) || DropForPlaybackSpeed(m_Frame)) {
+                av_frame_unref(m_Frame);
+                continue;
             }
-            LOGCATE("BaseDecoder::DecodeOneFrame frameCount=%d", frameCount);
-            //判断一个 packet 是否解码完成
-            if(frameCount > 0) {
-                result = 0;
-                goto __EXIT;
+
+            //送入解码帧队列, 队列满时阻塞, 解码线程最多领先渲染 m_FrameQueueSize 帧
+            AVFrame *frame = av_frame_alloc();
+            av_frame_move_ref(frame, m_Frame);
+            if(!m_FrameQueue->Push(frame)) {
+                av_frame_free(&frame);
+                return -1;
             }
+            frameCount ++;
+        }
+        LOGCATE("BaseDecoder::DecodeOneFrame frameCount=%d", frameCount);
+
+        if(endOfStream) {
+            //解码器已经输出所有缓存帧
+            result = -1;
+            break;
+        }
+
+        //判断一个 packet 是否解码完成
+        if(frameCount > 0) {
+            result = 0;
+            break;
         }
-        av_packet_unref(m_Packet);
-        result = av_read_frame(m_AVFormatContext, m_Packet);
     }
 
-__EXIT:
-    av_packet_unref(m_Packet);
     return result;
 }
 
@@ -355,10 +793,24 @@ void DecoderBase::DoAVDecoding(DecoderBase *decoder)
         }
 
         decoder->OnDecoderReady();
+        decoder->m_PresentThread = new thread(DoAVPresenting, decoder);
         decoder->DecodingLoop();
     }while (false);
 
+    if(decoder->m_PresentThread)
+    {
+        decoder->m_FrameQueue->Abort();
+        decoder->m_PresentThread->join();
+        delete decoder->m_PresentThread;
+        decoder->m_PresentThread = nullptr;
+        decoder->ReleasePendingFrame();
+    }
 
     decoder->UnInitDecoder();
     decoder->OnDecoderDone();
-}
\ No newline at end of file
+}
+
+void DecoderBase::DoAVPresenting(DecoderBase *decoder)
+{
+    decoder->PresentingLoop();
+}
@@ -14,9 +14,34 @@ extern "C"{
 
 #include <thread>
 #include "Decoder.h"
+#include "Demuxer.h"
+#include "ThreadSafeQueue.h"
+#include "FrameScheduler.h"
+
+class VsyncSource;
 
-#define MAX_PATH 2048
 #define DELAY_THRESHOLD 100 //ms
+//视频帧落后主时钟超过该值时丢弃, 不再做格式转换和上传
+#define AV_SYNC_DROP_THRESHOLD 40 //ms
+//最多连续丢弃的帧数, 保证画面持续更新
+#define AV_SYNC_MAX_DROP_FRAMES 8
+//时间戳与主时钟相差过大时认为是时间戳跳变, 不做同步
+#define AV_SYNC_NOSYNC_THRESHOLD 10000 //ms
+//主时钟超过该时间没有更新时(音频结束或者卡顿), 退回到系统时钟
+#define AV_SYNC_CLOCK_STALE_THRESHOLD 500 //ms
+//播放列表切换后等待主时钟报告新条目时间戳的最长时间, 以及检查间隔
+#define AV_SYNC_MASTER_CLOCK_TIMEOUT 500 //ms
+#define AV_SYNC_MASTER_CLOCK_INTERVAL 5 //ms
+#define DEFAULT_FRAME_QUEUE_SIZE 8
+//倍速播放范围
+#define MIN_PLAYBACK_SPEED 0.25f
+#define MAX_PLAYBACK_SPEED 4.0f
+//达到该倍速时视频跳过非参考帧的解码
+#define SKIP_NONREF_PLAYBACK_SPEED 2.0f
+//没有帧率信息时假定的帧间隔
+#define DEFAULT_FRAME_DURATION 40 //ms
+//超过该时间没有 vsync 时退回到按时钟休眠同步
+#define VSYNC_WAIT_TIMEOUT 100000 //us
 
 using namespace std;
 
@@ -27,12 +52,22 @@ enum DecoderState{
     STATE_STOP
 };
 
+//软解码线程模型
+enum DecoderThreadType{
+    DECODER_THREAD_AUTO,   //帧级 + slice 级, 由 FFmpeg 根据解码器能力选择
+    DECODER_THREAD_FRAME,  //帧级多线程, 吞吐量高, 会增加 thread_count 帧的延迟
+    DECODER_THREAD_SLICE   //slice 级多线程, 不增加延迟, 依赖码流的 slice 划分
+};
+
 enum DecoderMsg{
     MSG_DECODER_INIT_ERROR,
     MSG_DECODER_READY,
     MSG_DECODER_DONE,
     MSG_DECODER_RENDER,
-    MSG_DECODING_TIME
+    MSG_DECODING_TIME,
+    MSG_DECODER_COMPLETE,   //最后一帧已经送显, msgCode 为媒体类型
+    MSG_MEDIA_ITEM_CHANGED, //播放列表切换到下一个条目, msgCode 为条目序号
+    MSG_VIDEO_SIZE_CHANGED  //码流中途改变了分辨率, 新的尺寸通过 GetMediaParams 获取
 };
 
 class DecoderBase : public Decoder{
@@ -40,6 +75,9 @@ public:
     DecoderBase(){}
     virtual ~DecoderBase(){};
 
+    //在后台完成初始化并预先送显 m_PrerollFrameCount 帧, 之后保持暂停直到 Start
+    virtual void Prepare();
+
     virtual void Start();
 
     virtual void Pause();
@@ -59,29 +97,96 @@ public:
 
     }
 
+    //threadCount 为 0 时按 CPU 核数自动选择, 需要在 Start 之前设置
+    virtual void SetDecoderThreadPolicy(int threadType, int threadCount)
+    {
+        m_ThreadType = threadType;
+        m_ThreadCount = threadCount > 0 ? threadCount : 0;
+    }
+
+    //最近一个统计周期内解码器能达到的帧率(不包含等待队列的时间)
+    virtual float GetDecodeFps()
+    {
+        return m_DecodeFps;
+    }
+
+    //第一帧送显的系统时间(ms), 还没有送显时返回 -1
+    virtual long GetFirstFrameTime()
+    {
+        return m_FirstFrameTime;
+    }
+
+    //准备阶段预先送显的帧数, 送显完成后发送 MSG_DECODER_READY, 需要在 Prepare 之前设置.
+    //为 0 时只解码填满解码帧队列, 不送显也不发送 MSG_DECODER_READY, 用于播放列表预加载下一个条目
+    virtual void SetPrerollFrameCount(int frameCount)
+    {
+        m_PrerollFrameCount = frameCount > 0 ? frameCount : 0;
+    }
+
+    //播放列表的后续条目: Start 之后等到主时钟报告的是本条目的时间戳再开始送显,
+    //避免按渲染队列中上一个条目的尾巴做同步
+    virtual void SetWaitForMasterClock(bool wait)
+    {
+        m_WaitForMasterClock = wait;
+    }
+
+    //解码线程最多可以领先渲染多少帧, 需要在 Start 之前设置
+    virtual void SetFrameQueueSize(int frameCount)
+    {
+        m_FrameQueueSize = frameCount > 0 ? frameCount : 1;
+    }
+
     virtual void SetMessageCallback(void* context, MessageCallback callback)
     {
         m_MsgContext = context;
         m_MsgCallback = callback;
     }
-    //设置音视频同步的回调
+    //设置音视频同步的回调, 回调返回主时钟(ms), 返回负值表示主时钟不可用
     virtual void SetAVSyncCallback(void* context, AVSyncCallback callback)
     {
         m_AVDecoderContext = context;
         m_AVSyncCallback = callback;
     }
 
+    //倍速播放, 系统时钟和同步阈值按倍速缩放, 视频在解码之后、格式转换之前按倍速抽帧
+    virtual void SetPlaybackSpeed(float speed);
+
+    virtual float GetPlaybackSpeed()
+    {
+        return m_PlaybackSpeed;
+    }
+
+    //作为主时钟的解码器不做休眠同步, 由渲染端的背压控制节奏
+    virtual void SetAVSyncMaster(bool isMaster)
+    {
+        m_IsAVSyncMaster = isMaster;
+    }
+
+    //设置之后视频按 vsync 选择送显的帧, 需要在 Start 之前设置, 为 nullptr 时按时钟休眠同步
+    virtual void SetVsyncSource(VsyncSource *vsyncSource)
+    {
+        m_VsyncSource = vsyncSource;
+    }
+
+    //按 vsync 送显时, 送显帧的 pts 与上屏时间的平均偏差(us)
+    virtual long GetCadenceError()
+    {
+        return m_FrameScheduler.GetCadenceError();
+    }
+
 protected:
     void* m_MsgContext = nullptr;
     MessageCallback m_MsgCallback = nullptr;
 
-    virtual int Init(const char* url,AVMediaType mediaType);
+    virtual int Init(Demuxer* demuxer,AVMediaType mediaType);
     virtual void UnInit();
 
     virtual void OnDecoderReady() = 0;
     virtual void OnDecoderDone() = 0;
 
     virtual void OnFrameAvailable(AVFrame* frame) = 0;
+    //流中最后一帧已经送显, 子类在这里输出内部缓存的数据
+    virtual void OnDecoderComplete() {}
 
     AVCodecContext *GetCodecContext(){
         return m_AVCodecContext;
@@ -95,29 +200,72 @@ private:
 
     void DecodingLoop();
 
-    void UpdateTimeStamp();
+    //渲染线程, 从解码帧队列中取帧做音视频同步后送显
+    void PresentingLoop();
+
+    void OnFramePresented();
+
+    void OnStreamComplete();
+
+    void ClearFrameQueue();
+
+    void UpdateDecodeFps();
+
+    void UpdateTimeStamp(AVFrame* frame);
+
+    //帧的显示时间戳, ms
+    long GetFrameTimeStamp(AVFrame* frame);
+    //精确到 us 的显示时间戳, 用于按 vsync 选帧
+    int64_t GetFrameTimeStampUs(AVFrame* frame);
+
+    //精确 seek 时丢弃目标之前的帧, 返回 true 表示该帧需要丢弃
+    bool DiscardBeforeSeekTarget(AVFrame* frame);
+
+    long GetMasterClock();
+
+    //系统时钟按播放速度流逝, 锚定为当前时刻对应 mediaTime(ms), 调用者需要持有 m_Mutex 或者在渲染线程中
+    void SetClockAnchor(long mediaTime);
+    long GetSystemClock();
+
+    //倍速播放时丢弃多余的视频帧, 返回 true 表示该帧需要丢弃
+    bool DropForPlaybackSpeed(AVFrame* frame);
+    AVDiscard GetSkipFrame();
 
     long AVSync();
+    void WaitForMasterClock();
+
+    //等到能显示当前帧的 vsync, 返回 false 表示同一个 vsync 上更新的帧也已经到期, 当前帧需要丢弃
+    bool VsyncSync();
+
+    //优先取出 VsyncSync 预读的帧
+    bool PopFrame(AVFrame* &frame);
+    void ReleasePendingFrame();
 
     int DecodeOnePacket();
 
     static void DoAVDecoding(DecoderBase* decoder);
 
-    AVFormatContext* m_AVFormatContext = nullptr;
+    static void DoAVPresenting(DecoderBase* decoder);
+
+    static void ReleaseFrame(AVFrame* &frame);
+
+    Demuxer* m_Demuxer = nullptr;
+
+    PacketQueue* m_PacketQueue = nullptr;
+
+    AVStream* m_AVStream = nullptr;
 
     AVCodecContext* m_AVCodecContext = nullptr;
 
     AVCodec* m_AVCodec = nullptr;
 
-    AVPacket* m_Packet = nullptr;
-
     AVFrame* m_Frame = nullptr;
 
     AVMediaType m_MediaType = AVMEDIA_TYPE_UNKNOWN;
 
-    char m_Url[MAX_PATH] = {0};
-
     long m_CurTimeStamp = 0;
+    //当前帧精确到 us 的时间戳
+    int64_t m_CurFrameTime = 0;
 
     long m_StartTimeStamp = -1;
 
@@ -129,13 +277,58 @@ private:
 
     condition_variable m_Cond;
     thread* m_Thread = nullptr;
-
+    thread* m_PresentThread = nullptr;
+
+    //解码帧队列, 解码线程生产, 渲染线程消费
+    ThreadSafeQueue<AVFrame*>* m_FrameQueue = nullptr;
+    int m_FrameQueueSize = DEFAULT_FRAME_QUEUE_SIZE;
+    //解码到流末尾, 等待 seek 或者 stop
+    volatile bool m_EndOfStream = false;
+
+    int m_ThreadType = DECODER_THREAD_AUTO;
+    int m_ThreadCount = 0;
+    //解码帧率统计, us
+    int64_t m_FpsStatStartTime = -1;
+    int64_t m_FpsStatDecodeTime = 0;
+    int m_FpsStatFrameCount = 0;
+    volatile float m_DecodeFps = 0;
+    volatile long m_FirstFrameTime = -1;
+    int m_PrerollFrameCount = 1;
+    int m_PresentedFrameCount = 0;
+    //暂停状态下 seek 之后还需要送显的帧数
+    int m_SeekPresentFrameCount = 0;
+    bool m_WaitForMasterClock = false;
+
+    //只用于日志, 是否在 seek 中看 m_SeekPending
     volatile float      m_SeekPosition = 0;
+    //SeekToPosition 之后, seek 后的第一帧送显之前为 true
+    volatile bool       m_SeekPending = false;
+    //解码线程已经处理了这次 seek 的 FlushPacket
     volatile bool       m_SeekSuccess = false;
+    //精确 seek 的目标时间戳(ms), 之前的帧只解码不送显, -1 表示没有需要丢弃的帧
+    long m_SeekDiscardTarget = -1;
+    int m_SeekDiscardFrames = 0;
     //解码器状态
     volatile int  m_DecoderState = STATE_UNKNOWN;
     void* m_AVDecoderContext = nullptr;
     AVSyncCallback m_AVSyncCallback = nullptr;//用作音视频同步
+    volatile bool m_IsAVSyncMaster = false;
+    long m_LastMasterClock = -1;
+    long m_LastMasterClockUpdateTime = 0;
+    int m_DroppedFrames = 0;
+
+    volatile float m_PlaybackSpeed = 1.0f;
+    long m_FrameDuration = DEFAULT_FRAME_DURATION;
+    //最近一个送入解码帧队列的视频帧时间戳, 用于倍速抽帧
+    long m_LastQueuedTimeStamp = -1;
+
+    VsyncSource *m_VsyncSource = nullptr;
+    FrameScheduler m_FrameScheduler;
+    //已经收到还没有结束的 vsync
+    bool m_VsyncPending = false;
+    //VsyncSync 从解码帧队列中预读的下一帧, nullptr 表示流结束, 只在渲染线程访问
+    AVFrame *m_PendingFrame = nullptr;
+    bool m_HasPendingFrame = false;
 
 };
 
@@ -0,0 +1,552 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "Demuxer.h"
+#include "LogUtil.h"
+#include "CacheUtil.h"
+#include "StreamInfoCache.h"
+
+Demuxer::Demuxer(const char *url)
+{
+    strcpy(m_Url, url);
+}
+
+Demuxer::~Demuxer()
+{
+    Stop();
+    if(m_Thread)
+    {
+        m_Thread->join();
+        delete m_Thread;
+        m_Thread = nullptr;
+    }
+    if(m_IndexThread)
+    {
+        m_IndexThread->join();
+        delete m_IndexThread;
+        m_IndexThread = nullptr;
+    }
+    CloseInput();
+
+    if(m_KeyFrameIndex)
+    {
+        delete m_KeyFrameIndex;
+        m_KeyFrameIndex = nullptr;
+    }
+}
+
+void Demuxer::Start()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_Thread == nullptr)
+    {
+        m_Thread = new std::thread(DoDemuxing, this);
+    }
+}
+
+void Demuxer::Stop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_State = DEMUXER_STATE_STOP;
+    m_Cond.notify_all();
+    lock.unlock();
+
+    m_VideoPacketQueue.Abort();
+    m_AudioPacketQueue.Abort();
+
+    lock.lock();
+    if(m_ReadAheadIO)
+        m_ReadAheadIO->Abort();
+}
+
+void Demuxer::SeekToPosition(float position, int seekMode)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_SeekRequest)
+        LOGCATE("Demuxer::SeekToPosition coalesce pending seek %f -> %f", m_SeekPosition, position);
+    m_SeekPosition = position;
+    m_SeekMode = seekMode;
+    m_SeekRequest = true;
+    m_Cond.notify_all();
+    lock.unlock();
+
+    //唤醒可能因队列已满而阻塞的解复用线程
+    m_VideoPacketQueue.Flush();
+    m_AudioPacketQueue.Flush();
+}
+
+int Demuxer::WaitForOpen()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (m_OpenResult == 1 && m_State != DEMUXER_STATE_STOP)
+    {
+        m_Cond.wait(lock);
+    }
+    return m_OpenResult == 0 ? 0 : -1;
+}
+
+int Demuxer::GetStreamIndex(AVMediaType mediaType)
+{
+    switch (mediaType)
+    {
+        case AVMEDIA_TYPE_VIDEO:
+            return m_VideoStreamIndex;
+        case AVMEDIA_TYPE_AUDIO:
+            return m_AudioStreamIndex;
+        default:
+            return -1;
+    }
+}
+
+AVStream *Demuxer::GetStream(AVMediaType mediaType)
+{
+    int streamIndex = GetStreamIndex(mediaType);
+    if(m_AVFormatContext == nullptr || streamIndex < 0)
+        return nullptr;
+    return m_AVFormatContext->streams[streamIndex];
+}
+
+PacketQueue *Demuxer::GetPacketQueue(AVMediaType mediaType)
+{
+    switch (mediaType)
+    {
+        case AVMEDIA_TYPE_VIDEO:
+            return &m_VideoPacketQueue;
+        case AVMEDIA_TYPE_AUDIO:
+            return &m_AudioPacketQueue;
+        default:
+            return nullptr;
+    }
+}
+
+int Demuxer::OpenInput()
+{
+    int result = -1;
+    int64_t startTime = av_gettime_relative();
+    bool hasStreamInfo = false;
+    do{
+        m_AVFormatContext = avformat_alloc_context();
+        StreamInfoCache streamInfoCache(m_Url);
+        hasStreamInfo = streamInfoCache.Load();
+        if(hasStreamInfo)
+        {
+            m_AVFormatContext->probesize = STREAM_INFO_CACHE_PROBE_SIZE;
+            m_AVFormatContext->max_analyze_duration = STREAM_INFO_CACHE_ANALYZE_DURATION;
+        }
+        //Stop 时中断阻塞的网络读取
+        m_AVFormatContext->interrupt_callback.callback = InterruptCallback;
+        m_AVFormatContext->interrupt_callback.opaque = this;
+
+        if(ReadAheadIO::IsSupported(m_Url))
+        {
+            ReadAheadIO *readAheadIO = new ReadAheadIO(m_Url, m_ReadAheadBufferSize);
+            readAheadIO->SetWatermarks(m_ReadAheadLowWatermark, m_ReadAheadHighWatermark);
+            if(readAheadIO->Open(&m_AVFormatContext->interrupt_callback) == 0)
+            {
+                m_AVFormatContext->pb = readAheadIO->GetAVIOContext();
+                m_AVFormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_ReadAheadIO = readAheadIO;
+                if(m_State == DEMUXER_STATE_STOP)
+                    m_ReadAheadIO->Abort();
+            }
+            else
+            {
+                //退回到 libavformat 自己打开输入
+                delete readAheadIO;
+            }
+        }
+
+        //rtsp 等协议的参数, 对其他协议无效
+        AVDictionary *options = nullptr;
+        av_dict_set(&options, "buffer_size", "1024000", 0);
+        av_dict_set(&options, "stimeout", "20000000", 0);
+        av_dict_set(&options, "max_delay", "30000000", 0);
+        av_dict_set(&options, "rtsp_transport", "tcp", 0);
+        int openResult = avformat_open_input(&m_AVFormatContext, m_Url, NULL, &options);
+        av_dict_free(&options);
+        if(openResult != 0)
+        {
+            LOGCATE("Demuxer::OpenInput avformat_open_input fail. result=%d", openResult);
+            m_AVFormatContext = nullptr;
+            break;
+        }
+
+        //之前打开过的文件直接使用缓存的流参数, 不再解码探测
+        if(!hasStreamInfo || streamInfoCache.Apply(m_AVFormatContext) != 0)
+        {
+            m_AVFormatContext->probesize = DEFAULT_PROBE_SIZE;
+            m_AVFormatContext->max_analyze_duration = 0;
+            if(avformat_find_stream_info(m_AVFormatContext, NULL) < 0)
+            {
+                LOGCATE("Demuxer::OpenInput avformat_find_stream_info fail.");
+                break;
+            }
+            streamInfoCache.Save(m_AVFormatContext);
+            hasStreamInfo = false;
+        }
+
+        m_VideoStreamIndex = av_find_best_stream(m_AVFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        m_AudioStreamIndex = av_find_best_stream(m_AVFormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+        if(m_VideoStreamIndex < 0 && m_AudioStreamIndex < 0)
+        {
+            LOGCATE("Demuxer::OpenInput Fail to find stream index.");
+            break;
+        }
+
+        if(m_VideoStreamIndex >= 0)
+            m_VideoPacketQueue.SetTimeBase(m_AVFormatContext->streams[m_VideoStreamIndex]->time_base);
+        if(m_AudioStreamIndex >= 0)
+            m_AudioPacketQueue.SetTimeBase(m_AVFormatContext->streams[m_AudioStreamIndex]->time_base);
+
+        //其余的流不需要解复用
+        for (unsigned int i = 0; i < m_AVFormatContext->nb_streams; ++i)
+        {
+            if(static_cast<int>(i) != m_VideoStreamIndex && static_cast<int>(i) != m_AudioStreamIndex)
+                m_AVFormatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        m_Duration = m_AVFormatContext->duration / AV_TIME_BASE * 1000; //us to ms
+        if(m_ReadAheadIO)
+            m_ReadAheadIO->SetBitRate(m_AVFormatContext->bit_rate);
+        result = 0;
+
+    }while (false);
+
+    LOGCATE("Demuxer::OpenInput result=%d, [video, audio]=[%d, %d], streamInfoCached=%d, cost=%lldms", result,
+            m_VideoStreamIndex, m_AudioStreamIndex, hasStreamInfo, (long long)(av_gettime_relative() - startTime) / 1000);
+    return result;
+}
+
+void Demuxer::CloseInput()
+{
+    m_VideoPacketQueue.Flush();
+    m_AudioPacketQueue.Flush();
+
+    if(m_AVFormatContext != nullptr)
+    {
+        avformat_close_input(&m_AVFormatContext);
+        avformat_free_context(m_AVFormatContext);
+        m_AVFormatContext = nullptr;
+    }
+
+    //自定义的 AVIOContext 不会被 avformat_close_input 释放
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_ReadAheadIO)
+    {
+        delete m_ReadAheadIO;
+        m_ReadAheadIO = nullptr;
+    }
+}
+
+int64_t Demuxer::GetBufferedBytes()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    return m_ReadAheadIO ? m_ReadAheadIO->GetBufferedBytes() : 0;
+}
+
+int64_t Demuxer::GetBufferedDuration()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    int64_t duration = m_ReadAheadIO ? m_ReadAheadIO->GetBufferedDuration() : 0;
+    return duration > 0 ? duration : 0;
+}
+
+int64_t Demuxer::FindNearestKeyFrame(int64_t target)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    KeyFrameIndex *index = m_KeyFrameIndex;
+    lock.unlock();
+
+    if(index == nullptr)
+        return target;
+
+    AVRational timeBase = {1, AV_TIME_BASE};
+    int64_t timestamp = av_rescale_q(target, timeBase, index->GetTimeBase());
+    int prevIndex = index->Search(timestamp, true);
+    int nextIndex = index->Search(timestamp, false);
+
+    int nearest = prevIndex >= 0 ? prevIndex : nextIndex;
+    if(prevIndex >= 0 && nextIndex >= 0 &&
+       index->GetEntry(nextIndex).timestamp - timestamp < timestamp - index->GetEntry(prevIndex).timestamp)
+    {
+        nearest = nextIndex;
+    }
+
+    if(nearest < 0)
+        return target;
+
+    return av_rescale_q(index->GetEntry(nearest).timestamp, index->GetTimeBase(), timeBase);
+}
+
+int64_t Demuxer::FindKeyFramePosition(int64_t target)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    KeyFrameIndex *index = m_ByteSeekByIndex ? m_KeyFrameIndex : nullptr;
+    lock.unlock();
+
+    if(index == nullptr)
+        return -1;
+
+    AVRational timeBase = {1, AV_TIME_BASE};
+    int prevIndex = index->Search(av_rescale_q(target, timeBase, index->GetTimeBase()), true);
+    if(prevIndex < 0)
+        prevIndex = 0;
+    return index->GetEntry(prevIndex).pos;
+}
+
+void Demuxer::InitKeyFrameIndex()
+{
+    AVStream *stream = GetStream(AVMEDIA_TYPE_VIDEO);
+    if(stream == nullptr)
+        return;
+
+    //mp4/mkv 等容器自带完整索引, 按时间戳 seek 已经是常数时间; 索引不完整时使用 sidecar 或者扫描
+    KeyFrameIndex *index = KeyFrameIndex::FromStream(stream, m_Duration);
+    if(index != nullptr)
+    {
+        SetKeyFrameIndex(index, false);
+        return;
+    }
+
+    if(!CacheUtil::GetFileCachePath(m_Url, KEY_FRAME_INDEX_SUFFIX, m_IndexPath, MAX_PATH))
+    {
+        LOGCATE("Demuxer::InitKeyFrameIndex no sidecar for url=%s", m_Url);
+        return;
+    }
+
+    index = KeyFrameIndex::Load(m_IndexPath);
+    if(index != nullptr)
+    {
+        SetKeyFrameIndex(index, true);
+        return;
+    }
+
+    m_IndexThread = new std::thread(DoIndexBuilding, this);
+}
+
+void Demuxer::SetKeyFrameIndex(KeyFrameIndex *index, bool scanned)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_KeyFrameIndex = index;
+    m_ByteSeekByIndex = scanned && index->HasPosition() &&
+            !(m_AVFormatContext->iformat->flags & AVFMT_NO_BYTE_SEEK);
+    LOGCATE("Demuxer::SetKeyFrameIndex count=%d, scanned=%d, byteSeek=%d", index->GetCount(), scanned, m_ByteSeekByIndex);
+}
+
+KeyFrameIndex *Demuxer::BuildKeyFrameIndex()
+{
+    KeyFrameIndex *index = nullptr;
+    AVFormatContext *formatContext = avformat_alloc_context();
+    //Stop 时中断扫描
+    formatContext->interrupt_callback.callback = InterruptCallback;
+    formatContext->interrupt_callback.opaque = this;
+
+    AVPacket *packet = av_packet_alloc();
+    do{
+        if(avformat_open_input(&formatContext, m_Url, NULL, NULL) != 0)
+        {
+            LOGCATE("Demuxer::BuildKeyFrameIndex avformat_open_input fail.");
+            formatContext = nullptr;
+            break;
+        }
+
+        if(avformat_find_stream_info(formatContext, NULL) < 0)
+        {
+            LOGCATE("Demuxer::BuildKeyFrameIndex avformat_find_stream_info fail.");
+            break;
+        }
+
+        //与播放使用的 AVFormatContext 相互独立, 流的序号用 id 对应
+        int streamId = GetStream(AVMEDIA_TYPE_VIDEO)->id;
+        int streamIndex = -1;
+        for (unsigned int i = 0; i < formatContext->nb_streams; ++i)
+        {
+            if(formatContext->streams[i]->id == streamId &&
+               formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                streamIndex = static_cast<int>(i);
+            else
+                formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        if(streamIndex < 0)
+        {
+            LOGCATE("Demuxer::BuildKeyFrameIndex Fail to find stream id=%d", streamId);
+            break;
+        }
+
+        index = new KeyFrameIndex(formatContext->streams[streamIndex]->time_base);
+        int result = 0;
+        while ((result = av_read_frame(formatContext, packet)) >= 0)
+        {
+            if(packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY))
+                index->Add(packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts, packet->pos);
+            av_packet_unref(packet);
+        }
+
+        //被中断时索引不完整, 不能保存
+        if(result != AVERROR_EOF || index->GetCount() == 0)
+        {
+            LOGCATE("Demuxer::BuildKeyFrameIndex abort, result=%d, count=%d", result, index->GetCount());
+            delete index;
+            index = nullptr;
+        }
+
+    }while (false);
+
+    av_packet_free(&packet);
+    if(formatContext != nullptr)
+        avformat_close_input(&formatContext);
+
+    return index;
+}
+
+void Demuxer::DoIndexBuilding(Demuxer *demuxer)
+{
+    int64_t startTime = av_gettime_relative();
+    KeyFrameIndex *index = demuxer->BuildKeyFrameIndex();
+    if(index == nullptr)
+        return;
+
+    LOGCATE("Demuxer::DoIndexBuilding count=%d, cost=%lldms", index->GetCount(), (long long)(av_gettime_relative() - startTime) / 1000);
+    index->Save(demuxer->m_IndexPath);
+    demuxer->SetKeyFrameIndex(index, true);
+}
+
+int Demuxer::InterruptCallback(void *context)
+{
+    Demuxer *demuxer = static_cast<Demuxer *>(context);
+    return demuxer->m_State == DEMUXER_STATE_STOP ? 1 : 0;
+}
+
+void Demuxer::DoSeek()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    float position = m_SeekPosition;
+    int seekMode = m_SeekMode;
+    m_SeekRequest = false;
+    lock.unlock();
+
+    int64_t seek_target = static_cast<int64_t>(position * 1000000);//微秒
+    int64_t seek_max = INT64_MAX;
+    long discardTarget = -1;
+    if(seekMode == SEEK_MODE_PREVIEW)
+    {
+        //预览直接显示关键帧, 不需要向前解码
+        seek_target = FindNearestKeyFrame(seek_target);
+    }
+    else
+    {
+        //精确 seek 必须落在目标之前的关键帧上
+        seek_max = seek_target;
+        discardTarget = static_cast<long>(position * 1000);
+    }
+
+    int seek_ret = -1;
+    int64_t seek_pos = FindKeyFramePosition(seek_target);
+    if(seek_pos >= 0)
+    {
+        //直接跳到关键帧的字节偏移, 不需要 libavformat 再去搜索
+        seek_ret = avformat_seek_file(m_AVFormatContext, -1, INT64_MIN, seek_pos, INT64_MAX, AVSEEK_FLAG_BYTE);
+        LOGCATE("Demuxer::DoSeek byte seek pos=%lld, ret=%d", (long long)seek_pos, seek_ret);
+    }
+    if(seek_ret < 0)
+        seek_ret = avformat_seek_file(m_AVFormatContext, -1, INT64_MIN, seek_target, seek_max, 0);
+    if(seek_ret < 0 && seek_max != INT64_MAX)
+    {
+        //目标之前没有关键帧, 退回到最近的关键帧
+        seek_ret = avformat_seek_file(m_AVFormatContext, -1, INT64_MIN, seek_target, INT64_MAX, 0);
+    }
+    if (seek_ret < 0) {
+        LOGCATE("Demuxer::DoSeek error while seeking target=%lld", (long long)seek_target);
+        return;
+    }
+
+    m_EOF = false;
+    m_SeekDiscardTarget = discardTarget;
+    m_VideoPacketQueue.Flush();
+    m_AudioPacketQueue.Flush();
+    if(m_VideoStreamIndex >= 0)
+        m_VideoPacketQueue.Put(PacketQueue::FlushPacket());
+    if(m_AudioStreamIndex >= 0)
+        m_AudioPacketQueue.Put(PacketQueue::FlushPacket());
+    LOGCATE("Demuxer::DoSeek seekFrame target=%lld, seekMode=%d, discardTarget=%ld", (long long)seek_target, seekMode, discardTarget);
+}
+
+void Demuxer::DemuxingLoop()
+{
+    for(;;)
+    {
+        if(m_State == DEMUXER_STATE_STOP)
+            break;
+
+        if(m_SeekRequest)
+            DoSeek();
+
+        if(m_EOF)
+        {
+            //读到文件末尾, 等待 seek 或者 stop
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            while (m_State != DEMUXER_STATE_STOP && !m_SeekRequest)
+            {
+                m_Cond.wait(lock);
+            }
+            continue;
+        }
+
+        AVPacket *packet = av_packet_alloc();
+        int result = av_read_frame(m_AVFormatContext, packet);
+        if(result < 0)
+        {
+            av_packet_free(&packet);
+            if(result == AVERROR_EOF || avio_feof(m_AVFormatContext->pb))
+            {
+                LOGCATE("Demuxer::DemuxingLoop end of file");
+                m_EOF = true;
+                //空 packet 通知解码器进入 draining 状态
+                if(m_VideoStreamIndex >= 0)
+                    m_VideoPacketQueue.Put(av_packet_alloc());
+                if(m_AudioStreamIndex >= 0)
+                    m_AudioPacketQueue.Put(av_packet_alloc());
+            }
+            else
+            {
+                av_usleep(10 * 1000);
+            }
+            continue;
+        }
+
+        if(packet->stream_index == m_VideoStreamIndex)
+        {
+            m_VideoPacketQueue.Put(packet);
+        }
+        else if(packet->stream_index == m_AudioStreamIndex)
+        {
+            m_AudioPacketQueue.Put(packet);
+        }
+        else
+        {
+            av_packet_free(&packet);
+        }
+    }
+}
+
+void Demuxer::DoDemuxing(Demuxer *demuxer)
+{
+    int result = demuxer->OpenInput();
+
+    std::unique_lock<std::mutex> lock(demuxer->m_Mutex);
+    demuxer->m_OpenResult = result;
+    if(demuxer->m_State == DEMUXER_STATE_UNKNOWN)
+        demuxer->m_State = DEMUXER_STATE_DEMUXING;
+    demuxer->m_Cond.notify_all();
+    lock.unlock();
+
+    if(result == 0)
+    {
+        demuxer->InitKeyFrameIndex();
+        demuxer->DemuxingLoop();
+    }
+}
@@ -0,0 +1,139 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_DEMUXER_H
+#define FFMPEGEXERCISE_DEMUXER_H
+
+extern "C"{
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+};
+
+#include <thread>
+#include "PacketQueue.h"
+#include "KeyFrameIndex.h"
+#include "ReadAheadIO.h"
+
+#define MAX_PATH 2048
+//libavformat 默认的探测大小
+#define DEFAULT_PROBE_SIZE 5000000
+
+enum DemuxerState{
+    DEMUXER_STATE_UNKNOWN,
+    DEMUXER_STATE_DEMUXING,
+    DEMUXER_STATE_STOP
+};
+
+enum SeekMode{
+    SEEK_MODE_EXACT,   //定位到目标之前的关键帧, 解码器向前解码并丢弃目标之前的帧
+    SEEK_MODE_PREVIEW  //吸附到离目标最近的关键帧, 用于拖动进度条时快速预览
+};
+
+//单个 AVFormatContext 的解复用器, 音视频解码器共享同一路输入
+class Demuxer {
+public:
+    Demuxer(const char *url);
+    ~Demuxer();
+
+    void Start();
+    void Stop();
+    //seek 请求只保存最新的目标, 解复用线程执行 seek 之前到达的请求会被合并
+    void SeekToPosition(float position, int seekMode = SEEK_MODE_EXACT);
+
+    //阻塞直到输入打开完成,成功返回 0
+    int WaitForOpen();
+
+    int GetStreamIndex(AVMediaType mediaType);
+    AVStream *GetStream(AVMediaType mediaType);
+    PacketQueue *GetPacketQueue(AVMediaType mediaType);
+
+    //预读缓冲区大小, 需要在 Start 之前设置
+    void SetReadAheadBufferSize(int bufferSize)
+    {
+        m_ReadAheadBufferSize = bufferSize;
+    }
+
+    //预读缓冲区的低水位和高水位(字节), <=0 使用默认值, 需要在 Start 之前设置
+    void SetReadAheadWatermarks(int64_t lowBytes, int64_t highBytes)
+    {
+        m_ReadAheadLowWatermark = lowBytes;
+        m_ReadAheadHighWatermark = highBytes;
+    }
+
+    //预读缓冲区中未读的字节数和对应时长(ms), 没有使用预读时返回 0
+    int64_t GetBufferedBytes();
+    int64_t GetBufferedDuration();
+
+    //ms
+    long GetDuration()
+    {
+        return m_Duration;
+    }
+
+    //最近一次 seek 需要丢弃到的时间戳(ms), -1 表示不需要丢弃, 解码器收到 flush packet 之后读取
+    long GetSeekDiscardTarget()
+    {
+        return m_SeekDiscardTarget;
+    }
+
+private:
+    int OpenInput();
+    void CloseInput();
+    void DemuxingLoop();
+    void DoSeek();
+    //返回离 target 最近的视频关键帧时间戳, 单位与 target 相同(AV_TIME_BASE)
+    int64_t FindNearestKeyFrame(int64_t target);
+    //返回 target 之前最近的关键帧的字节偏移, 不能按字节 seek 时返回 -1
+    int64_t FindKeyFramePosition(int64_t target);
+
+    //优先使用容器索引, 其次是 sidecar 文件, 都没有时启动后台线程扫描
+    void InitKeyFrameIndex();
+    void SetKeyFrameIndex(KeyFrameIndex *index, bool scanned);
+    KeyFrameIndex *BuildKeyFrameIndex();
+
+    static void DoIndexBuilding(Demuxer *demuxer);
+    static int InterruptCallback(void *context);
+
+    static void DoDemuxing(Demuxer *demuxer);
+
+    char m_Url[MAX_PATH] = {0};
+
+    AVFormatContext *m_AVFormatContext = nullptr;
+
+    //本地文件和 http 通过预读缓冲区读取, 用 m_Mutex 保护
+    ReadAheadIO *m_ReadAheadIO = nullptr;
+    int m_ReadAheadBufferSize = READ_AHEAD_DEFAULT_BUFFER_SIZE;
+    int64_t m_ReadAheadLowWatermark = 0;
+    int64_t m_ReadAheadHighWatermark = 0;
+
+    int m_VideoStreamIndex = -1;
+    int m_AudioStreamIndex = -1;
+
+    PacketQueue m_VideoPacketQueue;
+    PacketQueue m_AudioPacketQueue;
+
+    long m_Duration = 0;
+
+    //视频关键帧索引, 设置之后不再改变, 用 m_Mutex 保护
+    KeyFrameIndex *m_KeyFrameIndex = nullptr;
+    //扫描得到的索引可以按字节 seek, 避免 TS 等没有索引的容器每次 seek 都要搜索
+    bool m_ByteSeekByIndex = false;
+    char m_IndexPath[MAX_PATH] = {0};
+    std::thread *m_IndexThread = nullptr;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Cond;
+    std::thread *m_Thread = nullptr;
+
+    volatile int   m_State = DEMUXER_STATE_UNKNOWN;
+    //1: 正在打开, 0: 打开成功, <0: 打开失败
+    volatile int   m_OpenResult = 1;
+    volatile bool  m_SeekRequest = false;
+    volatile float m_SeekPosition = 0;
+    volatile int   m_SeekMode = SEEK_MODE_EXACT;
+    volatile long  m_SeekDiscardTarget = -1;
+    volatile bool  m_EOF = false;
+};
+
+#endif //FFMPEGEXERCISE_DEMUXER_H
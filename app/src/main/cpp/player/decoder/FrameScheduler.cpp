@@ -0,0 +1,58 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "FrameScheduler.h"
+#include "LogUtil.h"
+
+void FrameScheduler::BeginVsync(int64_t displayTime, int64_t vsyncInterval)
+{
+    m_DisplayTime = displayTime;
+    m_VsyncInterval = vsyncInterval;
+    m_Presented = false;
+}
+
+int64_t FrameScheduler::GetFrameDelay(int64_t frameTime)
+{
+    return frameTime - m_DisplayTime;
+}
+
+bool FrameScheduler::IsDue(int64_t frameTime)
+{
+    //恰好落在两个 vsync 中间的帧归到前一个, 保证结果确定
+    return GetFrameDelay(frameTime) <= m_VsyncInterval / 2 + FRAME_SCHEDULER_TIE_THRESHOLD;
+}
+
+void FrameScheduler::OnFramePresented(int64_t frameTime)
+{
+    int64_t error = GetFrameDelay(frameTime);
+    m_StatError += error >= 0 ? error : -error;
+    m_StatPresentCount++;
+    m_Presented = true;
+}
+
+void FrameScheduler::OnFrameDropped()
+{
+    m_StatDropCount++;
+}
+
+void FrameScheduler::EndVsync()
+{
+    if(!m_Presented)
+        m_StatRepeatCount++;
+
+    if(++m_StatVsyncCount < FRAME_SCHEDULER_STAT_VSYNC_COUNT)
+        return;
+
+    m_CadenceError = m_StatPresentCount > 0 ? static_cast<long>(m_StatError / m_StatPresentCount) : 0;
+    m_PresentCount = m_StatPresentCount;
+    m_RepeatCount = m_StatRepeatCount;
+    m_DropCount = m_StatDropCount;
+    LOGCATE("FrameScheduler::EndVsync vsyncs=%d, presented=%d, repeated=%d, dropped=%d, cadenceError=%ldus",
+            m_StatVsyncCount, m_StatPresentCount, m_StatRepeatCount, m_StatDropCount, m_CadenceError);
+    m_StatVsyncCount = 0;
+    m_StatPresentCount = 0;
+    m_StatRepeatCount = 0;
+    m_StatDropCount = 0;
+    m_StatError = 0;
+}
@@ -0,0 +1,75 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_FRAMESCHEDULER_H
+#define FFMPEGEXERCISE_FRAMESCHEDULER_H
+
+#include <stdint.h>
+
+//每隔多少个 vsync 统计一次送显节奏
+#define FRAME_SCHEDULER_STAT_VSYNC_COUNT 300
+//主时钟只精确到 ms, 晚于两个 vsync 中点不超过该值的帧也归到前一个 vsync,
+//恰好落在中点上的帧(24fps 在 60Hz 上每隔一帧)才能始终归到同一侧, 得到 3:2 而不是 2:3:3:2 的节奏
+#define FRAME_SCHEDULER_TIE_THRESHOLD 1000 //us
+
+//按 vsync 选择送显的视频帧.
+//每个 vsync 有一个上屏时对应的媒体时间 displayTime, pts 不晚于 displayTime + 半个 vsync 周期(加上时间戳精度)的帧在这个 vsync 上到期,
+//即每帧落在离它的 pts 最近的 vsync 上. 没有到期的帧时重复上一帧, 有多帧到期时只显示最新的一帧, 其余丢弃.
+//结果只取决于传入的时间, 24/25fps 在 60Hz 上得到稳定的 3:2 / 2:3 节奏, 可以用模拟的 vsync 序列验证
+class FrameScheduler
+{
+public:
+    //displayTime 与 vsyncInterval 都是媒体时间(us), 倍速播放时一个 vsync 对应的媒体时长按倍速放大
+    void BeginVsync(int64_t displayTime, int64_t vsyncInterval);
+
+    //时间戳为 frameTime(us) 的帧在当前 vsync 上是否已经到期.
+    //帧时间戳按 us 传入, 取整到 ms 会让落在中点附近的帧随机归到两侧, 打乱节奏
+    bool IsDue(int64_t frameTime);
+
+    //frameTime(us) 与当前 vsync 上屏时间的距离(us), 正值表示帧还没有到期
+    int64_t GetFrameDelay(int64_t frameTime);
+
+    void OnFramePresented(int64_t frameTime);
+    void OnFrameDropped();
+
+    //当前 vsync 结束, 没有送显新帧时记为重复
+    void EndVsync();
+
+    //最近一个统计周期内送显帧的 pts 与上屏时间的平均偏差(us)
+    long GetCadenceError()
+    {
+        return m_CadenceError;
+    }
+
+    //最近一个统计周期内送显、重复和丢弃的帧数
+    int GetPresentCount()
+    {
+        return m_PresentCount;
+    }
+    int GetRepeatCount()
+    {
+        return m_RepeatCount;
+    }
+    int GetDropCount()
+    {
+        return m_DropCount;
+    }
+
+private:
+    int64_t m_DisplayTime = 0;
+    int64_t m_VsyncInterval = 0;
+    bool m_Presented = false;
+
+    int m_StatVsyncCount = 0;
+    int m_StatPresentCount = 0;
+    int m_StatRepeatCount = 0;
+    int m_StatDropCount = 0;
+    int64_t m_StatError = 0;
+    volatile long m_CadenceError = 0;
+    volatile int m_PresentCount = 0;
+    volatile int m_RepeatCount = 0;
+    volatile int m_DropCount = 0;
+};
+
+#endif //FFMPEGEXERCISE_FRAMESCHEDULER_H
@@ -0,0 +1,171 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "KeyFrameIndex.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "LogUtil.h"
+
+//sidecar 文件头, 后面紧跟 count 个 KeyFrameEntry
+struct KeyFrameIndexHeader
+{
+    char magic[4];
+    int32_t version;
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    int32_t count;
+    int32_t hasPosition;
+};
+
+static const char KEY_FRAME_INDEX_MAGIC[4] = {'K', 'F', 'I', 'X'};
+
+static bool CompareTimeStamp(const KeyFrameEntry &entry, int64_t timestamp)
+{
+    return entry.timestamp < timestamp;
+}
+
+KeyFrameIndex::KeyFrameIndex(AVRational timeBase)
+{
+    m_TimeBase = timeBase;
+}
+
+void KeyFrameIndex::Add(int64_t timestamp, int64_t pos)
+{
+    if(timestamp == AV_NOPTS_VALUE)
+        return;
+
+    if(pos < 0)
+        m_HasPosition = false;
+
+    KeyFrameEntry entry = {timestamp, pos};
+    if(m_Entries.empty() || m_Entries.back().timestamp < timestamp)
+    {
+        m_Entries.push_back(entry);
+        return;
+    }
+
+    std::vector<KeyFrameEntry>::iterator it = std::lower_bound(m_Entries.begin(), m_Entries.end(), timestamp, CompareTimeStamp);
+    if(it == m_Entries.end() || it->timestamp != timestamp)
+        m_Entries.insert(it, entry);
+}
+
+int KeyFrameIndex::Search(int64_t timestamp, bool backward)
+{
+    std::vector<KeyFrameEntry>::iterator it = std::lower_bound(m_Entries.begin(), m_Entries.end(), timestamp, CompareTimeStamp);
+    int index = static_cast<int>(it - m_Entries.begin());
+    if(backward)
+    {
+        if(it == m_Entries.end() || it->timestamp != timestamp)
+            index--;
+        return index;
+    }
+    return index < GetCount() ? index : -1;
+}
+
+int KeyFrameIndex::Save(const char *path)
+{
+    char tmpPath[1024] = {0};
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE *file = fopen(tmpPath, "wb");
+    if(file == nullptr)
+    {
+        LOGCATE("KeyFrameIndex::Save fopen fail. path=%s", tmpPath);
+        return -1;
+    }
+
+    KeyFrameIndexHeader header;
+    memcpy(header.magic, KEY_FRAME_INDEX_MAGIC, sizeof(header.magic));
+    header.version = KEY_FRAME_INDEX_VERSION;
+    header.timeBaseNum = m_TimeBase.num;
+    header.timeBaseDen = m_TimeBase.den;
+    header.count = GetCount();
+    header.hasPosition = m_HasPosition ? 1 : 0;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(success && header.count > 0)
+        success = fwrite(&m_Entries[0], sizeof(KeyFrameEntry), m_Entries.size(), file) == m_Entries.size();
+    success = fclose(file) == 0 && success;
+
+    if(!success || rename(tmpPath, path) != 0)
+    {
+        LOGCATE("KeyFrameIndex::Save write fail. path=%s", path);
+        remove(tmpPath);
+        return -1;
+    }
+
+    LOGCATE("KeyFrameIndex::Save path=%s, count=%d", path, header.count);
+    return 0;
+}
+
+KeyFrameIndex *KeyFrameIndex::Load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == nullptr)
+        return nullptr;
+
+    KeyFrameIndex *index = nullptr;
+    do{
+        KeyFrameIndexHeader header;
+        if(fread(&header, sizeof(header), 1, file) != 1)
+            break;
+
+        if(memcmp(header.magic, KEY_FRAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+           header.version != KEY_FRAME_INDEX_VERSION || header.count <= 0 ||
+           header.timeBaseNum <= 0 || header.timeBaseDen <= 0)
+        {
+            LOGCATE("KeyFrameIndex::Load invalid header. path=%s", path);
+            break;
+        }
+
+        AVRational timeBase = {header.timeBaseNum, header.timeBaseDen};
+        index = new KeyFrameIndex(timeBase);
+        index->m_HasPosition = header.hasPosition != 0;
+        index->m_Entries.resize(header.count);
+        if(fread(&index->m_Entries[0], sizeof(KeyFrameEntry), header.count, file) != static_cast<size_t>(header.count))
+        {
+            LOGCATE("KeyFrameIndex::Load truncated. path=%s", path);
+            delete index;
+            index = nullptr;
+            break;
+        }
+
+        LOGCATE("KeyFrameIndex::Load path=%s, count=%d", path, header.count);
+    }while (false);
+
+    fclose(file);
+    return index;
+}
+
+KeyFrameIndex *KeyFrameIndex::FromStream(AVStream *stream, long duration)
+{
+    if(stream == nullptr || stream->nb_index_entries <= 0 || duration <= 0)
+        return nullptr;
+
+    KeyFrameIndex *index = new KeyFrameIndex(stream->time_base);
+    for (int i = 0; i < stream->nb_index_entries; ++i)
+    {
+        const AVIndexEntry &entry = stream->index_entries[i];
+        if(entry.flags & AVINDEX_KEYFRAME)
+            index->Add(entry.timestamp, entry.pos);
+    }
+
+    if(index->GetCount() == 0)
+    {
+        delete index;
+        return nullptr;
+    }
+
+    int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    int64_t lastTime = av_rescale_q(index->m_Entries.back().timestamp - startTime, stream->time_base, av_make_q(1, 1000));
+    if(lastTime < duration - KEY_FRAME_INDEX_MAX_TAIL)
+    {
+        LOGCATE("KeyFrameIndex::FromStream partial index, count=%d, last=%lldms, duration=%ldms",
+                index->GetCount(), (long long)lastTime, duration);
+        delete index;
+        return nullptr;
+    }
+    return index;
+}
@@ -0,0 +1,73 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_KEYFRAMEINDEX_H
+#define FFMPEGEXERCISE_KEYFRAMEINDEX_H
+
+extern "C"{
+#include <libavformat/avformat.h>
+};
+
+#include <vector>
+
+#define KEY_FRAME_INDEX_SUFFIX  ".kfi"
+#define KEY_FRAME_INDEX_VERSION 1
+//容器索引的最后一个关键帧离结尾不超过该值(ms)时才认为索引完整
+#define KEY_FRAME_INDEX_MAX_TAIL 10000
+
+struct KeyFrameEntry
+{
+    int64_t timestamp; //视频流 time_base
+    int64_t pos;       //packet 在文件中的字节偏移, -1 表示未知
+};
+
+//视频关键帧索引, 来自容器自带的索引或者后台扫描一遍码流, 扫描结果保存为 sidecar 文件
+class KeyFrameIndex {
+public:
+    KeyFrameIndex(AVRational timeBase);
+
+    //按时间戳有序插入, 重复的时间戳忽略
+    void Add(int64_t timestamp, int64_t pos);
+
+    //backward 为 true 时返回时间戳 <= timestamp 的最后一个关键帧, 否则返回 >= timestamp 的第一个, 没有时返回 -1
+    int Search(int64_t timestamp, bool backward);
+
+    const KeyFrameEntry &GetEntry(int index)
+    {
+        return m_Entries[index];
+    }
+
+    int GetCount()
+    {
+        return static_cast<int>(m_Entries.size());
+    }
+
+    AVRational GetTimeBase()
+    {
+        return m_TimeBase;
+    }
+
+    //所有关键帧都有字节偏移时才能按字节 seek
+    bool HasPosition()
+    {
+        return m_HasPosition;
+    }
+
+    //先写临时文件再重命名, 避免留下不完整的索引
+    int Save(const char *path);
+
+    //文件不存在或者校验失败时返回 nullptr
+    static KeyFrameIndex *Load(const char *path);
+
+    //从容器自带的索引构建, duration 为文件时长(ms). ts 或者没有 cues 的 mkv 等边读边建立索引的容器,
+    //探测之后只有部分索引, 没有覆盖到结尾时返回 nullptr
+    static KeyFrameIndex *FromStream(AVStream *stream, long duration);
+
+private:
+    AVRational m_TimeBase;
+    std::vector<KeyFrameEntry> m_Entries;
+    bool m_HasPosition = true;
+};
+
+#endif //FFMPEGEXERCISE_KEYFRAMEINDEX_H
@@ -0,0 +1,530 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "MediaCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <linux/falloc.h>
+#include <vector>
+#include <algorithm>
+#include "CacheUtil.h"
+#include "LogUtil.h"
+
+struct MediaCacheHeader
+{
+    char magic[4];
+    int32_t version;
+    int64_t size;
+    int64_t validatedTime;
+    int32_t count;
+    int32_t reserved;
+};
+
+static const char MEDIA_CACHE_MAGIC[4] = {'M', 'C', 'R', 'G'};
+
+int64_t MediaCache::s_Budget = MEDIA_CACHE_DEFAULT_BUDGET;
+std::mutex MediaCache::s_Mutex;
+std::set<std::string> MediaCache::s_ActivePaths;
+
+MediaCache::MediaCache(const char *url)
+{
+    strncpy(m_Url, url, sizeof(m_Url) - 1);
+    memset(&m_InterruptCallback, 0, sizeof(m_InterruptCallback));
+}
+
+MediaCache::~MediaCache()
+{
+    Close();
+}
+
+bool MediaCache::IsSupported(const char *url)
+{
+    const char *protocol = avio_find_protocol_name(url);
+    if(protocol == nullptr || (strcmp(protocol, "http") != 0 && strcmp(protocol, "https") != 0))
+        return false;
+
+    char path[MEDIA_CACHE_MAX_PATH];
+    return CacheUtil::GetCachePath(url, MEDIA_CACHE_DATA_SUFFIX, path, sizeof(path));
+}
+
+void MediaCache::SetBudget(int64_t budget)
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    s_Budget = budget;
+}
+
+int MediaCache::Open(const AVIOInterruptCB *interruptCallback)
+{
+    int result = -1;
+    do{
+        if(!CacheUtil::GetCachePath(m_Url, MEDIA_CACHE_DATA_SUFFIX, m_DataPath, sizeof(m_DataPath)) ||
+           !CacheUtil::GetCachePath(m_Url, MEDIA_CACHE_RANGE_SUFFIX, m_RangePath, sizeof(m_RangePath)))
+        {
+            break;
+        }
+
+        if(interruptCallback)
+            m_InterruptCallback = *interruptCallback;
+
+        m_DataFd = open(m_DataPath, O_RDWR | O_CREAT, 0644);
+        if(m_DataFd < 0)
+        {
+            LOGCATE("MediaCache::Open open fail. path=%s", m_DataPath);
+            break;
+        }
+
+        if(LoadRanges() != 0)
+        {
+            //区间表无效时数据文件也不可信
+            m_Size = -1;
+            if(ResetCache() != 0)
+                break;
+        }
+
+        //不知道文件大小, 或者缓存太久没有校验时需要先连接网络
+        if((m_Size < 0 || time(nullptr) - m_ValidatedTime > MEDIA_CACHE_MAX_UNVALIDATED_AGE) && OpenNetwork() != 0)
+            break;
+
+        //更新最近使用时间
+        utimes(m_RangePath, nullptr);
+        std::unique_lock<std::mutex> lock(s_Mutex);
+        s_ActivePaths.insert(m_DataPath);
+        result = 0;
+    }while (false);
+
+    LOGCATE("MediaCache::Open result=%d, size=%lld, ranges=%d", result, (long long)m_Size, (int)m_Ranges.size());
+    return result;
+}
+
+void MediaCache::Close()
+{
+    if(m_DataFd >= 0)
+    {
+        EnforceBudget();
+        SaveRanges();
+        close(m_DataFd);
+        m_DataFd = -1;
+        std::unique_lock<std::mutex> lock(s_Mutex);
+        s_ActivePaths.erase(m_DataPath);
+    }
+
+    if(m_Network)
+        avio_closep(&m_Network);
+}
+
+//RFC 7231 的 HTTP-date, 不受 locale 影响
+static void FormatHttpDate(int64_t time, char *buffer, int size)
+{
+    static const char *const s_WeekDays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *const s_Months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                           "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    time_t t = static_cast<time_t>(time);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    snprintf(buffer, size, "%s, %02d %s %04d %02d:%02d:%02d GMT", s_WeekDays[tm.tm_wday], tm.tm_mday,
+             s_Months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+int MediaCache::OpenNetwork()
+{
+    bool validate = !m_Ranges.empty() && m_ValidatedTime > 0;
+    int64_t requestTime = time(nullptr);
+    int result = OpenNetworkConnection(validate);
+    if(result == AVERROR_HTTP_OTHER_4XX && validate)
+    {
+        //412: 远端在上一次校验之后被修改, 丢弃旧的缓存重新请求
+        LOGCATE("MediaCache::OpenNetwork precondition failed, drop cache. url=%s", m_Url);
+        if(ResetCache() != 0)
+            return AVERROR(EIO);
+        result = OpenNetworkConnection(false);
+    }
+    if(result < 0)
+        return result;
+
+    m_NetworkPosition = 0;
+    int64_t size = avio_size(m_Network);
+    if(m_Size >= 0 && size != m_Size)
+    {
+        //远端文件变化, 丢弃旧的缓存
+        LOGCATE("MediaCache::OpenNetwork size changed %lld -> %lld", (long long)m_Size, (long long)size);
+        if(ResetCache() != 0)
+            return AVERROR(EIO);
+    }
+    m_Size = size;
+    //请求发出时远端与缓存一致, 或者缓存是从这次请求开始下载的
+    m_ValidatedTime = requestTime;
+    return 0;
+}
+
+int MediaCache::OpenNetworkConnection(bool validate)
+{
+    AVDictionary *options = nullptr;
+    av_dict_set(&options, "rw_timeout", "20000000", 0);
+    if(validate)
+    {
+        //通过 http 协议自己的 headers 选项发送, 代理, user-agent, cookie 等设置仍然有效
+        char date[64] = {0};
+        char headers[128] = {0};
+        FormatHttpDate(m_ValidatedTime, date, sizeof(date));
+        snprintf(headers, sizeof(headers), "If-Unmodified-Since: %s\r\n", date);
+        av_dict_set(&options, "headers", headers, 0);
+    }
+    int result = avio_open2(&m_Network, m_Url, AVIO_FLAG_READ, &m_InterruptCallback, &options);
+    av_dict_free(&options);
+    if(result < 0)
+        LOGCATE("MediaCache::OpenNetworkConnection avio_open2 fail. result=%d, validate=%d", result, validate);
+    return result;
+}
+
+int MediaCache::ResetCache()
+{
+    m_Ranges.clear();
+    m_ValidatedTime = 0;
+    m_UnsavedBytes = 0;
+    return ftruncate(m_DataFd, 0) == 0 ? 0 : -1;
+}
+
+int MediaCache::Read(uint8_t *buffer, int size)
+{
+    if(m_Size >= 0 && m_Position >= m_Size)
+        return AVERROR_EOF;
+
+    int64_t cachedEnd = FindCachedEnd(m_Position);
+    if(cachedEnd > m_Position)
+    {
+        int length = static_cast<int>(std::min<int64_t>(size, cachedEnd - m_Position));
+        ssize_t ret = pread(m_DataFd, buffer, length, m_Position);
+        if(ret > 0)
+        {
+            m_Position += ret;
+            return static_cast<int>(ret);
+        }
+        //磁盘数据读取失败, 退回到网络
+        LOGCATE("MediaCache::Read pread fail. position=%lld", (long long)m_Position);
+    }
+
+    return ReadFromNetwork(buffer, size);
+}
+
+int MediaCache::ReadFromNetwork(uint8_t *buffer, int size)
+{
+    if(m_Network == nullptr)
+    {
+        int result = OpenNetwork();
+        if(result != 0)
+            return result;
+    }
+
+    if(m_NetworkPosition != m_Position)
+    {
+        int64_t ret = avio_seek(m_Network, m_Position, SEEK_SET);
+        if(ret < 0)
+        {
+            LOGCATE("MediaCache::ReadFromNetwork avio_seek fail. position=%lld", (long long)m_Position);
+            avio_closep(&m_Network);
+            return static_cast<int>(ret);
+        }
+        m_NetworkPosition = m_Position;
+    }
+
+    //只下载到下一个已缓存区间的开始位置
+    int64_t nextCached = FindNextCachedStart(m_Position);
+    if(nextCached > m_Position)
+        size = static_cast<int>(std::min<int64_t>(size, nextCached - m_Position));
+
+    int ret = avio_read(m_Network, buffer, size);
+    if(ret == 0 || ret == AVERROR_EOF)
+        return AVERROR_EOF;
+    if(ret < 0)
+    {
+        //连接断开, 下次读取时重新连接并从 m_Position 继续
+        LOGCATE("MediaCache::ReadFromNetwork avio_read fail. ret=%d, position=%lld", ret, (long long)m_Position);
+        avio_closep(&m_Network);
+        return ret;
+    }
+
+    if(pwrite(m_DataFd, buffer, ret, m_Position) == ret)
+    {
+        AddRange(m_Position, m_Position + ret);
+        m_UnsavedBytes += ret;
+        if(m_UnsavedBytes >= MEDIA_CACHE_SAVE_INTERVAL)
+        {
+            EnforceBudget();
+            SaveRanges();
+        }
+    }
+
+    m_Position += ret;
+    m_NetworkPosition += ret;
+    return ret;
+}
+
+int64_t MediaCache::Seek(int64_t position)
+{
+    if(position < 0 || (m_Size >= 0 && position > m_Size))
+        return AVERROR(EINVAL);
+
+    //网络连接的位置在真正读取缺失数据时才调整
+    m_Position = position;
+    return position;
+}
+
+int64_t MediaCache::FindCachedEnd(int64_t position)
+{
+    std::map<int64_t, int64_t>::iterator it = m_Ranges.upper_bound(position);
+    if(it == m_Ranges.begin())
+        return -1;
+    --it;
+    return it->second > position ? it->second : -1;
+}
+
+int64_t MediaCache::FindNextCachedStart(int64_t position)
+{
+    std::map<int64_t, int64_t>::iterator it = m_Ranges.upper_bound(position);
+    return it != m_Ranges.end() ? it->first : -1;
+}
+
+void MediaCache::AddRange(int64_t start, int64_t end)
+{
+    std::map<int64_t, int64_t>::iterator it = m_Ranges.upper_bound(start);
+    //与前一个区间重叠或相邻时合并
+    if(it != m_Ranges.begin())
+    {
+        std::map<int64_t, int64_t>::iterator prev = it;
+        --prev;
+        if(prev->second >= start)
+        {
+            start = prev->first;
+            end = std::max(end, prev->second);
+            m_Ranges.erase(prev);
+        }
+    }
+
+    //合并后面被覆盖或相邻的区间
+    it = m_Ranges.lower_bound(start);
+    while (it != m_Ranges.end() && it->first <= end)
+    {
+        end = std::max(end, it->second);
+        it = m_Ranges.erase(it);
+    }
+
+    m_Ranges[start] = end;
+}
+
+void MediaCache::RemoveRange(int64_t start, int64_t end)
+{
+    std::map<int64_t, int64_t>::iterator it = m_Ranges.upper_bound(start);
+    if(it != m_Ranges.begin())
+        --it;
+
+    //与 [start, end) 重叠的区间只保留两端不重叠的部分
+    while (it != m_Ranges.end() && it->first < end)
+    {
+        int64_t rangeStart = it->first;
+        int64_t rangeEnd = it->second;
+        if(rangeEnd <= start)
+        {
+            ++it;
+            continue;
+        }
+
+        it = m_Ranges.erase(it);
+        if(rangeStart < start)
+            m_Ranges[rangeStart] = start;
+        if(rangeEnd > end)
+            m_Ranges[end] = rangeEnd;
+    }
+}
+
+void MediaCache::EnforceBudget()
+{
+    int64_t excess = TrimCache();
+    if(excess > 0)
+        EvictColdRanges(excess);
+}
+
+void MediaCache::EvictColdRanges(int64_t bytes)
+{
+    //先淘汰播放位置之前最早的数据, 再淘汰播放位置之后最远的数据
+    int64_t hotStart = std::max<int64_t>(0, m_Position - MEDIA_CACHE_HOT_WINDOW);
+    int64_t hotEnd = m_Position + MEDIA_CACHE_HOT_WINDOW;
+    int64_t unit = std::max<int64_t>(bytes, MEDIA_CACHE_EVICT_UNIT);
+    while (bytes > 0 && !m_Ranges.empty())
+    {
+        int64_t start = 0;
+        int64_t end = 0;
+        std::map<int64_t, int64_t>::iterator first = m_Ranges.begin();
+        std::map<int64_t, int64_t>::reverse_iterator last = m_Ranges.rbegin();
+        if(first->first < hotStart)
+        {
+            start = first->first;
+            end = std::min(std::min(first->second, hotStart), start + unit);
+        }
+        else if(last->second > hotEnd)
+        {
+            end = last->second;
+            start = std::max(std::max(last->first, hotEnd), end - unit);
+        }
+        else
+        {
+            break;
+        }
+
+        //稀疏文件打洞释放磁盘块, 文件大小不变
+        if(fallocate(m_DataFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) != 0)
+        {
+            LOGCATE("MediaCache::EvictColdRanges punch hole fail. [%lld, %lld)", (long long)start, (long long)end);
+            break;
+        }
+
+        LOGCATE("MediaCache::EvictColdRanges [%lld, %lld), position=%lld", (long long)start, (long long)end, (long long)m_Position);
+        RemoveRange(start, end);
+        bytes -= end - start;
+    }
+}
+
+int MediaCache::LoadRanges()
+{
+    FILE *file = fopen(m_RangePath, "rb");
+    if(file == nullptr)
+        return -1;
+
+    int result = -1;
+    do{
+        MediaCacheHeader header;
+        if(fread(&header, sizeof(header), 1, file) != 1 ||
+           memcmp(header.magic, MEDIA_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+           header.version != MEDIA_CACHE_VERSION || header.count < 0)
+        {
+            LOGCATE("MediaCache::LoadRanges invalid header. path=%s", m_RangePath);
+            break;
+        }
+
+        std::vector<int64_t> ranges(header.count * 2);
+        if(header.count > 0 && fread(&ranges[0], sizeof(int64_t), ranges.size(), file) != ranges.size())
+            break;
+
+        for (int i = 0; i < header.count; ++i)
+        {
+            if(ranges[i * 2] < ranges[i * 2 + 1])
+                AddRange(ranges[i * 2], ranges[i * 2 + 1]);
+        }
+        m_Size = header.size;
+        m_ValidatedTime = header.validatedTime;
+        result = 0;
+    }while (false);
+
+    fclose(file);
+    return result;
+}
+
+int MediaCache::SaveRanges()
+{
+    char tmpPath[MEDIA_CACHE_MAX_PATH + 8] = {0};
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", m_RangePath);
+
+    FILE *file = fopen(tmpPath, "wb");
+    if(file == nullptr)
+        return -1;
+
+    MediaCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MEDIA_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MEDIA_CACHE_VERSION;
+    header.size = m_Size;
+    header.validatedTime = m_ValidatedTime;
+    header.count = static_cast<int32_t>(m_Ranges.size());
+
+    std::vector<int64_t> ranges;
+    ranges.reserve(m_Ranges.size() * 2);
+    for (std::map<int64_t, int64_t>::iterator it = m_Ranges.begin(); it != m_Ranges.end(); ++it)
+    {
+        ranges.push_back(it->first);
+        ranges.push_back(it->second);
+    }
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(success && !ranges.empty())
+        success = fwrite(&ranges[0], sizeof(int64_t), ranges.size(), file) == ranges.size();
+    success = fclose(file) == 0 && success;
+
+    if(!success || rename(tmpPath, m_RangePath) != 0)
+    {
+        remove(tmpPath);
+        return -1;
+    }
+
+    m_UnsavedBytes = 0;
+    return 0;
+}
+
+struct MediaCacheEntry
+{
+    std::string dataPath;
+    std::string rangePath;
+    int64_t diskUsage;
+    time_t lastUsed;
+};
+
+static bool CompareLastUsed(const MediaCacheEntry &a, const MediaCacheEntry &b)
+{
+    return a.lastUsed < b.lastUsed;
+}
+
+int64_t MediaCache::TrimCache()
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    char cacheDir[MEDIA_CACHE_MAX_PATH] = {0};
+    CacheUtil::GetCacheDir(cacheDir, sizeof(cacheDir));
+    DIR *dir = opendir(cacheDir);
+    if(dir == nullptr)
+        return 0;
+
+    std::vector<MediaCacheEntry> entries;
+    int64_t totalUsage = 0;
+    int suffixLength = strlen(MEDIA_CACHE_DATA_SUFFIX);
+    struct dirent *dirEntry = nullptr;
+    while ((dirEntry = readdir(dir)) != nullptr)
+    {
+        int nameLength = strlen(dirEntry->d_name);
+        if(nameLength <= suffixLength || strcmp(dirEntry->d_name + nameLength - suffixLength, MEDIA_CACHE_DATA_SUFFIX) != 0)
+            continue;
+
+        MediaCacheEntry entry;
+        entry.dataPath = std::string(cacheDir) + "/" + dirEntry->d_name;
+        entry.rangePath = entry.dataPath.substr(0, entry.dataPath.size() - suffixLength) + MEDIA_CACHE_RANGE_SUFFIX;
+
+        struct stat dataStat;
+        if(stat(entry.dataPath.c_str(), &dataStat) != 0)
+            continue;
+        //稀疏文件按实际占用的块计算
+        entry.diskUsage = static_cast<int64_t>(dataStat.st_blocks) * 512;
+
+        struct stat rangeStat;
+        entry.lastUsed = stat(entry.rangePath.c_str(), &rangeStat) == 0 ? rangeStat.st_mtime : dataStat.st_mtime;
+
+        totalUsage += entry.diskUsage;
+        entries.push_back(entry);
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), CompareLastUsed);
+    for (size_t i = 0; i < entries.size() && totalUsage > s_Budget; ++i)
+    {
+        if(s_ActivePaths.count(entries[i].dataPath) > 0)
+            continue;
+
+        LOGCATE("MediaCache::TrimCache remove %s, usage=%lld", entries[i].dataPath.c_str(), (long long)entries[i].diskUsage);
+        remove(entries[i].dataPath.c_str());
+        remove(entries[i].rangePath.c_str());
+        totalUsage -= entries[i].diskUsage;
+    }
+    return totalUsage > s_Budget ? totalUsage - s_Budget : 0;
+}
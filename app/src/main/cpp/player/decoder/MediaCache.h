@@ -0,0 +1,115 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_MEDIACACHE_H
+#define FFMPEGEXERCISE_MEDIACACHE_H
+
+extern "C"{
+#include <libavformat/avio.h>
+};
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <mutex>
+
+#define MEDIA_CACHE_DATA_SUFFIX   ".mcd"
+#define MEDIA_CACHE_RANGE_SUFFIX  ".mcr"
+#define MEDIA_CACHE_VERSION       2
+//缓存内容上一次确认与远端一致之后, 不连接网络直接使用的时长(s), 超过后 Open 时先校验
+#define MEDIA_CACHE_MAX_UNVALIDATED_AGE (24 * 3600)
+#define MEDIA_CACHE_DEFAULT_BUDGET (512LL * 1024 * 1024)
+//累计写入超过该值时保存一次区间表, 异常退出时最多丢失这部分缓存
+#define MEDIA_CACHE_SAVE_INTERVAL (4 * 1024 * 1024)
+#define MEDIA_CACHE_MAX_PATH      1024
+//超出容量时当前文件中播放位置前后的这部分数据不淘汰
+#define MEDIA_CACHE_HOT_WINDOW    (8 * 1024 * 1024)
+//淘汰当前文件区间的最小单位
+#define MEDIA_CACHE_EVICT_UNIT    (1024 * 1024)
+
+//网络文件的磁盘缓存. 已下载的字节按原偏移写入稀疏文件, 区间表记录哪些范围有效,
+//命中的范围直接从磁盘读取, 缺失的范围按需从网络获取. 所有缓存共享一个 LRU 容量上限,
+//写入时检查, 淘汰其他文件后仍然超出时淘汰当前文件中远离播放位置的区间.
+//libavformat 的 http 协议不导出 ETag/Last-Modified, 区间表记录缓存内容最近一次确认有效的时间,
+//连接网络时带上 If-Unmodified-Since, 远端在这之后被修改时服务端返回 412, 丢弃旧的缓存.
+class MediaCache {
+public:
+    MediaCache(const char *url);
+    ~MediaCache();
+
+    //只缓存 http(s), 并且需要设置缓存目录
+    static bool IsSupported(const char *url);
+
+    //区间表中有文件大小并且在 MEDIA_CACHE_MAX_UNVALIDATED_AGE 内校验过时不会立即连接网络, 完全命中的文件可以离线播放
+    int Open(const AVIOInterruptCB *interruptCallback);
+    void Close();
+
+    //返回读取的字节数, 结束时返回 AVERROR_EOF
+    int Read(uint8_t *buffer, int size);
+    int64_t Seek(int64_t position);
+
+    //未知时返回 -1
+    int64_t GetSize()
+    {
+        return m_Size;
+    }
+
+    bool IsSeekable()
+    {
+        return m_Size > 0;
+    }
+
+    //所有缓存文件占用的磁盘空间上限
+    static void SetBudget(int64_t budget);
+
+private:
+    int OpenNetwork();
+    //validate 为 true 时带上 If-Unmodified-Since 校验缓存
+    int OpenNetworkConnection(bool validate);
+    //丢弃所有已缓存的数据
+    int ResetCache();
+    int ReadFromNetwork(uint8_t *buffer, int size);
+
+    //position 所在的已缓存区间的结束位置, 不在缓存中时返回 -1
+    int64_t FindCachedEnd(int64_t position);
+    //position 之后第一个已缓存区间的开始位置, 没有时返回 -1
+    int64_t FindNextCachedStart(int64_t position);
+    void AddRange(int64_t start, int64_t end);
+    void RemoveRange(int64_t start, int64_t end);
+
+    void EnforceBudget();
+    //释放当前文件中离播放位置最远的 bytes 字节
+    void EvictColdRanges(int64_t bytes);
+
+    int LoadRanges();
+    int SaveRanges();
+
+    //按最近使用时间淘汰没有打开的缓存文件, 返回淘汰后仍然超出容量的字节数
+    static int64_t TrimCache();
+
+    char m_Url[2048] = {0};
+    char m_DataPath[MEDIA_CACHE_MAX_PATH] = {0};
+    char m_RangePath[MEDIA_CACHE_MAX_PATH] = {0};
+
+    AVIOInterruptCB m_InterruptCallback;
+    AVIOContext *m_Network = nullptr;
+    int64_t m_NetworkPosition = 0;
+    int m_DataFd = -1;
+
+    //已缓存的区间 [start, end), 相邻的区间会合并
+    std::map<int64_t, int64_t> m_Ranges;
+    int64_t m_Size = -1;
+    int64_t m_Position = 0;
+    int64_t m_UnsavedBytes = 0;
+    //缓存内容最近一次确认与远端一致的时间(time(), s), 0 表示没有缓存
+    int64_t m_ValidatedTime = 0;
+
+    static int64_t s_Budget;
+    static std::mutex s_Mutex;
+    //正在使用的缓存文件, TrimCache 不会删除
+    static std::set<std::string> s_ActivePaths;
+};
+
+#endif //FFMPEGEXERCISE_MEDIACACHE_H
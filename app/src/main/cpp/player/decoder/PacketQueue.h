@@ -0,0 +1,116 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_PACKETQUEUE_H
+#define FFMPEGEXERCISE_PACKETQUEUE_H
+
+extern "C"{
+#include <libavcodec/avcodec.h>
+};
+
+#include "ThreadSafeQueue.h"
+
+#define MAX_PACKET_QUEUE_COUNT    1024
+#define MAX_PACKET_QUEUE_BYTES    (8 * 1024 * 1024)
+#define MAX_PACKET_QUEUE_DURATION 10000 //ms
+
+//解复用线程与解码线程之间的 packet 队列
+class PacketQueue
+{
+public:
+    PacketQueue() : m_Queue(MAX_PACKET_QUEUE_COUNT, MAX_PACKET_QUEUE_BYTES, MAX_PACKET_QUEUE_DURATION)
+    {
+        m_TimeBase.num = 1;
+        m_TimeBase.den = 1000;
+    }
+
+    ~PacketQueue()
+    {
+        Flush();
+    }
+
+    //用于把 packet 时长换算为毫秒
+    void SetTimeBase(AVRational timeBase)
+    {
+        m_TimeBase = timeBase;
+    }
+
+    //队列满时阻塞,被 Abort 时释放 packet 并返回 -1
+    int Put(AVPacket *packet)
+    {
+        int64_t duration = 0;
+        if(packet != FlushPacket() && packet->duration > 0)
+        {
+            AVRational msTimeBase = {1, 1000};
+            duration = av_rescale_q(packet->duration, m_TimeBase, msTimeBase);
+        }
+
+        if(!m_Queue.Push(packet, packet->size, duration))
+        {
+            ReleasePacket(packet);
+            return -1;
+        }
+        return 0;
+    }
+
+    //队列空时阻塞,被 Abort 时返回 nullptr
+    AVPacket *Get()
+    {
+        AVPacket *packet = nullptr;
+        if(!m_Queue.Pop(packet))
+            return nullptr;
+        return packet;
+    }
+
+    void Flush()
+    {
+        m_Queue.Clear(ReleasePacket);
+    }
+
+    void Abort()
+    {
+        m_Queue.Abort();
+    }
+
+    void Reset()
+    {
+        m_Queue.Reset();
+    }
+
+    int GetPacketCount()
+    {
+        return m_Queue.Size();
+    }
+
+    //ms
+    int64_t GetBufferedDuration()
+    {
+        return m_Queue.Duration();
+    }
+
+    //seek 之后插入队列,通知解码器刷新缓冲区
+    static AVPacket *FlushPacket()
+    {
+        static AVPacket s_FlushPacket;
+        return &s_FlushPacket;
+    }
+
+    //数据为空的 packet 表示流结束,解码器收到后进入 draining 状态
+    static bool IsEndOfStream(AVPacket *packet)
+    {
+        return packet != FlushPacket() && packet->data == nullptr && packet->size == 0;
+    }
+
+private:
+    static void ReleasePacket(AVPacket *&packet)
+    {
+        if(packet != FlushPacket())
+            av_packet_free(&packet);
+    }
+
+    ThreadSafeQueue<AVPacket*> m_Queue;
+    AVRational m_TimeBase;
+};
+
+#endif //FFMPEGEXERCISE_PACKETQUEUE_H
@@ -0,0 +1,423 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "ReadAheadIO.h"
+#include <string.h>
+#include <algorithm>
+#include "LogUtil.h"
+
+ReadAheadIO::ReadAheadIO(const char *url, int bufferSize)
+{
+    strncpy(m_Url, url, sizeof(m_Url) - 1);
+    m_Capacity = bufferSize > READ_AHEAD_CHUNK_SIZE * 4 ? bufferSize : READ_AHEAD_CHUNK_SIZE * 4;
+    m_Ring.resize(m_Capacity);
+    m_BackBufferSize = m_Capacity / 8;
+    m_HighWatermark = m_Capacity - m_BackBufferSize;
+    m_LowWatermark = m_HighWatermark / 2;
+}
+
+ReadAheadIO::~ReadAheadIO()
+{
+    Close();
+}
+
+bool ReadAheadIO::IsSupported(const char *url)
+{
+    const char *protocol = avio_find_protocol_name(url);
+    if(protocol == nullptr)
+        return false;
+
+    return strcmp(protocol, "file") == 0 || strcmp(protocol, "http") == 0 || strcmp(protocol, "https") == 0;
+}
+
+int ReadAheadIO::Open(const AVIOInterruptCB *interruptCallback)
+{
+    int result = -1;
+    do{
+        if(interruptCallback)
+            m_InterruptCallback = *interruptCallback;
+
+        int seekable = 0;
+        if(MediaCache::IsSupported(m_Url))
+        {
+            m_MediaCache = new MediaCache(m_Url);
+            result = m_MediaCache->Open(interruptCallback);
+            if(result < 0)
+            {
+                delete m_MediaCache;
+                m_MediaCache = nullptr;
+            }
+            else
+            {
+                m_FileSize = m_MediaCache->GetSize();
+                seekable = m_MediaCache->IsSeekable() ? AVIO_SEEKABLE_NORMAL : 0;
+            }
+        }
+
+        if(m_MediaCache == nullptr)
+        {
+            result = OpenSource();
+            if(result < 0)
+            {
+                LOGCATE("ReadAheadIO::Open avio_open2 fail. result=%d", result);
+                break;
+            }
+            m_FileSize = avio_size(m_Source);
+            seekable = m_Source->seekable;
+        }
+
+        uint8_t *ioBuffer = static_cast<uint8_t *>(av_malloc(READ_AHEAD_AVIO_BUFFER_SIZE));
+        m_AVIOContext = avio_alloc_context(ioBuffer, READ_AHEAD_AVIO_BUFFER_SIZE, 0, this, ReadPacket, nullptr, Seek);
+        if(m_AVIOContext == nullptr)
+        {
+            av_free(ioBuffer);
+            result = AVERROR(ENOMEM);
+            break;
+        }
+        m_AVIOContext->seekable = seekable;
+        m_Seekable = seekable != 0;
+
+        m_Thread = new std::thread(DoReading, this);
+        result = 0;
+    }while (false);
+
+    LOGCATE("ReadAheadIO::Open result=%d, fileSize=%lld, capacity=%lld", result, (long long)m_FileSize, (long long)m_Capacity);
+    return result;
+}
+
+void ReadAheadIO::Close()
+{
+    Abort();
+    if(m_Thread)
+    {
+        m_Thread->join();
+        delete m_Thread;
+        m_Thread = nullptr;
+    }
+
+    if(m_AVIOContext)
+    {
+        //缓冲区可能被 libavformat 重新分配过, 需要通过 AVIOContext 释放
+        av_freep(&m_AVIOContext->buffer);
+        avio_context_free(&m_AVIOContext);
+    }
+
+    if(m_Source)
+        avio_closep(&m_Source);
+
+    if(m_MediaCache)
+    {
+        delete m_MediaCache;
+        m_MediaCache = nullptr;
+    }
+}
+
+void ReadAheadIO::Abort()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Abort = true;
+    m_DataCond.notify_all();
+    m_SpaceCond.notify_all();
+}
+
+void ReadAheadIO::SetWatermarks(int64_t lowBytes, int64_t highBytes)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(highBytes > 0)
+        m_HighWatermark = std::min(highBytes, m_Capacity - m_BackBufferSize);
+    if(lowBytes > 0)
+        m_LowWatermark = lowBytes;
+    m_LowWatermark = std::min(m_LowWatermark, m_HighWatermark);
+    m_SpaceCond.notify_all();
+}
+
+void ReadAheadIO::SetBitRate(int64_t bitRate)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_BitRate = bitRate;
+}
+
+int64_t ReadAheadIO::GetBufferedBytes()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    return m_WindowEnd - m_ReadOffset;
+}
+
+int64_t ReadAheadIO::GetBufferedDuration()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_BitRate <= 0)
+        return -1;
+    return (m_WindowEnd - m_ReadOffset) * 8 * 1000 / m_BitRate;
+}
+
+bool ReadAheadIO::NeedFill()
+{
+    int64_t unread = m_WindowEnd - m_ReadOffset;
+    if(m_Filling && unread >= m_HighWatermark)
+        m_Filling = false;
+    else if(!m_Filling && unread < m_LowWatermark)
+        m_Filling = true;
+    return m_Filling && GetWritableSize() > 0;
+}
+
+int64_t ReadAheadIO::GetWritableSize()
+{
+    //不能覆盖未读数据和保留的已读数据
+    int64_t writable = m_Capacity - m_BackBufferSize - (m_WindowEnd - m_ReadOffset);
+    return writable > 0 ? writable : 0;
+}
+
+void ReadAheadIO::WriteRing(const uint8_t *data, int size)
+{
+    int64_t ringPos = m_WindowEnd % m_Capacity;
+    int64_t firstPart = std::min<int64_t>(size, m_Capacity - ringPos);
+    memcpy(&m_Ring[ringPos], data, firstPart);
+    if(firstPart < size)
+        memcpy(&m_Ring[0], data + firstPart, size - firstPart);
+
+    m_WindowEnd += size;
+    if(m_WindowEnd - m_WindowStart > m_Capacity)
+        m_WindowStart = m_WindowEnd - m_Capacity;
+}
+
+int ReadAheadIO::ReadRing(uint8_t *buffer, int size)
+{
+    int64_t length = std::min<int64_t>(size, m_WindowEnd - m_ReadOffset);
+    int64_t ringPos = m_ReadOffset % m_Capacity;
+    int64_t firstPart = std::min<int64_t>(length, m_Capacity - ringPos);
+    memcpy(buffer, &m_Ring[ringPos], firstPart);
+    if(firstPart < length)
+        memcpy(buffer + firstPart, &m_Ring[0], length - firstPart);
+
+    m_ReadOffset += length;
+    return static_cast<int>(length);
+}
+
+void ReadAheadIO::ReadingLoop()
+{
+    std::vector<uint8_t> chunk(READ_AHEAD_CHUNK_SIZE);
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for(;;)
+    {
+        while (!m_Abort && !m_SeekRequest && (m_EOF || m_Error < 0 || !NeedFill()))
+        {
+            m_SpaceCond.wait(lock);
+        }
+
+        if(m_Abort)
+            break;
+
+        if(m_SeekRequest)
+        {
+            int64_t target = m_SeekTarget;
+            lock.unlock();
+            int64_t ret = SeekSource(target);
+            lock.lock();
+            if(ret >= 0)
+            {
+                m_WindowStart = m_WindowEnd = m_ReadOffset = target;
+                m_EOF = false;
+                m_Error = 0;
+                m_Reconnect = false;
+                m_RetryCount = 0;
+                m_Filling = true;
+            }
+            LOGCATE("ReadAheadIO::ReadingLoop seek target=%lld, ret=%lld", (long long)target, (long long)ret);
+            m_SeekResult = ret;
+            m_SeekRequest = false;
+            m_DataCond.notify_all();
+            continue;
+        }
+
+        if(m_Reconnect)
+        {
+            Reconnect(lock);
+            continue;
+        }
+
+        int size = static_cast<int>(std::min<int64_t>(READ_AHEAD_CHUNK_SIZE, GetWritableSize()));
+        lock.unlock();
+        //在锁外读取源, 读者可以继续消费环中已有的数据
+        int ret = ReadSource(&chunk[0], size);
+        lock.lock();
+
+        //读取期间收到了 seek 请求, 数据已经失效
+        if(m_SeekRequest)
+            continue;
+
+        if(ret > 0)
+        {
+            WriteRing(&chunk[0], ret);
+            m_RetryCount = 0;
+        }
+        else if(ret == AVERROR_EOF || ret == 0)
+        {
+            m_EOF = true;
+        }
+        else
+        {
+            LOGCATE("ReadAheadIO::ReadingLoop avio_read error=%d", ret);
+            OnReadError(ret);
+        }
+        m_DataCond.notify_all();
+    }
+}
+
+void ReadAheadIO::Reconnect(std::unique_lock<std::mutex> &lock)
+{
+    int64_t delay = (int64_t)READ_AHEAD_RETRY_DELAY << (m_RetryCount - 1);
+    m_SpaceCond.wait_for(lock, std::chrono::milliseconds(delay), [this]{ return m_Abort || m_SeekRequest; });
+    //seek 会重新请求源, 不需要再重连
+    if(m_Abort || m_SeekRequest)
+        return;
+
+    int64_t position = m_WindowEnd;
+    lock.unlock();
+    int64_t ret = ReconnectSource(position);
+    lock.lock();
+    if(m_SeekRequest)
+        return;
+
+    LOGCATE("ReadAheadIO::Reconnect position=%lld, retry=%d, ret=%lld", (long long)position, m_RetryCount, (long long)ret);
+    if(ret >= 0)
+        m_Reconnect = false;
+    else
+        OnReadError(static_cast<int>(ret));
+    m_DataCond.notify_all();
+}
+
+void ReadAheadIO::OnReadError(int error)
+{
+    //被中断, 或者源不能从断开的位置继续读取, 直接返回错误
+    if(error == AVERROR_EXIT || !m_Seekable || m_RetryCount >= READ_AHEAD_MAX_RETRIES)
+    {
+        m_Error = error;
+        m_Reconnect = false;
+        return;
+    }
+    m_RetryCount++;
+    m_Reconnect = true;
+}
+
+int ReadAheadIO::OpenSource()
+{
+    AVDictionary *options = nullptr;
+    //网络读写超时, us
+    av_dict_set(&options, "rw_timeout", "20000000", 0);
+    int result = avio_open2(&m_Source, m_Url, AVIO_FLAG_READ, &m_InterruptCallback, &options);
+    av_dict_free(&options);
+    return result;
+}
+
+int ReadAheadIO::ReadSource(uint8_t *buffer, int size)
+{
+    if(m_MediaCache)
+        return m_MediaCache->Read(buffer, size);
+
+    //出错时 avio 也会标记 eof, 只有真正读到结尾才返回 AVERROR_EOF, 其他错误需要重试
+    int ret = avio_read(m_Source, buffer, size);
+    if(ret == 0)
+        return AVERROR_EOF;
+    return ret;
+}
+
+int64_t ReadAheadIO::SeekSource(int64_t position)
+{
+    if(m_MediaCache)
+        return m_MediaCache->Seek(position);
+
+    return avio_seek(m_Source, position, SEEK_SET);
+}
+
+int64_t ReadAheadIO::ReconnectSource(int64_t position)
+{
+    //磁盘缓存读取出错时已经关闭了网络连接, 下次读取时重新连接
+    if(m_MediaCache)
+        return m_MediaCache->Seek(position);
+
+    //avio 的缓冲区还覆盖 position 时 avio_seek 不会重新请求, 需要重新打开
+    if(m_Source)
+        avio_closep(&m_Source);
+    int result = OpenSource();
+    if(result < 0)
+        return result;
+    return position > 0 ? avio_seek(m_Source, position, SEEK_SET) : 0;
+}
+
+int ReadAheadIO::ReadPacket(void *opaque, uint8_t *buffer, int bufferSize)
+{
+    ReadAheadIO *io = static_cast<ReadAheadIO *>(opaque);
+    std::unique_lock<std::mutex> lock(io->m_Mutex);
+    while (!io->m_Abort && io->m_WindowEnd == io->m_ReadOffset && !io->m_EOF && io->m_Error == 0)
+    {
+        //读空时立即恢复填充, 不等待低水位
+        io->m_Filling = true;
+        io->m_SpaceCond.notify_all();
+        io->m_DataCond.wait(lock);
+    }
+
+    if(io->m_Abort)
+        return AVERROR_EXIT;
+
+    if(io->m_WindowEnd == io->m_ReadOffset)
+        return io->m_Error < 0 ? io->m_Error : AVERROR_EOF;
+
+    int size = io->ReadRing(buffer, bufferSize);
+    io->m_SpaceCond.notify_all();
+    return size;
+}
+
+int64_t ReadAheadIO::Seek(void *opaque, int64_t offset, int whence)
+{
+    ReadAheadIO *io = static_cast<ReadAheadIO *>(opaque);
+    if(whence & AVSEEK_SIZE)
+        return io->m_FileSize >= 0 ? io->m_FileSize : AVERROR(ENOSYS);
+
+    std::unique_lock<std::mutex> lock(io->m_Mutex);
+    int64_t target = -1;
+    switch (whence & ~AVSEEK_FORCE)
+    {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = io->m_ReadOffset + offset;
+            break;
+        case SEEK_END:
+            if(io->m_FileSize >= 0)
+                target = io->m_FileSize + offset;
+            break;
+        default:
+            break;
+    }
+
+    if(target < 0)
+        return AVERROR(EINVAL);
+
+    //窗口内的 seek 只移动读位置
+    if(target >= io->m_WindowStart && target <= io->m_WindowEnd)
+    {
+        io->m_ReadOffset = target;
+        io->m_SpaceCond.notify_all();
+        return target;
+    }
+
+    io->m_SeekTarget = target;
+    io->m_SeekRequest = true;
+    io->m_SpaceCond.notify_all();
+    while (!io->m_Abort && io->m_SeekRequest)
+    {
+        io->m_DataCond.wait(lock);
+    }
+
+    if(io->m_Abort)
+        return AVERROR_EXIT;
+    return io->m_SeekResult;
+}
+
+void ReadAheadIO::DoReading(ReadAheadIO *io)
+{
+    io->ReadingLoop();
+}
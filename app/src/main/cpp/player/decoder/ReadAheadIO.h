@@ -0,0 +1,123 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_READAHEADIO_H
+#define FFMPEGEXERCISE_READAHEADIO_H
+
+extern "C"{
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+};
+
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "MediaCache.h"
+
+#define READ_AHEAD_DEFAULT_BUFFER_SIZE (16 * 1024 * 1024)
+//交给 libavformat 的 AVIOContext 缓冲区
+#define READ_AHEAD_AVIO_BUFFER_SIZE    (32 * 1024)
+//I/O 线程每次从源读取的大小
+#define READ_AHEAD_CHUNK_SIZE          (64 * 1024)
+//读取出错后从断开的位置重新请求, 间隔从 READ_AHEAD_RETRY_DELAY 开始倍增, 超过次数后才把错误返回给解复用器
+#define READ_AHEAD_MAX_RETRIES         5
+#define READ_AHEAD_RETRY_DELAY         200 //ms
+
+//环形缓冲区支撑的 AVIOContext, 由独立的 I/O 线程预读, 网络或者慢速存储的卡顿不会直接阻塞解复用.
+//已经读过的一部分数据保留在环中, 容器解析时的小范围回退 seek 不需要重新请求源.
+class ReadAheadIO {
+public:
+    ReadAheadIO(const char *url, int bufferSize = READ_AHEAD_DEFAULT_BUFFER_SIZE);
+    ~ReadAheadIO();
+
+    //只有通过 avio 读取的协议才能使用自定义 AVIOContext, rtsp 等由解复用器自己管理连接
+    static bool IsSupported(const char *url);
+
+    //interruptCallback 用于中断阻塞在源上的读取
+    int Open(const AVIOInterruptCB *interruptCallback);
+    void Close();
+
+    //唤醒阻塞在读取和 seek 上的线程, 之后的读取都返回 AVERROR_EXIT
+    void Abort();
+
+    AVIOContext *GetAVIOContext()
+    {
+        return m_AVIOContext;
+    }
+
+    //未读数据低于 lowBytes 时开始填充, 达到 highBytes 后暂停, 减少网络唤醒次数. <=0 保持默认值
+    void SetWatermarks(int64_t lowBytes, int64_t highBytes);
+
+    //用于把缓冲的字节数换算成时长, bit/s
+    void SetBitRate(int64_t bitRate);
+
+    int64_t GetBufferedBytes();
+
+    //ms, 码率未知时返回 -1
+    int64_t GetBufferedDuration();
+
+private:
+    void ReadingLoop();
+    //退避之后从 m_WindowEnd 重新请求源, 调用时持有 lock
+    void Reconnect(std::unique_lock<std::mutex> &lock);
+    void OnReadError(int error);
+    //源为磁盘缓存或者 avio
+    int OpenSource();
+    int ReadSource(uint8_t *buffer, int size);
+    int64_t SeekSource(int64_t position);
+    //连接断开后从 position 重新请求源
+    int64_t ReconnectSource(int64_t position);
+    bool NeedFill();
+    int64_t GetWritableSize();
+    void WriteRing(const uint8_t *data, int size);
+    int ReadRing(uint8_t *buffer, int size);
+
+    static int ReadPacket(void *opaque, uint8_t *buffer, int bufferSize);
+    static int64_t Seek(void *opaque, int64_t offset, int whence);
+    static void DoReading(ReadAheadIO *io);
+
+    char m_Url[2048] = {0};
+
+    AVIOInterruptCB m_InterruptCallback = {nullptr, nullptr};
+    AVIOContext *m_Source = nullptr;
+    //http(s) 经过磁盘缓存读取
+    MediaCache *m_MediaCache = nullptr;
+    AVIOContext *m_AVIOContext = nullptr;
+    int64_t m_FileSize = -1;
+    bool m_Seekable = false;
+    int64_t m_BitRate = 0;
+
+    std::vector<uint8_t> m_Ring;
+    int64_t m_Capacity = 0;
+    //保留在环中的已读数据, 用于小范围回退 seek
+    int64_t m_BackBufferSize = 0;
+    //环中数据对应的文件区间 [m_WindowStart, m_WindowEnd), m_ReadOffset 为读位置
+    int64_t m_WindowStart = 0;
+    int64_t m_WindowEnd = 0;
+    int64_t m_ReadOffset = 0;
+
+    int64_t m_LowWatermark = 0;
+    int64_t m_HighWatermark = 0;
+    bool m_Filling = true;
+
+    bool m_EOF = false;
+    int m_Error = 0;
+    //出错后等待重新请求源, 读者继续等待数据而不是收到错误
+    bool m_Reconnect = false;
+    int m_RetryCount = 0;
+    bool m_Abort = false;
+
+    //超出窗口的 seek 由 I/O 线程执行
+    bool m_SeekRequest = false;
+    int64_t m_SeekTarget = 0;
+    int64_t m_SeekResult = 0;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_DataCond;  //读者等待数据
+    std::condition_variable m_SpaceCond; //I/O 线程等待空间或者 seek 请求
+    std::thread *m_Thread = nullptr;
+};
+
+#endif //FFMPEGEXERCISE_READAHEADIO_H
@@ -0,0 +1,339 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "SliceConverter.h"
+#include "YuvConverter.h"
+#include "ImageDef.h"
+
+//按 row 偏移每个平面的起始地址, 色度平面按格式的垂直下采样换算行数
+static void OffsetPlanes(AVPixelFormat format, uint8_t *const src[], const int lineSize[], int row, uint8_t *dst[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    for (int i = 0; i < 4; ++i) {
+        if(src[i] == nullptr) {
+            dst[i] = nullptr;
+            continue;
+        }
+        //调色板格式的平面 1 是调色板, 不偏移
+        if(desc != nullptr && (desc->flags & AV_PIX_FMT_FLAG_PAL) && i == 1) {
+            dst[i] = src[i];
+            continue;
+        }
+        int planeRow = row;
+        //平面 1, 2 为色度, 平面 0, 3 与亮度同尺寸
+        if(desc != nullptr && (i == 1 || i == 2))
+            planeRow = row >> desc->log2_chroma_h;
+        dst[i] = src[i] + planeRow * lineSize[i];
+    }
+}
+
+SliceConverter::SliceConverter(int swsFlags, int threadCount)
+{
+    m_SwsFlags = swsFlags;
+    if(threadCount <= 0)
+        threadCount = std::thread::hardware_concurrency();
+    m_ThreadCount = threadCount < 1 ? 1 : (threadCount > MAX_CONVERT_THREADS ? MAX_CONVERT_THREADS : threadCount);
+    LOGCATE("SliceConverter::SliceConverter m_ThreadCount=%d", m_ThreadCount);
+}
+
+void SliceConverter::StartWorkers()
+{
+    if(m_WorkersStarted)
+        return;
+
+    //条带 0 在调用线程上转换
+    for (int i = 1; i < m_ThreadCount; ++i) {
+        m_Workers[i] = new std::thread(DoWork, this, i);
+    }
+    m_WorkersStarted = true;
+    LOGCATE("SliceConverter::StartWorkers workerCount=%d", m_ThreadCount - 1);
+}
+
+SliceConverter::~SliceConverter()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+        m_JobCond.notify_all();
+    }
+    for (int i = 1; i < m_ThreadCount && m_WorkersStarted; ++i) {
+        m_Workers[i]->join();
+        delete m_Workers[i];
+        m_Workers[i] = nullptr;
+    }
+    Clear();
+}
+
+void SliceConverter::Clear()
+{
+    for (int i = 0; i < m_ContextCount; ++i) {
+        ReleaseContext(&m_Contexts[i]);
+    }
+    m_ContextCount = 0;
+}
+
+SliceConverter::ConvertContext *SliceConverter::GetContext(const ConvertKey &key)
+{
+    m_UseCount++;
+    for (int i = 0; i < m_ContextCount; ++i) {
+        if(m_Contexts[i].key == key) {
+            m_Contexts[i].lastUsed = m_UseCount;
+            return &m_Contexts[i];
+        }
+    }
+
+    ConvertContext *context = nullptr;
+    if(m_ContextCount < MAX_CONVERT_CONTEXTS) {
+        context = &m_Contexts[m_ContextCount++];
+    } else {
+        context = &m_Contexts[0];
+        for (int i = 1; i < m_ContextCount; ++i) {
+            if(m_Contexts[i].lastUsed < context->lastUsed)
+                context = &m_Contexts[i];
+        }
+        ReleaseContext(context);
+    }
+
+    if(!InitContext(context, key)) {
+        //失败的上下文不保留, 把最后一个移到空出的位置
+        ReleaseContext(context);
+        *context = m_Contexts[--m_ContextCount];
+        return nullptr;
+    }
+    context->lastUsed = m_UseCount;
+    return context;
+}
+
+bool SliceConverter::InitContext(ConvertContext *context, const ConvertKey &key)
+{
+    context->key = key;
+    context->bandCount = 0;
+    context->swsBanded = false;
+    context->whole.swsContext = nullptr;
+
+    const AVPixFmtDescriptor *srcDesc = av_pix_fmt_desc_get(key.srcFormat);
+    const AVPixFmtDescriptor *dstDesc = av_pix_fmt_desc_get(key.dstFormat);
+    if(srcDesc == nullptr || dstDesc == nullptr || key.srcHeight <= 0 || key.dstHeight <= 0)
+        return false;
+
+    context->whole.srcY = 0;
+    context->whole.srcHeight = key.srcHeight;
+    context->whole.dstY = 0;
+    context->whole.dstHeight = key.dstHeight;
+
+    //垂直方向缩放时整帧转换, 不拆分条带
+    int bandCount = 1;
+    if(key.srcHeight == key.dstHeight) {
+        bandCount = m_ThreadCount;
+        if(key.dstHeight / MIN_CONVERT_BAND_HEIGHT < bandCount)
+            bandCount = key.dstHeight / MIN_CONVERT_BAND_HEIGHT > 0 ? key.dstHeight / MIN_CONVERT_BAND_HEIGHT : 1;
+    }
+
+    //条带边界对齐到源和目标的色度行, 不缩放时两者的边界相同
+    int align = 1 << (srcDesc->log2_chroma_h > dstDesc->log2_chroma_h ? srcDesc->log2_chroma_h : dstDesc->log2_chroma_h);
+    int boundary[MAX_CONVERT_THREADS + 1];
+    for (int i = 0; i < bandCount; ++i) {
+        boundary[i] = key.dstHeight * i / bandCount / align * align;
+    }
+    boundary[bandCount] = key.dstHeight;
+
+    for (int i = 0; i < bandCount; ++i) {
+        Band &band = context->bands[i];
+        band.swsContext = nullptr;
+        band.srcY = boundary[i];
+        band.srcHeight = boundary[i + 1] - boundary[i];
+        band.dstY = boundary[i];
+        band.dstHeight = boundary[i + 1] - boundary[i];
+    }
+    context->bandCount = bandCount;
+    //垂直方向不缩放且没有色度下采样时, swscale 的垂直滤波只有一个抽头, 每行输出只取决于同一行输入
+    context->swsBanded = bandCount > 1 && srcDesc->log2_chroma_h == 0 && dstDesc->log2_chroma_h == 0;
+
+    LOGCATE("SliceConverter::InitContext [%d, %d, %d] -> [%d, %d, %d], bandCount=%d, swsBanded=%d, contextCount=%d",
+            key.srcWidth, key.srcHeight, key.srcFormat, key.dstWidth, key.dstHeight, key.dstFormat,
+            bandCount, context->swsBanded, m_ContextCount);
+    return true;
+}
+
+bool SliceConverter::PrepareSwsContexts(ConvertContext *context)
+{
+    const ConvertKey &key = context->key;
+    if(!context->swsBanded) {
+        if(context->whole.swsContext == nullptr)
+            context->whole.swsContext = sws_getContext(key.srcWidth, key.srcHeight, key.srcFormat,
+                                                       key.dstWidth, key.dstHeight, key.dstFormat,
+                                                       m_SwsFlags, NULL, NULL, NULL);
+        if(context->whole.swsContext == nullptr) {
+            LOGCATE("SliceConverter::PrepareSwsContexts sws_getContext fail");
+            return false;
+        }
+        return true;
+    }
+
+    for (int i = 0; i < context->bandCount; ++i) {
+        Band &band = context->bands[i];
+        if(band.swsContext == nullptr)
+            band.swsContext = sws_getContext(key.srcWidth, band.srcHeight, key.srcFormat,
+                                             key.dstWidth, band.dstHeight, key.dstFormat,
+                                             m_SwsFlags, NULL, NULL, NULL);
+        if(band.swsContext == nullptr) {
+            LOGCATE("SliceConverter::PrepareSwsContexts sws_getContext fail, band=%d", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void SliceConverter::ReleaseContext(ConvertContext *context)
+{
+    for (int i = 0; i < context->bandCount; ++i) {
+        if(context->bands[i].swsContext != nullptr) {
+            sws_freeContext(context->bands[i].swsContext);
+            context->bands[i].swsContext = nullptr;
+        }
+    }
+    if(context->whole.swsContext != nullptr) {
+        sws_freeContext(context->whole.swsContext);
+        context->whole.swsContext = nullptr;
+    }
+    context->bandCount = 0;
+}
+
+int SliceConverter::Convert(AVFrame *frame, int dstWidth, int dstHeight, AVPixelFormat dstFormat,
+                            uint8_t *const dst[], const int dstLineSize[], int flags)
+{
+    if(frame == nullptr || frame->data[0] == nullptr)
+        return -1;
+
+    ConvertKey key;
+    key.srcWidth = frame->width;
+    key.srcHeight = frame->height;
+    key.srcFormat = static_cast<AVPixelFormat>(frame->format);
+    key.dstWidth = dstWidth;
+    key.dstHeight = dstHeight;
+    key.dstFormat = dstFormat;
+    ConvertContext *context = GetContext(key);
+    if(context == nullptr)
+        return -1;
+
+    Job job;
+    job.frame = frame;
+    job.key = &context->key;
+    job.bands = context->bands;
+    job.dst = dst;
+    job.dstLineSize = dstLineSize;
+    job.yuvFormat = (flags & CONVERT_FLAG_NO_SIMD) ? 0 : GetYuvFormat(frame, key);
+    int bandCount = context->bandCount;
+    if(job.yuvFormat == 0) {
+        if(!PrepareSwsContexts(context))
+            return -1;
+        if(!context->swsBanded) {
+            job.bands = &context->whole;
+            bandCount = 1;
+        }
+    }
+    m_BandCount = bandCount;
+    //未标明矩阵时按分辨率推断, 高清内容通常为 BT.709
+    job.colorSpace = YUV_COLOR_SPACE_BT601;
+    if(frame->colorspace == AVCOL_SPC_BT709 || (frame->colorspace == AVCOL_SPC_UNSPECIFIED && frame->height >= 720))
+        job.colorSpace = YUV_COLOR_SPACE_BT709;
+    job.colorRange = YUV_COLOR_RANGE_LIMITED;
+    if(frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P)
+        job.colorRange = YUV_COLOR_RANGE_FULL;
+
+    if(bandCount == 1 || m_ThreadCount == 1 || (flags & CONVERT_FLAG_SINGLE_THREAD)) {
+        for (int i = 0; i < bandCount; ++i) {
+            ConvertBand(i, job);
+        }
+        return job.yuvFormat != 0 ? 1 : 0;
+    }
+
+    StartWorkers();
+
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Job = job;
+        m_JobBandCount = bandCount;
+        m_PendingCount = bandCount - 1;
+        m_JobSeq++;
+        m_JobCond.notify_all();
+    }
+
+    ConvertBand(0, job);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (m_PendingCount > 0) {
+        m_DoneCond.wait(lock);
+    }
+    return job.yuvFormat != 0 ? 1 : 0;
+}
+
+void SliceConverter::ConvertBand(int index, const Job &job)
+{
+    const ConvertKey &key = *job.key;
+    const Band &band = job.bands[index];
+    uint8_t *src[4];
+    uint8_t *dst[4];
+    OffsetPlanes(key.srcFormat, job.frame->data, job.frame->linesize, band.srcY, src);
+    OffsetPlanes(key.dstFormat, job.dst, job.dstLineSize, band.dstY, dst);
+
+    if(job.yuvFormat != 0) {
+        YuvConverter::ConvertToRgba(job.yuvFormat, src, job.frame->linesize, key.srcWidth, band.srcHeight,
+                                    job.colorSpace, job.colorRange, dst[0], job.dstLineSize[0]);
+        return;
+    }
+
+    sws_scale(band.swsContext, src, job.frame->linesize, 0, band.srcHeight, dst, job.dstLineSize);
+}
+
+int SliceConverter::GetYuvFormat(AVFrame *frame, const ConvertKey &key)
+{
+    if(key.dstFormat != AV_PIX_FMT_RGBA || key.srcWidth != key.dstWidth || key.srcHeight != key.dstHeight)
+        return 0;
+
+    switch (key.srcFormat) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            //与 VideoDecoder::OnFrameAvailable 相同, 兼容部分设备 mediacodec 输出 NV12 的情况
+            if(frame->data[1] && !frame->data[2] && frame->linesize[2] == 0)
+                return IMAGE_FORMAT_NV12;
+            return frame->data[2] != nullptr ? IMAGE_FORMAT_I420 : 0;
+        case AV_PIX_FMT_NV12:
+            return IMAGE_FORMAT_NV12;
+        case AV_PIX_FMT_NV21:
+            return IMAGE_FORMAT_NV21;
+        default:
+            return 0;
+    }
+}
+
+void SliceConverter::DoWork(SliceConverter *converter, int index)
+{
+    converter->WorkLoop(index);
+}
+
+void SliceConverter::WorkLoop(int index)
+{
+    int jobSeq = 0;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true) {
+        while (!m_Exit && m_JobSeq == jobSeq) {
+            m_JobCond.wait(lock);
+        }
+        if(m_Exit)
+            break;
+
+        jobSeq = m_JobSeq;
+        if(index >= m_JobBandCount)
+            continue;
+
+        Job job = m_Job;
+        lock.unlock();
+        ConvertBand(index, job);
+        lock.lock();
+
+        if(--m_PendingCount == 0)
+            m_DoneCond.notify_all();
+    }
+}
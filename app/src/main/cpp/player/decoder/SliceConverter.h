@@ -0,0 +1,149 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_SLICECONVERTER_H
+#define FFMPEGEXERCISE_SLICECONVERTER_H
+
+extern "C"{
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+};
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//最多使用的转换线程数(包括调用线程), 解码线程也需要 CPU
+#define MAX_CONVERT_THREADS     4
+//目标图像每个条带至少多少行, 小图像不值得拆分
+#define MIN_CONVERT_BAND_HEIGHT 64
+
+//Convert 的 flags, 用于对比测试
+#define CONVERT_FLAG_SINGLE_THREAD 0x01 //所有条带在调用线程上顺序转换
+#define CONVERT_FLAG_NO_SIMD       0x02 //不使用 YuvConverter, 全部由 swscale 转换
+
+//每个 SliceConverter 缓存的转换上下文个数, 超过时淘汰最久没有使用的
+#define MAX_CONVERT_CONTEXTS    4
+
+//把一帧按水平条带拆分, 在工作线程池上并行转换.
+//FFmpeg 4.2 的 swscale 不支持 slice 多线程, 各个条带独立转换时垂直方向的滤波在条带边界处取不到相邻条带的行,
+//缩放时会在边界上产生接缝. 所以只有每一行的输出只取决于同一行输入的转换才拆分条带:
+//不缩放的 I420/NV12/NV21 -> RGBA 使用 YuvConverter, 色度按行取样;
+//swscale 只在垂直方向不缩放、源和目标都没有垂直色度下采样时每个条带使用独立的 SwsContext, 其他情况整帧转换.
+//转换上下文按 (源尺寸, 源格式, 目标尺寸, 目标格式) 缓存, 码流中途改变分辨率时
+//只创建新的上下文, 自适应码流在几档分辨率之间切换时不再重复创建, 内存占用有上限.
+//工作线程在第一次需要拆分条带时才创建, 只走 GL 直接渲染 YUV 纹理的播放不会创建线程
+class SliceConverter
+{
+public:
+    //threadCount 为 0 时按 CPU 核数选择, 线程在第一次需要时创建
+    SliceConverter(int swsFlags, int threadCount = 0);
+    ~SliceConverter();
+
+    //按 frame 的尺寸和格式转换到目标图像, 所有条带完成之后返回.
+    //返回 <0 表示失败, 0 表示使用 swscale, 1 表示使用了 YuvConverter
+    int Convert(AVFrame *frame, int dstWidth, int dstHeight, AVPixelFormat dstFormat,
+                 uint8_t *const dst[], const int dstLineSize[], int flags = 0);
+
+    //释放所有缓存的转换上下文
+    void Clear();
+
+    //最近一次转换使用的条带数
+    int GetBandCount()
+    {
+        return m_BandCount;
+    }
+
+private:
+    struct Band
+    {
+        SwsContext *swsContext;
+        int srcY;
+        int srcHeight;
+        int dstY;
+        int dstHeight;
+    };
+
+    struct ConvertKey
+    {
+        int srcWidth;
+        int srcHeight;
+        AVPixelFormat srcFormat;
+        int dstWidth;
+        int dstHeight;
+        AVPixelFormat dstFormat;
+
+        bool operator==(const ConvertKey &other) const
+        {
+            return srcWidth == other.srcWidth && srcHeight == other.srcHeight && srcFormat == other.srcFormat &&
+                   dstWidth == other.dstWidth && dstHeight == other.dstHeight && dstFormat == other.dstFormat;
+        }
+    };
+
+    //一组尺寸和格式对应的所有条带. 条带的 SwsContext 和整帧的 SwsContext 都在第一次用到 swscale 时创建
+    struct ConvertContext
+    {
+        ConvertKey key;
+        Band bands[MAX_CONVERT_THREADS];
+        int bandCount;
+        //swscale 可以按条带转换而没有接缝
+        bool swsBanded;
+        //swscale 不能按条带转换时使用的整帧上下文
+        Band whole;
+        int64_t lastUsed;
+    };
+
+    //一次 Convert 的参数, 由所有条带共享
+    struct Job
+    {
+        AVFrame *frame;
+        const ConvertKey *key;
+        const Band *bands;
+        uint8_t *const *dst;
+        const int *dstLineSize;
+        int yuvFormat;   //0 表示使用 swscale
+        int colorSpace;
+        int colorRange;
+    };
+
+    //查找或者创建 key 对应的上下文, 缓存已满时替换最久没有使用的, 失败返回 nullptr
+    ConvertContext *GetContext(const ConvertKey &key);
+    bool InitContext(ConvertContext *context, const ConvertKey &key);
+    //创建 swscale 转换需要的 SwsContext, 失败返回 false
+    bool PrepareSwsContexts(ConvertContext *context);
+    static void ReleaseContext(ConvertContext *context);
+    //按需创建工作线程, 只在调用 Convert 的线程上调用
+    void StartWorkers();
+
+    void ConvertBand(int index, const Job &job);
+    //不缩放且 YuvConverter 支持时返回 IMAGE_FORMAT_XXX, 否则返回 0
+    static int GetYuvFormat(AVFrame *frame, const ConvertKey &key);
+
+    static void DoWork(SliceConverter *converter, int index);
+    void WorkLoop(int index);
+
+    int m_SwsFlags = 0;
+    int m_ThreadCount = 1;
+    std::thread *m_Workers[MAX_CONVERT_THREADS] = {nullptr};
+    bool m_WorkersStarted = false;
+
+    //只在调用 Convert 的线程上访问
+    ConvertContext m_Contexts[MAX_CONVERT_CONTEXTS];
+    int m_ContextCount = 0;
+    int64_t m_UseCount = 0;
+    int m_BandCount = 0;
+
+    //m_JobSeq 增加表示有新的任务, 工作线程 i 转换条带 i, 调用线程转换条带 0
+    std::mutex m_Mutex;
+    std::condition_variable m_JobCond;
+    std::condition_variable m_DoneCond;
+    Job m_Job;
+    int m_JobSeq = 0;
+    int m_JobBandCount = 0;
+    int m_PendingCount = 0;
+    bool m_Exit = false;
+};
+
+#endif //FFMPEGEXERCISE_SLICECONVERTER_H
@@ -0,0 +1,222 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "StreamInfoCache.h"
+#include <stdio.h>
+#include <string.h>
+#include "CacheUtil.h"
+#include "LogUtil.h"
+
+struct StreamInfoCacheHeader
+{
+    char magic[4];
+    int32_t version;
+    int32_t streamCount;
+    int32_t reserved;
+    int64_t fileSize;
+    int64_t startTime;
+    int64_t duration;
+    int64_t bitRate;
+};
+
+static const char STREAM_INFO_CACHE_MAGIC[4] = {'S', 'I', 'C', 'H'};
+
+StreamInfoCache::StreamInfoCache(const char *url)
+{
+    //本地文件的 key 包含大小和修改时间, 网络文件在 Apply 时校验大小
+    if(!CacheUtil::GetFileCachePath(url, STREAM_INFO_CACHE_SUFFIX, m_Path, sizeof(m_Path)) &&
+       !CacheUtil::GetCachePath(url, STREAM_INFO_CACHE_SUFFIX, m_Path, sizeof(m_Path)))
+    {
+        m_Path[0] = '\0';
+    }
+}
+
+bool StreamInfoCache::Load()
+{
+    if(m_Path[0] == '\0')
+        return false;
+
+    FILE *file = fopen(m_Path, "rb");
+    if(file == nullptr)
+        return false;
+
+    do{
+        StreamInfoCacheHeader header;
+        if(fread(&header, sizeof(header), 1, file) != 1 ||
+           memcmp(header.magic, STREAM_INFO_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+           header.version != STREAM_INFO_CACHE_VERSION || header.streamCount <= 0)
+        {
+            break;
+        }
+
+        m_FileSize = header.fileSize;
+        m_StartTime = header.startTime;
+        m_Duration = header.duration;
+        m_BitRate = header.bitRate;
+        m_Streams.resize(header.streamCount);
+        m_Extradata.resize(header.streamCount);
+
+        bool success = true;
+        for (int i = 0; i < header.streamCount && success; ++i)
+        {
+            StreamInfo &info = m_Streams[i];
+            success = fread(&info, sizeof(info), 1, file) == 1 && info.extradataSize >= 0;
+            if(success && info.extradataSize > 0)
+            {
+                m_Extradata[i].resize(info.extradataSize);
+                success = fread(&m_Extradata[i][0], 1, m_Extradata[i].size(), file) == m_Extradata[i].size();
+            }
+        }
+        m_Valid = success;
+    }while (false);
+
+    fclose(file);
+    LOGCATE("StreamInfoCache::Load path=%s, valid=%d, streams=%d", m_Path, m_Valid, (int)m_Streams.size());
+    return m_Valid;
+}
+
+int StreamInfoCache::Apply(AVFormatContext *formatContext)
+{
+    if(!m_Valid || static_cast<size_t>(formatContext->nb_streams) != m_Streams.size())
+        return -1;
+
+    int64_t fileSize = GetInputSize(formatContext);
+    if(fileSize < 0 || fileSize != m_FileSize)
+    {
+        LOGCATE("StreamInfoCache::Apply size mismatch %lld != %lld", (long long)fileSize, (long long)m_FileSize);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i)
+    {
+        AVCodecParameters *codecpar = formatContext->streams[i]->codecpar;
+        if(codecpar->codec_type != m_Streams[i].codecType || codecpar->codec_id != m_Streams[i].codecId)
+        {
+            LOGCATE("StreamInfoCache::Apply stream %d mismatch", i);
+            return -1;
+        }
+    }
+
+    //只补全文件头中没有的参数
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i)
+    {
+        AVStream *stream = formatContext->streams[i];
+        AVCodecParameters *codecpar = stream->codecpar;
+        const StreamInfo &info = m_Streams[i];
+
+        if(codecpar->format < 0) codecpar->format = info.format;
+        if(codecpar->width <= 0) codecpar->width = info.width;
+        if(codecpar->height <= 0) codecpar->height = info.height;
+        if(codecpar->sample_rate <= 0) codecpar->sample_rate = info.sampleRate;
+        if(codecpar->channels <= 0) codecpar->channels = info.channels;
+        if(codecpar->channel_layout == 0) codecpar->channel_layout = info.channelLayout;
+        if(codecpar->bit_rate <= 0) codecpar->bit_rate = info.bitRate;
+        if(codecpar->profile == FF_PROFILE_UNKNOWN) codecpar->profile = info.profile;
+        if(codecpar->level == FF_LEVEL_UNKNOWN) codecpar->level = info.level;
+        if(codecpar->sample_aspect_ratio.num == 0)
+        {
+            codecpar->sample_aspect_ratio.num = info.sarNum;
+            codecpar->sample_aspect_ratio.den = info.sarDen;
+        }
+        if(stream->avg_frame_rate.num == 0)
+        {
+            stream->avg_frame_rate.num = info.frameRateNum;
+            stream->avg_frame_rate.den = info.frameRateDen;
+        }
+        if(stream->start_time == AV_NOPTS_VALUE) stream->start_time = info.startTime;
+        if(stream->duration == AV_NOPTS_VALUE) stream->duration = info.duration;
+
+        if(codecpar->extradata == nullptr && !m_Extradata[i].empty())
+        {
+            int size = static_cast<int>(m_Extradata[i].size());
+            codecpar->extradata = static_cast<uint8_t *>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+            if(codecpar->extradata == nullptr)
+                return AVERROR(ENOMEM);
+            memcpy(codecpar->extradata, &m_Extradata[i][0], size);
+            codecpar->extradata_size = size;
+        }
+    }
+
+    if(formatContext->start_time == AV_NOPTS_VALUE) formatContext->start_time = m_StartTime;
+    if(formatContext->duration == AV_NOPTS_VALUE) formatContext->duration = m_Duration;
+    if(formatContext->bit_rate <= 0) formatContext->bit_rate = m_BitRate;
+    return 0;
+}
+
+int StreamInfoCache::Save(AVFormatContext *formatContext)
+{
+    if(m_Path[0] == '\0' || formatContext->nb_streams == 0)
+        return -1;
+
+    //大小未知时无法校验, 不缓存
+    int64_t fileSize = GetInputSize(formatContext);
+    if(fileSize < 0)
+        return -1;
+
+    char tmpPath[sizeof(m_Path) + 8] = {0};
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", m_Path);
+    FILE *file = fopen(tmpPath, "wb");
+    if(file == nullptr)
+        return -1;
+
+    StreamInfoCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_INFO_CACHE_MAGIC, sizeof(header.magic));
+    header.version = STREAM_INFO_CACHE_VERSION;
+    header.streamCount = formatContext->nb_streams;
+    header.fileSize = fileSize;
+    header.startTime = formatContext->start_time;
+    header.duration = formatContext->duration;
+    header.bitRate = formatContext->bit_rate;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (unsigned int i = 0; i < formatContext->nb_streams && success; ++i)
+    {
+        AVStream *stream = formatContext->streams[i];
+        AVCodecParameters *codecpar = stream->codecpar;
+
+        StreamInfo info;
+        memset(&info, 0, sizeof(info));
+        info.codecType = codecpar->codec_type;
+        info.codecId = codecpar->codec_id;
+        info.format = codecpar->format;
+        info.width = codecpar->width;
+        info.height = codecpar->height;
+        info.sampleRate = codecpar->sample_rate;
+        info.channels = codecpar->channels;
+        info.profile = codecpar->profile;
+        info.level = codecpar->level;
+        info.frameRateNum = stream->avg_frame_rate.num;
+        info.frameRateDen = stream->avg_frame_rate.den;
+        info.sarNum = codecpar->sample_aspect_ratio.num;
+        info.sarDen = codecpar->sample_aspect_ratio.den;
+        info.extradataSize = codecpar->extradata != nullptr ? codecpar->extradata_size : 0;
+        info.channelLayout = codecpar->channel_layout;
+        info.bitRate = codecpar->bit_rate;
+        info.startTime = stream->start_time;
+        info.duration = stream->duration;
+
+        success = fwrite(&info, sizeof(info), 1, file) == 1;
+        if(success && info.extradataSize > 0)
+            success = fwrite(codecpar->extradata, 1, codecpar->extradata_size, file) == static_cast<size_t>(codecpar->extradata_size);
+    }
+    success = fclose(file) == 0 && success;
+
+    if(!success || rename(tmpPath, m_Path) != 0)
+    {
+        remove(tmpPath);
+        return -1;
+    }
+
+    LOGCATE("StreamInfoCache::Save path=%s, streams=%d", m_Path, header.streamCount);
+    return 0;
+}
+
+int64_t StreamInfoCache::GetInputSize(AVFormatContext *formatContext)
+{
+    if(formatContext->pb == nullptr)
+        return -1;
+    int64_t size = avio_size(formatContext->pb);
+    return size >= 0 ? size : -1;
+}
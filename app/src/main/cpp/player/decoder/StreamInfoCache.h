@@ -0,0 +1,73 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_STREAMINFOCACHE_H
+#define FFMPEGEXERCISE_STREAMINFOCACHE_H
+
+extern "C"{
+#include <libavformat/avformat.h>
+};
+
+#include <vector>
+
+#define STREAM_INFO_CACHE_SUFFIX  ".sic"
+#define STREAM_INFO_CACHE_VERSION 3
+#define STREAM_INFO_CACHE_MAX_URL 2048
+//命中缓存时的探测参数, 只需要读到能解析文件头即可
+#define STREAM_INFO_CACHE_PROBE_SIZE       (64 * 1024)
+#define STREAM_INFO_CACHE_ANALYZE_DURATION (500 * 1000) //us
+
+//avformat_find_stream_info 探测得到的流参数, 按 url(本地文件加上大小和修改时间) 缓存,
+//再次打开时直接填入 AVCodecParameters, 跳过解码探测.
+//网络文件用已经打开的输入报告的大小校验, 不额外发起请求; 大小未知时不缓存.
+//大小相同但内容被替换时, 文件头解析出的流数量和 codec 与缓存不一致也会重新探测
+class StreamInfoCache {
+public:
+    StreamInfoCache(const char *url);
+
+    //缓存文件存在并且格式正确时返回 true
+    bool Load();
+
+    //流的数量和 codec 与缓存一致时补全参数并返回 0, 否则需要调用 avformat_find_stream_info
+    int Apply(AVFormatContext *formatContext);
+
+    int Save(AVFormatContext *formatContext);
+
+private:
+    struct StreamInfo
+    {
+        int32_t codecType;
+        int32_t codecId;
+        int32_t format;
+        int32_t width;
+        int32_t height;
+        int32_t sampleRate;
+        int32_t channels;
+        int32_t profile;
+        int32_t level;
+        int32_t frameRateNum;
+        int32_t frameRateDen;
+        int32_t sarNum;
+        int32_t sarDen;
+        int32_t extradataSize;
+        int64_t channelLayout;
+        int64_t bitRate;
+        int64_t startTime;
+        int64_t duration;
+    };
+
+    static int64_t GetInputSize(AVFormatContext *formatContext);
+
+    char m_Path[1024] = {0};
+    bool m_Valid = false;
+
+    int64_t m_FileSize = -1;
+    int64_t m_StartTime = AV_NOPTS_VALUE;
+    int64_t m_Duration = AV_NOPTS_VALUE;
+    int64_t m_BitRate = 0;
+    std::vector<StreamInfo> m_Streams;
+    std::vector<std::vector<uint8_t> > m_Extradata;
+};
+
+#endif //FFMPEGEXERCISE_STREAMINFOCACHE_H
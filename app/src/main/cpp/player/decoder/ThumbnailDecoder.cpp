@@ -0,0 +1,274 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "ThumbnailDecoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/resource.h>
+#include "LogUtil.h"
+
+ThumbnailDecoder::ThumbnailDecoder(const char *url) : m_Cache(THUMBNAIL_CACHE_CAPACITY)
+{
+    strncpy(m_Url, url, THUMBNAIL_MAX_URL - 1);
+}
+
+ThumbnailDecoder::~ThumbnailDecoder()
+{
+    Stop();
+    if(m_Thread)
+    {
+        m_Thread->join();
+        delete m_Thread;
+        m_Thread = nullptr;
+    }
+    m_Cache.Clear();
+}
+
+void ThumbnailDecoder::Start()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if(m_Thread == nullptr && !m_Stop)
+    {
+        m_Thread = new std::thread(DoThumbnailDecoding, this);
+    }
+}
+
+void ThumbnailDecoder::Stop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+    m_Cond.notify_all();
+}
+
+bool ThumbnailDecoder::GetThumbnail(long timestamp, Thumbnail &thumbnail)
+{
+    bool hit = m_Cache.Get(timestamp, THUMBNAIL_MAX_DISTANCE, thumbnail);
+    long distance = hit ? labs(thumbnail.timestamp - timestamp) : THUMBNAIL_MAX_DISTANCE;
+    if(!hit || distance > m_SweepInterval)
+    {
+        //只保留最新的查询, 拖动时不会堆积请求
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_RequestTimeStamp = timestamp;
+        m_Cond.notify_all();
+    }
+    return hit;
+}
+
+int ThumbnailDecoder::OpenDecoder()
+{
+    int result = -1;
+    do{
+        m_AVFormatContext = avformat_alloc_context();
+        m_AVFormatContext->interrupt_callback.callback = InterruptCallback;
+        m_AVFormatContext->interrupt_callback.opaque = this;
+
+        if(avformat_open_input(&m_AVFormatContext, m_Url, NULL, NULL) != 0)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder avformat_open_input fail.");
+            m_AVFormatContext = nullptr;
+            break;
+        }
+
+        if(avformat_find_stream_info(m_AVFormatContext, NULL) < 0)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder avformat_find_stream_info fail.");
+            break;
+        }
+
+        m_StreamIndex = av_find_best_stream(m_AVFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if(m_StreamIndex < 0)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder Fail to find video stream.");
+            break;
+        }
+
+        for (unsigned int i = 0; i < m_AVFormatContext->nb_streams; ++i)
+        {
+            if(static_cast<int>(i) != m_StreamIndex)
+                m_AVFormatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+        m_AVStream = m_AVFormatContext->streams[m_StreamIndex];
+
+        AVCodec *codec = avcodec_find_decoder(m_AVStream->codecpar->codec_id);
+        if(codec == nullptr)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder avcodec_find_decoder fail.");
+            break;
+        }
+
+        m_AVCodecContext = avcodec_alloc_context3(codec);
+        if(avcodec_parameters_to_context(m_AVCodecContext, m_AVStream->codecpar) != 0)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder avcodec_parameters_to_context fail.");
+            break;
+        }
+
+        //只解码关键帧, 单线程避免和播放争抢 CPU
+        m_AVCodecContext->skip_frame = AVDISCARD_NONKEY;
+        m_AVCodecContext->thread_count = 1;
+
+        if(avcodec_open2(m_AVCodecContext, codec, NULL) < 0)
+        {
+            LOGCATE("ThumbnailDecoder::OpenDecoder avcodec_open2 fail.");
+            break;
+        }
+
+        if(m_AVCodecContext->width <= 0 || m_AVCodecContext->height <= 0)
+            break;
+
+        m_ThumbnailWidth = THUMBNAIL_WIDTH;
+        m_ThumbnailHeight = (THUMBNAIL_WIDTH * m_AVCodecContext->height / m_AVCodecContext->width) & ~1;
+        if(m_ThumbnailHeight <= 0)
+            m_ThumbnailHeight = 2;
+
+        m_Duration = m_AVFormatContext->duration / AV_TIME_BASE * 1000;
+        //缓存容量刚好覆盖整个时长
+        m_SweepInterval = std::max(m_Duration / THUMBNAIL_CACHE_CAPACITY, (long)THUMBNAIL_MIN_INTERVAL);
+        m_Packet = av_packet_alloc();
+        m_Frame = av_frame_alloc();
+        result = 0;
+
+    }while (false);
+
+    LOGCATE("ThumbnailDecoder::OpenDecoder result=%d, size=[%d, %d]", result, m_ThumbnailWidth, m_ThumbnailHeight);
+    return result;
+}
+
+void ThumbnailDecoder::CloseDecoder()
+{
+    if(m_Packet != nullptr)
+        av_packet_free(&m_Packet);
+
+    if(m_Frame != nullptr)
+        av_frame_free(&m_Frame);
+
+    if(m_SwsContext != nullptr)
+    {
+        sws_freeContext(m_SwsContext);
+        m_SwsContext = nullptr;
+    }
+
+    if(m_AVCodecContext != nullptr)
+        avcodec_free_context(&m_AVCodecContext);
+
+    if(m_AVFormatContext != nullptr)
+        avformat_close_input(&m_AVFormatContext);
+}
+
+void ThumbnailDecoder::DecodingLoop()
+{
+    for(;;)
+    {
+        long timestamp = -1;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            while (!m_Stop && m_RequestTimeStamp < 0 && (m_SweepTimeStamp > m_Duration || m_Cache.IsFull()))
+            {
+                m_Cond.wait(lock);
+            }
+
+            if(m_Stop)
+                break;
+
+            //拖动时的查询优先, 空闲时按固定间隔依次填充缓存, 缓存满了就不再继续
+            if(m_RequestTimeStamp >= 0)
+            {
+                timestamp = m_RequestTimeStamp;
+                m_RequestTimeStamp = -1;
+            }
+            else
+            {
+                timestamp = m_SweepTimeStamp;
+                m_SweepTimeStamp += m_SweepInterval;
+            }
+        }
+
+        if(m_Cache.Contains(timestamp, m_SweepInterval / 2))
+            continue;
+
+        DecodeKeyFrame(timestamp);
+    }
+}
+
+int ThumbnailDecoder::DecodeKeyFrame(long timestamp)
+{
+    AVRational msTimeBase = {1, 1000};
+    int64_t target = av_rescale_q(timestamp, msTimeBase, m_AVStream->time_base);
+    if(avformat_seek_file(m_AVFormatContext, m_StreamIndex, INT64_MIN, target, target, 0) < 0 &&
+       avformat_seek_file(m_AVFormatContext, m_StreamIndex, INT64_MIN, target, INT64_MAX, 0) < 0)
+    {
+        LOGCATE("ThumbnailDecoder::DecodeKeyFrame seek fail. timestamp=%ld", timestamp);
+        return -1;
+    }
+
+    int result = -1;
+    for (int i = 0; i < THUMBNAIL_MAX_READ_PACKETS && !m_Stop; ++i)
+    {
+        if(av_read_frame(m_AVFormatContext, m_Packet) < 0)
+            break;
+
+        bool isKeyFrame = m_Packet->stream_index == m_StreamIndex && (m_Packet->flags & AV_PKT_FLAG_KEY);
+        if(isKeyFrame)
+            avcodec_send_packet(m_AVCodecContext, m_Packet);
+        av_packet_unref(m_Packet);
+        if(!isKeyFrame)
+            continue;
+
+        //有重排序延迟的解码器需要 drain 才能输出这一帧
+        avcodec_send_packet(m_AVCodecContext, nullptr);
+        while (avcodec_receive_frame(m_AVCodecContext, m_Frame) == 0)
+        {
+            if(result != 0)
+                result = ScaleFrame(m_Frame);
+            av_frame_unref(m_Frame);
+        }
+        avcodec_flush_buffers(m_AVCodecContext);
+        break;
+    }
+
+    return result;
+}
+
+int ThumbnailDecoder::ScaleFrame(AVFrame *frame)
+{
+    m_SwsContext = sws_getCachedContext(m_SwsContext, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                        m_ThumbnailWidth, m_ThumbnailHeight, AV_PIX_FMT_BGRA,
+                                        SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if(m_SwsContext == nullptr)
+        return -1;
+
+    Thumbnail thumbnail;
+    thumbnail.width = m_ThumbnailWidth;
+    thumbnail.height = m_ThumbnailHeight;
+    thumbnail.pixels.resize(m_ThumbnailWidth * m_ThumbnailHeight * 4);
+
+    int64_t pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    if(pts == AV_NOPTS_VALUE)
+        pts = 0;
+    thumbnail.timestamp = (long)(pts * av_q2d(m_AVStream->time_base) * 1000);
+
+    uint8_t *dstData[4] = {&thumbnail.pixels[0], nullptr, nullptr, nullptr};
+    int dstLineSize[4] = {m_ThumbnailWidth * 4, 0, 0, 0};
+    sws_scale(m_SwsContext, frame->data, frame->linesize, 0, frame->height, dstData, dstLineSize);
+
+    m_Cache.Put(thumbnail);
+    return 0;
+}
+
+void ThumbnailDecoder::DoThumbnailDecoding(ThumbnailDecoder *decoder)
+{
+    //低优先级, 不影响播放线程
+    setpriority(PRIO_PROCESS, 0, THUMBNAIL_THREAD_NICE);
+
+    if(decoder->OpenDecoder() == 0)
+        decoder->DecodingLoop();
+    decoder->CloseDecoder();
+}
+
+int ThumbnailDecoder::InterruptCallback(void *context)
+{
+    ThumbnailDecoder *decoder = static_cast<ThumbnailDecoder *>(context);
+    return decoder->m_Stop ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_THUMBNAILDECODER_H
+#define FFMPEGEXERCISE_THUMBNAILDECODER_H
+
+extern "C"{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+};
+
+#include <thread>
+#include <list>
+#include <map>
+#include <iterator>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#define THUMBNAIL_MAX_URL        2048
+#define THUMBNAIL_WIDTH          160
+//后台按 时长/缓存容量 的间隔依次解码关键帧, 缓存填满后停止, 间隔不小于该值
+#define THUMBNAIL_MIN_INTERVAL   1000 //ms
+//查询时允许返回的最大时间偏差, 超过后认为未命中
+#define THUMBNAIL_MAX_DISTANCE   5000 //ms
+#define THUMBNAIL_CACHE_CAPACITY 128
+//查找关键帧时最多读取的 packet 数
+#define THUMBNAIL_MAX_READ_PACKETS 500
+#define THUMBNAIL_THREAD_NICE    10
+
+//缩略图, BGRA 格式, 按 int 读取即为 Android 的 ARGB_8888
+struct Thumbnail
+{
+    long timestamp = 0; //ms
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+//按时间戳查询的 LRU 缓存
+class ThumbnailCache
+{
+public:
+    ThumbnailCache(int capacity) : m_Capacity(capacity) {}
+
+    void Put(Thumbnail &thumbnail)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        std::map<long, std::list<Thumbnail>::iterator>::iterator it = m_Map.find(thumbnail.timestamp);
+        if(it != m_Map.end())
+        {
+            m_List.splice(m_List.begin(), m_List, it->second);
+            return;
+        }
+
+        m_List.push_front(Thumbnail());
+        m_List.front().timestamp = thumbnail.timestamp;
+        m_List.front().width = thumbnail.width;
+        m_List.front().height = thumbnail.height;
+        m_List.front().pixels.swap(thumbnail.pixels);
+        m_Map[thumbnail.timestamp] = m_List.begin();
+
+        if(static_cast<int>(m_List.size()) > m_Capacity)
+        {
+            m_Map.erase(m_List.back().timestamp);
+            m_List.pop_back();
+        }
+    }
+
+    //返回时间戳最接近的缩略图, 偏差超过 maxDistance 时返回 false
+    bool Get(long timestamp, long maxDistance, Thumbnail &thumbnail)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        std::list<Thumbnail>::iterator nearest;
+        if(!FindNearest(timestamp, maxDistance, nearest))
+            return false;
+
+        m_List.splice(m_List.begin(), m_List, nearest);
+        thumbnail = *nearest;
+        return true;
+    }
+
+    bool IsFull()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        return static_cast<int>(m_List.size()) >= m_Capacity;
+    }
+
+    bool Contains(long timestamp, long maxDistance)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        std::list<Thumbnail>::iterator nearest;
+        return FindNearest(timestamp, maxDistance, nearest);
+    }
+
+    void Clear()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Map.clear();
+        m_List.clear();
+    }
+
+private:
+    bool FindNearest(long timestamp, long maxDistance, std::list<Thumbnail>::iterator &nearest)
+    {
+        if(m_Map.empty())
+            return false;
+
+        std::map<long, std::list<Thumbnail>::iterator>::iterator next = m_Map.lower_bound(timestamp);
+        std::map<long, std::list<Thumbnail>::iterator>::iterator best = next;
+        if(next == m_Map.end() || (next != m_Map.begin() && timestamp - std::prev(next)->first < next->first - timestamp))
+            best = std::prev(next);
+
+        long distance = best->first > timestamp ? best->first - timestamp : timestamp - best->first;
+        if(distance > maxDistance)
+            return false;
+
+        nearest = best->second;
+        return true;
+    }
+
+    int m_Capacity;
+    std::list<Thumbnail> m_List; //表头是最近使用的
+    std::map<long, std::list<Thumbnail>::iterator> m_Map;
+    std::mutex m_Mutex;
+};
+
+//拖动进度条时的缩略图引擎, 使用独立的解码上下文在低优先级线程中只解码关键帧
+class ThumbnailDecoder {
+public:
+    ThumbnailDecoder(const char *url);
+    ~ThumbnailDecoder();
+
+    void Start();
+    void Stop();
+
+    //未命中时请求后台线程优先解码该位置附近的关键帧
+    bool GetThumbnail(long timestamp, Thumbnail &thumbnail);
+
+private:
+    int OpenDecoder();
+    void CloseDecoder();
+    void DecodingLoop();
+    //解码 timestamp 之前最近的关键帧并放入缓存
+    int DecodeKeyFrame(long timestamp);
+    int ScaleFrame(AVFrame *frame);
+
+    static void DoThumbnailDecoding(ThumbnailDecoder *decoder);
+    static int InterruptCallback(void *context);
+
+    char m_Url[THUMBNAIL_MAX_URL] = {0};
+
+    AVFormatContext *m_AVFormatContext = nullptr;
+    AVCodecContext *m_AVCodecContext = nullptr;
+    AVStream *m_AVStream = nullptr;
+    int m_StreamIndex = -1;
+    AVPacket *m_Packet = nullptr;
+    AVFrame *m_Frame = nullptr;
+
+    //所有缩略图尺寸相同, 复用同一个 SwsContext
+    SwsContext *m_SwsContext = nullptr;
+    int m_ThumbnailWidth = 0;
+    int m_ThumbnailHeight = 0;
+
+    long m_Duration = 0;
+    long m_SweepTimeStamp = 0;
+    volatile long m_SweepInterval = THUMBNAIL_MIN_INTERVAL;
+
+    ThumbnailCache m_Cache;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Cond;
+    std::thread *m_Thread = nullptr;
+    volatile bool m_Stop = false;
+    //-1 表示没有待处理的查询
+    long m_RequestTimeStamp = -1;
+};
+
+#endif //FFMPEGEXERCISE_THUMBNAILDECODER_H
@@ -3,18 +3,19 @@
 //
 
 #include "VideoDecoder.h"
+#include "YuvConverter.h"
 
 void VideoDecoder::OnDecoderReady() {
     LOGCATE("VideoDecoder::OnDecoderReady");
     m_VideoWidth = GetCodecContext()->width;
     m_VideoHeight = GetCodecContext()->height;
 
-    if(m_MsgContext && m_MsgCallback)
-        m_MsgCallback(m_MsgContext, MSG_DECODER_READY, 0);
-
     if(m_VideoRender != nullptr) {
         int dstSize[2] = {0};
-        m_VideoRender->Init(m_VideoWidth, m_VideoHeight, dstSize);
+        if(m_RenderInitialized)
+            m_VideoRender->OnVideoSizeChanged(m_VideoWidth, m_VideoHeight, dstSize);
+        else
+            m_VideoRender->Init(m_VideoWidth, m_VideoHeight, dstSize);
         m_RenderWidth = dstSize[0];
         m_RenderHeight = dstSize[1];
 
@@ -26,14 +27,10 @@ void VideoDecoder::OnDecoderReady() {
         }
 
         m_RGBAFrame = av_frame_alloc();
-        int bufferSize = av_image_get_buffer_size(DST_PIXEL_FORMAT, m_RenderWidth, m_RenderHeight, 1);
-        m_FrameBuffer = (uint8_t *) av_malloc(bufferSize * sizeof(uint8_t));
-        av_image_fill_arrays(m_RGBAFrame->data, m_RGBAFrame->linesize,
-                             m_FrameBuffer, DST_PIXEL_FORMAT, m_RenderWidth, m_RenderHeight, 1);
+        EnsureRgbaBuffer(m_RenderWidth, m_RenderHeight);
 
-        m_SwsContext = sws_getContext(m_VideoWidth, m_VideoHeight, GetCodecContext()->pix_fmt,
-                                      m_RenderWidth, m_RenderHeight, DST_PIXEL_FORMAT,
-                                      SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        //转换上下文在第一次转换时按帧的实际尺寸和格式创建
+        m_Converter = new SliceConverter(SWS_FAST_BILINEAR);
     } else {
         LOGCATE("VideoDecoder::OnDecoderReady m_VideoRender == null");
     }
@@ -54,13 +51,13 @@ void VideoDecoder::OnDecoderDone() {
     }
 
     if(m_FrameBuffer != nullptr) {
-        free(m_FrameBuffer);
-        m_FrameBuffer = nullptr;
+        av_freep(&m_FrameBuffer);
+        m_FrameBufferSize = 0;
     }
 
-    if(m_SwsContext != nullptr) {
-        sws_freeContext(m_SwsContext);
-        m_SwsContext = nullptr;
+    if(m_Converter != nullptr) {
+        delete m_Converter;
+        m_Converter = nullptr;
     }
 
 //    if(m_pVideoRecorder != nullptr) {
@@ -75,18 +72,26 @@ void VideoDecoder::OnFrameAvailable(AVFrame *frame) {
     LOGCATE("VideoDecoder::OnFrameAvailable frame=%p", frame);
     if(m_VideoRender != nullptr && frame != nullptr) {
         NativeImage image;
-        LOGCATE("VideoDecoder::OnFrameAvailable frame[w,h]=[%d, %d],format=%d,[line0,line1,line2]=[%d, %d, %d]", frame->width, frame->height, GetCodecContext()->pix_fmt, frame->linesize[0], frame->linesize[1],frame->linesize[2]);
+        //解码器输出的格式可以直接上传纹理时, 把帧的引用交给渲染器, 不拷贝像素
+        bool directFrame = false;
+        //以帧的实际尺寸和格式为准, 自适应码流和部分 TS 文件会在中途改变
+        AVPixelFormat pixFormat = static_cast<AVPixelFormat>(frame->format);
+        LOGCATE("VideoDecoder::OnFrameAvailable frame[w,h]=[%d, %d],format=%d,[line0,line1,line2]=[%d, %d, %d]", frame->width, frame->height, pixFormat, frame->linesize[0], frame->linesize[1],frame->linesize[2]);
+        if(frame->width != m_VideoWidth || frame->height != m_VideoHeight)
+            OnVideoSizeChanged(frame->width, frame->height);
+
         if(m_VideoRender->GetRenderType() == VIDEO_RENDER_ANWINDOW)
         {
-            sws_scale(m_SwsContext, frame->data, frame->linesize, 0,
-                      m_VideoHeight, m_RGBAFrame->data, m_RGBAFrame->linesize);
+            if(!ConvertToRgba(frame))
+                return;
 
             image.format = IMAGE_FORMAT_RGBA;
             image.width = m_RenderWidth;
             image.height = m_RenderHeight;
             image.ppPlane[0] = m_RGBAFrame->data[0];
             image.pLineSize[0] = image.width * 4;
-        } else if(GetCodecContext()->pix_fmt == AV_PIX_FMT_YUV420P || GetCodecContext()->pix_fmt == AV_PIX_FMT_YUVJ420P) {
+        } else if(pixFormat == AV_PIX_FMT_YUV420P || pixFormat == AV_PIX_FMT_YUVJ420P) {
+            directFrame = true;
             image.format = IMAGE_FORMAT_I420;
             image.width = frame->width;
             image.height = frame->height;
@@ -100,7 +105,8 @@ void VideoDecoder::OnFrameAvailable(AVFrame *frame) {
                 // on some android device, output of h264 mediacodec decoder is NV12 兼容某些设备可能出现的格式不匹配问题
                 image.format = IMAGE_FORMAT_NV12;
             }
-        } else if (GetCodecContext()->pix_fmt == AV_PIX_FMT_NV12) {
+        } else if (pixFormat == AV_PIX_FMT_NV12) {
+            directFrame = true;
             image.format = IMAGE_FORMAT_NV12;
             image.width = frame->width;
             image.height = frame->height;
@@ -108,7 +114,8 @@ void VideoDecoder::OnFrameAvailable(AVFrame *frame) {
             image.pLineSize[1] = frame->linesize[1];
             image.ppPlane[0] = frame->data[0];
             image.ppPlane[1] = frame->data[1];
-        } else if (GetCodecContext()->pix_fmt == AV_PIX_FMT_NV21) {
+        } else if (pixFormat == AV_PIX_FMT_NV21) {
+            directFrame = true;
             image.format = IMAGE_FORMAT_NV21;
             image.width = frame->width;
             image.height = frame->height;
@@ -116,15 +123,16 @@ void VideoDecoder::OnFrameAvailable(AVFrame *frame) {
             image.pLineSize[1] = frame->linesize[1];
             image.ppPlane[0] = frame->data[0];
             image.ppPlane[1] = frame->data[1];
-        } else if (GetCodecContext()->pix_fmt == AV_PIX_FMT_RGBA) {
+        } else if (pixFormat == AV_PIX_FMT_RGBA) {
+            directFrame = true;
             image.format = IMAGE_FORMAT_RGBA;
             image.width = frame->width;
             image.height = frame->height;
             image.pLineSize[0] = frame->linesize[0];
             image.ppPlane[0] = frame->data[0];
         } else {
-            sws_scale(m_SwsContext, frame->data, frame->linesize, 0,
-                      m_VideoHeight, m_RGBAFrame->data, m_RGBAFrame->linesize);
+            if(!ConvertToRgba(frame))
+                return;
             image.format = IMAGE_FORMAT_RGBA;
             image.width = m_RenderWidth;
             image.height = m_RenderHeight;
@@ -132,13 +140,83 @@ void VideoDecoder::OnFrameAvailable(AVFrame *frame) {
             image.pLineSize[0] = image.width * 4;
         }
 
-        m_VideoRender->RenderVideoFrame(&image);
+        if(!directFrame || !m_VideoRender->RenderVideoFrame(frame, image.format))
+            m_VideoRender->RenderVideoFrame(&image);
 
 //        if(m_pVideoRecorder != nullptr) {
 //            m_pVideoRecorder->OnFrame2Encode(&image);
 //        }
+
+        //按需重绘, 只有新的一帧才请求上层刷新
+        if(m_VideoRender->RequestRender() && m_MsgContext && m_MsgCallback)
+            m_MsgCallback(m_MsgContext, MSG_DECODER_RENDER, 0);
+    }
+}
+
+bool VideoDecoder::ConvertToRgba(AVFrame *frame) {
+    if(m_Converter == nullptr || m_FrameBuffer == nullptr)
+        return false;
+
+    int64_t startTime = av_gettime_relative();
+    int result = m_Converter->Convert(frame, m_RenderWidth, m_RenderHeight, DST_PIXEL_FORMAT,
+                                      m_RGBAFrame->data, m_RGBAFrame->linesize);
+    if(result < 0) {
+        LOGCATE("VideoDecoder::ConvertToRgba fail, frame[w,h]=[%d, %d], format=%d", frame->width, frame->height, frame->format);
+        return false;
     }
+    bool simd = result > 0;
+
+    //统计转换耗时, 转换方式改变之后重新统计
+    int64_t convertTime = av_gettime_relative() - startTime;
+    if(simd != m_StatConvertSimd) {
+        m_StatConvertSimd = simd;
+        m_StatConvertTime = 0;
+        m_StatConvertCount = 0;
+    }
+    m_StatConvertTime += convertTime;
+    if(++m_StatConvertCount == CONVERT_STAT_INTERVAL) {
+        LOGCATE("VideoDecoder::ConvertToRgba converter=%s, bandCount=%d, [w, h]=[%d, %d], avg convert time=%lldus",
+                simd ? YuvConverter::GetImplName() : "swscale", m_Converter->GetBandCount(), m_RenderWidth, m_RenderHeight,
+                (long long) (m_StatConvertTime / m_StatConvertCount));
+        m_StatConvertTime = 0;
+        m_StatConvertCount = 0;
+    }
+    return true;
+}
 
-//    if(m_MsgContext && m_MsgCallback)
-//        m_MsgCallback(m_MsgContext, MSG_REQUEST_RENDER, 0);
-}
\ No newline at end of file
+void VideoDecoder::OnVideoSizeChanged(int width, int height) {
+    LOGCATE("VideoDecoder::OnVideoSizeChanged [%d, %d] -> [%d, %d]", m_VideoWidth, m_VideoHeight, width, height);
+    m_VideoWidth = width;
+    m_VideoHeight = height;
+
+    int dstSize[2] = {0};
+    m_VideoRender->OnVideoSizeChanged(width, height, dstSize);
+    m_RenderWidth = dstSize[0];
+    m_RenderHeight = dstSize[1];
+    EnsureRgbaBuffer(m_RenderWidth, m_RenderHeight);
+
+    m_StatConvertTime = 0;
+    m_StatConvertCount = 0;
+
+    if(m_MsgContext && m_MsgCallback)
+        m_MsgCallback(m_MsgContext, MSG_VIDEO_SIZE_CHANGED, 0);
+}
+
+bool VideoDecoder::EnsureRgbaBuffer(int width, int height) {
+    if(m_RGBAFrame == nullptr || width <= 0 || height <= 0)
+        return false;
+
+    int bufferSize = av_image_get_buffer_size(DST_PIXEL_FORMAT, width, height, 1);
+    if(bufferSize > m_FrameBufferSize) {
+        av_freep(&m_FrameBuffer);
+        m_FrameBuffer = (uint8_t *) av_malloc(bufferSize * sizeof(uint8_t));
+        m_FrameBufferSize = m_FrameBuffer != nullptr ? bufferSize : 0;
+        if(m_FrameBuffer == nullptr) {
+            LOGCATE("VideoDecoder::EnsureRgbaBuffer av_malloc fail, bufferSize=%d", bufferSize);
+            return false;
+        }
+    }
+    av_image_fill_arrays(m_RGBAFrame->data, m_RGBAFrame->linesize,
+                         m_FrameBuffer, DST_PIXEL_FORMAT, width, height, 1);
+    return true;
+}
@@ -7,18 +7,21 @@
 
 extern "C"{
 #include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
 };
 
 #include "VideoRender.h"
 #include "DecoderBase.h"
+#include "SliceConverter.h"
+
+//每转换多少帧统计一次 RGBA 转换的平均耗时
+#define CONVERT_STAT_INTERVAL   120
 
 class VideoDecoder : public DecoderBase
 {
 public:
-    VideoDecoder(char* url)
+    VideoDecoder(Demuxer* demuxer)
     {
-        Init(url,AVMEDIA_TYPE_VIDEO);
+        Init(demuxer,AVMEDIA_TYPE_VIDEO);
     }
 
     virtual ~VideoDecoder(){
@@ -39,24 +42,43 @@ public:
         m_VideoRender = videoRender;
     }
 
+    //渲染器已经由播放列表的前一个条目初始化, 只更新视频尺寸, 保留手势设置的变换矩阵
+    void SetRenderInitialized(bool initialized)
+    {
+        m_RenderInitialized = initialized;
+    }
+
 private:
     virtual void OnDecoderReady();
     virtual void OnDecoderDone();
     virtual void OnFrameAvailable(AVFrame *frame);
 
+    //经由 m_Converter 分条带并行转换为 m_RGBAFrame, 失败返回 false
+    bool ConvertToRgba(AVFrame *frame);
+    //码流中途改变分辨率时只更新渲染尺寸和 RGBA 缓冲区, 不重启解码
+    void OnVideoSizeChanged(int width, int height);
+    //缓冲区只在需要更大的空间时重新分配
+    bool EnsureRgbaBuffer(int width, int height);
+
     const AVPixelFormat DST_PIXEL_FORMAT = AV_PIX_FMT_RGBA;
 
-    int m_VideoWidth = 0;
-    int m_VideoHeight = 0;
+    volatile int m_VideoWidth = 0;
+    volatile int m_VideoHeight = 0;
 
+    bool m_RenderInitialized = false;
     int m_RenderWidth = 0;
     int m_RenderHeight = 0;
 
     AVFrame *m_RGBAFrame = nullptr;
     uint8_t *m_FrameBuffer = nullptr;
+    int m_FrameBufferSize = 0;
 
     VideoRender *m_VideoRender = nullptr;
-    SwsContext *m_SwsContext = nullptr;
+    SliceConverter *m_Converter = nullptr;
+
+    int64_t m_StatConvertTime = 0;
+    int m_StatConvertCount = 0;
+    bool m_StatConvertSimd = false;
 };
 
 #endif //FFMPEGEXERCISE_VIDEODECODER_H
@@ -5,21 +5,17 @@
 #ifndef FFMPEGEXERCISE_AUDIORENDER_H
 #define FFMPEGEXERCISE_AUDIORENDER_H
 
+//PCM 缓冲块, 由渲染器预先分配并循环使用
 class AudioFrame
 {
 public:
-    AudioFrame(uint8_t* data,int dataSize,bool hardCopy = true){
-        this->dataSize  = dataSize;
-        this->data = data;
-        this->hardCopy = hardCopy;
-        if(hardCopy){
-            this->data = static_cast<uint8_t *>(malloc(this->dataSize));
-            memcpy(this->data,data,this->dataSize);
-        }
+    AudioFrame(int capacity){
+        this->capacity = capacity;
+        this->data = static_cast<uint8_t *>(malloc(this->capacity));
     }
 
     ~AudioFrame(){
-        if(hardCopy && this->data)
+        if(this->data)
         {
             free(this->data);
             this->data = nullptr;
@@ -27,8 +23,14 @@ public:
     }
 
     uint8_t * data = nullptr;
+    int capacity = 0;
     int dataSize = 0;
-    bool hardCopy = true;
+    //ms
+    long pts = -1;
+    //倍速播放时每毫秒输出对应的媒体时长
+    float speed = 1.0f;
+    //提交该块的解码器, 播放列表切换时用来区分缓冲队列中前后两个条目的数据
+    int tag = 0;
 };
 
 class AudioRender{
@@ -36,8 +38,20 @@ public:
     virtual ~AudioRender(){}
 
     virtual void Init() = 0;
+    //可以在 Init 之前调用, Init 完成并且缓冲区填满后才真正开始播放
+    virtual void Play() = 0;
+    virtual void Pause() = 0;
     virtual void ClearAudioCache() = 0;
-    virtual void RenderAudioFrame(uint8_t* pData,int dataSize) = 0;
+    //从缓冲池中取一个空闲块, 解码器直接写入 PCM 后用 RenderAudioFrame 提交, 不产生内存分配和拷贝.
+    //没有空闲块时阻塞, 渲染器停止后返回 nullptr
+    virtual AudioFrame* ObtainAudioFrame() = 0;
+    //提交 ObtainAudioFrame 取得的块, dataSize 为 0 时直接归还
+    virtual void RenderAudioFrame(AudioFrame* audioFrame) = 0;
+    //把一段 PCM 拷贝到缓冲池中提交, 用于不能直接写入缓冲块的数据(如滤镜输出).
+    //speed 为该段数据的播放速度, 用于把实际播放时长换算成媒体时间
+    virtual void RenderAudioFrame(uint8_t* pData,int dataSize,long pts = -1,float speed = 1.0f,int tag = 0) = 0;
+    //当前实际播放到的时间戳(ms), 不可用时返回 -1. tag 返回正在播放的块的 AudioFrame::tag
+    virtual long GetAudioClock(int *tag = nullptr) = 0;
     virtual void UnInit() = 0;
 };
 
@@ -6,6 +6,30 @@
 #include "LogUtil.h"
 #include <unistd.h>
 
+//只读的静音数据, 可以同时多次送入 OpenSL
+static uint8_t s_SilenceBuffer[AUDIO_SILENCE_SAMPLES * 2 * 2] = {0};
+
+OpenSLRender::OpenSLRender()
+        : m_FreeFrameQueue(AUDIO_FRAME_POOL_SIZE),
+          m_AudioFrameQueue(MAX_QUEUE_BUFFER_SIZE),
+          m_PlayingFrameQueue(AUDIO_FRAME_POOL_SIZE)
+{
+    //PCM 缓冲块一次性分配, 播放过程中不再分配内存
+    for (int i = 0; i < AUDIO_FRAME_POOL_SIZE; ++i) {
+        AudioFrame *audioFrame = new AudioFrame(AUDIO_FRAME_CAPACITY);
+        m_AudioFramePool.push_back(audioFrame);
+        m_FreeFrameQueue.TryPush(audioFrame);
+    }
+}
+
+OpenSLRender::~OpenSLRender() {
+    UnInit();
+    for (size_t i = 0; i < m_AudioFramePool.size(); ++i) {
+        delete m_AudioFramePool[i];
+    }
+    m_AudioFramePool.clear();
+}
+
 void OpenSLRender::Init() {
     LOGCATE("OpenSLRender::Init");
 
@@ -43,38 +67,108 @@ void OpenSLRender::Init() {
 
 }
 
-void OpenSLRender::RenderAudioFrame(uint8_t *pData, int dataSize)
+void OpenSLRender::Play() {
+    std::unique_lock<std::mutex> stateLock(m_StateMutex);
+    std::unique_lock<std::mutex> lock(m_ClockMutex);
+    m_PlayRequested = true;
+    m_PlayCond.notify_all();
+    lock.unlock();
+
+    //SetPlayState 可能同步执行或者等待回调, 不能持有回调使用的 m_ClockMutex
+    if(m_Started && m_AudioPlayerPlay)
+        (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, SL_PLAYSTATE_PLAYING);
+}
+
+void OpenSLRender::Pause() {
+    std::unique_lock<std::mutex> stateLock(m_StateMutex);
+    std::unique_lock<std::mutex> lock(m_ClockMutex);
+    m_PlayRequested = false;
+    lock.unlock();
+
+    if(m_Started && m_AudioPlayerPlay)
+        (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, SL_PLAYSTATE_PAUSED);
+}
+
+AudioFrame *OpenSLRender::ObtainAudioFrame()
 {
-    if(m_AudioPlayerPlay)
+    //没有空闲块时阻塞, 由 OpenSL 回调线程归还后唤醒
+    AudioFrame *audioFrame = nullptr;
+    if(!m_FreeFrameQueue.Pop(audioFrame))
+        return nullptr;
+
+    audioFrame->dataSize = 0;
+    audioFrame->pts = -1;
+    audioFrame->speed = 1.0f;
+    audioFrame->tag = 0;
+    return audioFrame;
+}
+
+void OpenSLRender::RenderAudioFrame(AudioFrame *audioFrame)
+{
+    if(audioFrame == nullptr)
+        return;
+
+    //队列满时阻塞, 由 OpenSL 回调线程出队后唤醒
+    if(m_AudioPlayerPlay == nullptr || audioFrame->dataSize <= 0 ||
+       !m_AudioFrameQueue.Push(audioFrame, audioFrame->dataSize))
     {
-        if(pData != nullptr && dataSize > 0)
-        {
-            while (GetAudioFrameQueueSize() >= MAX_QUEUE_BUFFER_SIZE && !m_Exit)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(15));
-            }
-
-            std::unique_lock<std::mutex> lock(m_Mutex);
-            AudioFrame *audioFrame = new AudioFrame(pData, dataSize);
-            m_AudioFrameQueue.push(audioFrame);
-            m_Cond.notify_all();
-            lock.unlock();
-        }
+        RecycleAudioFrame(audioFrame);
     }
 }
 
+void OpenSLRender::RenderAudioFrame(uint8_t *pData, int dataSize, long pts, float speed, int tag)
+{
+    //44.1kHz, 双声道, 16bit
+    const int bytesPerSecond = 44100 * 2 * 2;
+    while (pData != nullptr && dataSize > 0)
+    {
+        AudioFrame *audioFrame = ObtainAudioFrame();
+        if(audioFrame == nullptr)
+            return;
+
+        int size = dataSize < audioFrame->capacity ? dataSize : audioFrame->capacity;
+        memcpy(audioFrame->data, pData, size);
+        audioFrame->dataSize = size;
+        audioFrame->pts = pts;
+        audioFrame->speed = speed;
+        audioFrame->tag = tag;
+        RenderAudioFrame(audioFrame);
+
+        pData += size;
+        dataSize -= size;
+        if(pts >= 0)
+            pts += static_cast<long>(size * 1000LL * speed / bytesPerSecond);
+    }
+}
+
+void OpenSLRender::RecycleAudioFrame(AudioFrame *audioFrame)
+{
+    //静音块为 nullptr
+    if(audioFrame == nullptr)
+        return;
+
+    //缓冲池已经停止时 TryPush 失败, 块仍由 m_AudioFramePool 持有
+    m_FreeFrameQueue.TryPush(audioFrame);
+}
+
 void OpenSLRender::UnInit() {
     LOGCATE("OpenSLRender::UnInit");
 
-    if (m_AudioPlayerPlay) {
-        (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, SL_PLAYSTATE_STOPPED);
-        m_AudioPlayerPlay = nullptr;
-    }
-
-    std::unique_lock<std::mutex> lock(m_Mutex);
+    //先在 m_ClockMutex 下置空, GetAudioClock 不再访问播放器, 再在锁外停止播放
+    std::unique_lock<std::mutex> stateLock(m_StateMutex);
+    std::unique_lock<std::mutex> clockLock(m_ClockMutex);
+    SLPlayItf audioPlayerPlay = m_AudioPlayerPlay;
+    m_AudioPlayerPlay = nullptr;
     m_Exit = true;
-    m_Cond.notify_all();
-    lock.unlock();
+    m_PlayCond.notify_all();
+    clockLock.unlock();
+
+    if (audioPlayerPlay)
+        (*audioPlayerPlay)->SetPlayState(audioPlayerPlay, SL_PLAYSTATE_STOPPED);
+    stateLock.unlock();
+
+    m_AudioFrameQueue.Abort();
+    m_FreeFrameQueue.Abort();
 
     if (m_AudioPlayerObj) {
         (*m_AudioPlayerObj)->Destroy(m_AudioPlayerObj);
@@ -93,13 +187,9 @@ void OpenSLRender::UnInit() {
         m_EngineEngine = nullptr;
     }
 
-    lock.lock();
-    for (int i = 0; i < m_AudioFrameQueue.size(); ++i) {
-        AudioFrame *audioFrame = m_AudioFrameQueue.front();
-        m_AudioFrameQueue.pop();
-        delete audioFrame;
-    }
-    lock.unlock();
+    //OpenSL 已经销毁, 正在播放的块也可以回收
+    ClearAudioCache();
+    m_PlayingFrameQueue.Clear([this](AudioFrame *&audioFrame) { RecycleAudioFrame(audioFrame); });
 
     if(m_thread != nullptr)
     {
@@ -163,7 +253,7 @@ int OpenSLRender::CreateOutputMixer() {
 }
 
 int OpenSLRender::CreateAudioPlayer() {
-    SLDataLocator_AndroidSimpleBufferQueue android_queue = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 2};
+    SLDataLocator_AndroidSimpleBufferQueue android_queue = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, AUDIO_SL_BUFFER_COUNT};
     SLDataFormat_PCM pcm = {
             SL_DATAFORMAT_PCM,//format type
             (SLuint32)2,//channel count
@@ -234,39 +324,78 @@ int OpenSLRender::CreateAudioPlayer() {
 
 void OpenSLRender::StartRender() {
 
-    while (GetAudioFrameQueueSize() < MAX_QUEUE_BUFFER_SIZE && !m_Exit) {
-        std::unique_lock<std::mutex> lock(m_Mutex);
-        m_Cond.wait_for(lock, std::chrono::milliseconds(10));
-        //m_Cond.wait(lock);
-        lock.unlock();
+    //等待队列预先缓存 MAX_QUEUE_BUFFER_SIZE 帧
+    if(!m_AudioFrameQueue.WaitForCount(MAX_QUEUE_BUFFER_SIZE) || m_Exit)
+        return;
+
+    //暂停状态下预先送入 OpenSL, 此时不会触发回调, 开始播放后每个回调补充一块, OpenSL 中始终有 AUDIO_SL_BUFFER_COUNT 块
+    std::unique_lock<std::mutex> stateLock(m_StateMutex);
+    if(m_Exit || m_AudioPlayerPlay == nullptr)
+        return;
+    (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, SL_PLAYSTATE_PAUSED);
+    stateLock.unlock();
+
+    for (int i = 0; i < AUDIO_SL_BUFFER_COUNT; ++i) {
+        EnqueueAudioFrame();
+    }
+
+    //准备阶段缓冲区已经填满, 等待 Play
+    std::unique_lock<std::mutex> lock(m_ClockMutex);
+    while (!m_PlayRequested && !m_Exit)
+    {
+        m_PlayCond.wait(lock);
     }
+    lock.unlock();
+
+    //等待结束之后可能又被 Pause, 按 m_StateMutex 下的请求设置状态
+    stateLock.lock();
+    if(m_Exit || m_AudioPlayerPlay == nullptr)
+        return;
 
-    (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, SL_PLAYSTATE_PLAYING);
-    AudioPlayerCallback(m_BufferQueue, this);
+    m_Started = true;
+    (*m_AudioPlayerPlay)->SetPlayState(m_AudioPlayerPlay, m_PlayRequested ? SL_PLAYSTATE_PLAYING : SL_PLAYSTATE_PAUSED);
 }
 
 void OpenSLRender::HandleAudioFrameQueue() {
-    //LOGCATE("OpenSLRender::HandleAudioFrameQueue QueueSize=%lu", m_AudioFrameQueue.size());
-    if (m_AudioPlayerPlay == nullptr) return;
+    //运行在 OpenSL 的回调线程, 不能阻塞. 回调表示最早送入 OpenSL 的块已经播放完, 归还到缓冲池
+    AudioFrame *playedFrame = nullptr;
+    if (m_PlayingFrameQueue.TryPop(playedFrame))
+        RecycleAudioFrame(playedFrame);
 
-    while (GetAudioFrameQueueSize() < MAX_QUEUE_BUFFER_SIZE && !m_Exit) {
-        std::unique_lock<std::mutex> lock(m_Mutex);
-        m_Cond.wait_for(lock, std::chrono::milliseconds(10));
-    }
+    EnqueueAudioFrame();
+}
 
-    std::unique_lock<std::mutex> lock(m_Mutex);
-    AudioFrame *audioFrame = m_AudioFrameQueue.front();
-    if (nullptr != audioFrame && m_AudioPlayerPlay) {
-        SLresult result = (*m_BufferQueue)->Enqueue(m_BufferQueue, audioFrame->data, (SLuint32) audioFrame->dataSize);
-        if (result == SL_RESULT_SUCCESS) {
-            //AudioGLRender::GetInstance()->UpdateAudioFrame(audioFrame);
-            m_AudioFrameQueue.pop();
-            delete audioFrame;
-        }
+void OpenSLRender::EnqueueAudioFrame() {
+    //LOGCATE("OpenSLRender::EnqueueAudioFrame QueueSize=%d", m_AudioFrameQueue.Size());
+    if (m_AudioPlayerPlay == nullptr) return;
 
+    AudioFrame *audioFrame = nullptr;
+    if (!m_AudioFrameQueue.TryPop(audioFrame)) {
+        //解码跟不上或者已经播放结束, 送入一小段静音让回调继续, 静音期间音频时钟保持不变
+        if (!m_Starving) {
+            LOGCATE("OpenSLRender::EnqueueAudioFrame underrun, m_EnqueuedEndPts=%ld", m_EnqueuedEndPts);
+            m_Starving = true;
+        }
+        if ((*m_BufferQueue)->Enqueue(m_BufferQueue, s_SilenceBuffer, (SLuint32) sizeof(s_SilenceBuffer)) == SL_RESULT_SUCCESS) {
+            m_PlayingFrameQueue.TryPush(nullptr);
+            RecordEnqueuedBuffer(m_EnqueuedEndPts, sizeof(s_SilenceBuffer), 0.0f, m_EnqueuedEndTag);
+        }
+        return;
+    }
+    m_Starving = false;
+
+    //OpenSL 直接读取块中的数据, 播放完之前不能归还
+    SLresult result = SL_RESULT_PRECONDITIONS_VIOLATED;
+    if (m_AudioPlayerPlay)
+        result = (*m_BufferQueue)->Enqueue(m_BufferQueue, audioFrame->data, (SLuint32) audioFrame->dataSize);
+
+    if (result == SL_RESULT_SUCCESS) {
+        //AudioGLRender::GetInstance()->UpdateAudioFrame(audioFrame);
+        m_PlayingFrameQueue.TryPush(audioFrame);
+        RecordEnqueuedBuffer(audioFrame->pts, audioFrame->dataSize, audioFrame->speed, audioFrame->tag);
+    } else {
+        RecycleAudioFrame(audioFrame);
     }
-    lock.unlock();
-
 }
 
 void OpenSLRender::CreateSLWaitingThread(OpenSLRender *openSlRender) {
@@ -278,17 +407,44 @@ void OpenSLRender::AudioPlayerCallback(SLAndroidSimpleBufferQueueItf bufferQueue
     openSlRender->HandleAudioFrameQueue();
 }
 
-int OpenSLRender::GetAudioFrameQueueSize() {
-    std::unique_lock<std::mutex> lock(m_Mutex);
-    return m_AudioFrameQueue.size();
+void OpenSLRender::ClearAudioCache() {
+    m_AudioFrameQueue.Clear([this](AudioFrame *&audioFrame) { RecycleAudioFrame(audioFrame); });
 }
 
-void OpenSLRender::ClearAudioCache() {
-    std::unique_lock<std::mutex> lock(m_Mutex);
-    for (int i = 0; i < m_AudioFrameQueue.size(); ++i) {
-        AudioFrame *audioFrame = m_AudioFrameQueue.front();
-        m_AudioFrameQueue.pop();
-        delete audioFrame;
-    }
+void OpenSLRender::RecordEnqueuedBuffer(long pts, int dataSize, float speed, int tag) {
+    //44.1kHz, 双声道, 16bit
+    const int bytesPerSecond = 44100 * 2 * 2;
+    std::unique_lock<std::mutex> lock(m_ClockMutex);
+    EnqueuedBuffer &buffer = m_EnqueuedBuffers[m_EnqueuedIndex % ENQUEUED_BUFFER_RECORD_SIZE];
+    buffer.pts = pts;
+    buffer.startPosition = static_cast<long>(m_EnqueuedBytes * 1000 / bytesPerSecond);
+    buffer.speed = speed;
+    buffer.tag = tag;
+    m_EnqueuedIndex++;
+    m_EnqueuedBytes += dataSize;
+    if(pts >= 0)
+        m_EnqueuedEndPts = pts + static_cast<long>(dataSize * 1000LL * speed / bytesPerSecond);
+    m_EnqueuedEndTag = tag;
+}
 
-}
\ No newline at end of file
+long OpenSLRender::GetAudioClock(int *tag) {
+    //与 UnInit 互斥, 避免访问已经销毁的播放器
+    std::unique_lock<std::mutex> lock(m_ClockMutex);
+    if (m_AudioPlayerPlay == nullptr) return -1;
+
+    SLmillisecond position = 0;
+    if ((*m_AudioPlayerPlay)->GetPosition(m_AudioPlayerPlay, &position) != SL_RESULT_SUCCESS)
+        return -1;
+
+    //找到当前正在播放的缓冲区, 时钟 = 缓冲区时间戳 + 缓冲区内已播放的时长 * 播放速度
+    int count = m_EnqueuedIndex < ENQUEUED_BUFFER_RECORD_SIZE ? m_EnqueuedIndex : ENQUEUED_BUFFER_RECORD_SIZE;
+    for (int i = 1; i <= count; ++i) {
+        EnqueuedBuffer &buffer = m_EnqueuedBuffers[(m_EnqueuedIndex - i) % ENQUEUED_BUFFER_RECORD_SIZE];
+        if (buffer.startPosition <= (long)position) {
+            if (tag != nullptr)
+                *tag = buffer.tag;
+            return buffer.pts < 0 ? -1 : buffer.pts + static_cast<long>(((long)position - buffer.startPosition) * buffer.speed);
+        }
+    }
+    return -1;
+}
@@ -7,32 +7,53 @@
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
-#include <queue>
 #include <string>
 #include <thread>
+#include <vector>
 #include "AudioRender.h"
+#include "ThreadSafeQueue.h"
 
-#define MAX_QUEUE_BUFFER_SIZE 3
+//待播放的 PCM 块数, 回调从中取数据, 解码器被它的背压控制节奏
+#define MAX_QUEUE_BUFFER_SIZE 6
+//同时送入 OpenSL 缓冲队列的块数
+#define AUDIO_SL_BUFFER_COUNT 2
+//缓冲池大小: 待播放队列 + OpenSL 中正在播放的块 + 解码器正在写入的块
+#define AUDIO_FRAME_POOL_SIZE (MAX_QUEUE_BUFFER_SIZE + AUDIO_SL_BUFFER_COUNT + 3)
+//每个缓冲块最多容纳的采样数(每声道), 44.1kHz 双声道 16bit 约 46ms
+#define AUDIO_FRAME_MAX_SAMPLES 2048
+#define AUDIO_FRAME_CAPACITY (AUDIO_FRAME_MAX_SAMPLES * 2 * 2)
+//待播放队列为空时送入的静音时长, 10ms
+#define AUDIO_SILENCE_SAMPLES 441
+//记录最近送入 OpenSL 的缓冲区, 用于把播放位置换算成时间戳
+#define ENQUEUED_BUFFER_RECORD_SIZE 8
 
 class OpenSLRender : public AudioRender
 {
 public:
-    OpenSLRender(){}
-    virtual ~OpenSLRender(){}
+    OpenSLRender();
+    virtual ~OpenSLRender();
     virtual void Init();
+    virtual void Play();
+    virtual void Pause();
     virtual void ClearAudioCache();
-    virtual void RenderAudioFrame(uint8_t* pData,int dataSize);
+    virtual AudioFrame* ObtainAudioFrame();
+    virtual void RenderAudioFrame(AudioFrame* audioFrame);
+    virtual void RenderAudioFrame(uint8_t* pData,int dataSize,long pts = -1,float speed = 1.0f,int tag = 0);
+    virtual long GetAudioClock(int *tag = nullptr);
     virtual void UnInit();
 
 private:
     int CreateEngine();
     int CreateOutputMixer();
     int CreateAudioPlayer();
-    int GetAudioFrameQueueSize();
     void StartRender();
     void HandleAudioFrameQueue();
+    //从待播放队列取一块送入 OpenSL, 队列空时送入一段静音, 不阻塞
+    void EnqueueAudioFrame();
+    void RecycleAudioFrame(AudioFrame *audioFrame);
     static void CreateSLWaitingThread(OpenSLRender* openSlRender);
     static void AudioPlayerCallback(SLAndroidSimpleBufferQueueItf bufferQueue,void* context);
+    void RecordEnqueuedBuffer(long pts, int dataSize, float speed, int tag);
 
     SLObjectItf m_EngineObj = nullptr;
     SLEngineItf m_EngineEngine = nullptr;
@@ -42,12 +63,40 @@ private:
     SLVolumeItf m_AudioPlayerVolume = nullptr;
     SLAndroidSimpleBufferQueueItf m_BufferQueue;
 
-    std::queue<AudioFrame*> m_AudioFrameQueue;
+    //缓冲池持有所有的块, 析构时释放. 块在 空闲 -> 待播放 -> OpenSL 播放中 -> 空闲 之间流转
+    std::vector<AudioFrame*> m_AudioFramePool;
+    ThreadSafeQueue<AudioFrame*> m_FreeFrameQueue;
+    ThreadSafeQueue<AudioFrame*> m_AudioFrameQueue;
+    //已经送入 OpenSL 的块, OpenSL 播放完之前不能复用, 按送入顺序归还
+    ThreadSafeQueue<AudioFrame*> m_PlayingFrameQueue;
 
     std::thread *m_thread = nullptr;
-    std::mutex m_Mutex;
-    std::condition_variable m_Cond;
     volatile bool m_Exit = false;
+
+    struct EnqueuedBuffer
+    {
+        long pts;
+        //该缓冲区在 OpenSL 播放位置中的起始位置(ms)
+        long startPosition;
+        float speed;
+        int tag;
+    };
+    EnqueuedBuffer m_EnqueuedBuffers[ENQUEUED_BUFFER_RECORD_SIZE];
+    int m_EnqueuedIndex = 0;
+    int64_t m_EnqueuedBytes = 0;
+    //最近送入的数据结束处的时间戳, 静音期间音频时钟停在这里
+    long m_EnqueuedEndPts = -1;
+    int m_EnqueuedEndTag = 0;
+    bool m_Starving = false;
+    //OpenSL 回调线程也会获取, 只保护时钟字段和播放请求, 持有时不调用 SetPlayState
+    std::mutex m_ClockMutex;
+    std::condition_variable m_PlayCond;
+    //串行化 SetPlayState 和播放器的销毁, 先于 m_ClockMutex 获取, 回调线程不使用
+    std::mutex m_StateMutex;
+    //两个锁都持有时修改, 持有其中一个即可读取
+    bool m_PlayRequested = false;
+    //只在 m_StateMutex 下访问
+    bool m_Started = false;
 };
 
 #endif //FFMPEGEXERCISE_OPENSLRENDER_H
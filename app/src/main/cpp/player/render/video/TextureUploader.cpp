@@ -0,0 +1,206 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "TextureUploader.h"
+#include <string.h>
+#include "ImageDef.h"
+#include "LogUtil.h"
+
+void TextureUploader::OnContextCreated()
+{
+    //surface 重建时上下文可能还是原来的, 先释放旧的纹理, PBO 和 fence
+    Release();
+    for (int i = 0; i < TEXTURE_NUM ; ++i)
+    {
+        CreateTexture(i);
+    }
+}
+
+void TextureUploader::Release()
+{
+    DeleteTextures();
+    DeletePbos();
+}
+
+int TextureUploader::GetTexturePlanes(int format, int width, int height, uint8_t *const *planes,
+                                      const int *lineSizes, TexturePlane *texPlanes)
+{
+    //GL_RG 的两个通道对应 NV12/NV21 交错存放的 UV
+    switch (format)
+    {
+        case IMAGE_FORMAT_RGBA:
+            texPlanes[0] = {GL_RGBA, width, height, 4, planes[0], lineSizes[0]};
+            return 1;
+        case IMAGE_FORMAT_NV21:
+        case IMAGE_FORMAT_NV12:
+            texPlanes[0] = {GL_RED, width, height, 1, planes[0], lineSizes[0]};
+            texPlanes[1] = {GL_RG, width >> 1, height >> 1, 2, planes[1], lineSizes[1]};
+            return 2;
+        case IMAGE_FORMAT_I420:
+            texPlanes[0] = {GL_RED, width, height, 1, planes[0], lineSizes[0]};
+            texPlanes[1] = {GL_RED, width >> 1, height >> 1, 1, planes[1], lineSizes[1]};
+            texPlanes[2] = {GL_RED, width >> 1, height >> 1, 1, planes[2], lineSizes[2]};
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+void TextureUploader::CreateTexture(int texUnit)
+{
+    glGenTextures(1, &m_TextureIds[texUnit]);
+    glActiveTexture(GL_TEXTURE0 + texUnit);
+    glBindTexture(GL_TEXTURE_2D, m_TextureIds[texUnit]);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+    m_TexFormat[texUnit] = GL_NONE;
+    m_TexWidth[texUnit] = 0;
+    m_TexHeight[texUnit] = 0;
+}
+
+void TextureUploader::DeleteTextures()
+{
+    for (int i = 0; i < TEXTURE_NUM; ++i)
+    {
+        if(m_TextureIds[i] != GL_NONE)
+            glDeleteTextures(1, &m_TextureIds[i]);
+        m_TextureIds[i] = GL_NONE;
+        m_TexFormat[i] = GL_NONE;
+        m_TexWidth[i] = 0;
+        m_TexHeight[i] = 0;
+    }
+}
+
+void TextureUploader::EnsureTextureStorage(int texUnit, const TexturePlane &plane)
+{
+    if(m_TexFormat[texUnit] == plane.format && m_TexWidth[texUnit] == plane.width && m_TexHeight[texUnit] == plane.height)
+        return;
+
+    LOGCATE("TextureUploader::EnsureTextureStorage texUnit=%d, [w, h]=[%d, %d], format=0x%x", texUnit, plane.width, plane.height, plane.format);
+    //glTexStorage2D 分配的存储不可变, 尺寸或格式变化时重新创建纹理
+    if(m_TexFormat[texUnit] != GL_NONE) {
+        glDeleteTextures(1, &m_TextureIds[texUnit]);
+        CreateTexture(texUnit);
+    }
+
+    GLenum internalFormat = GL_RGBA8;
+    if(plane.format == GL_RED) internalFormat = GL_R8;
+    else if(plane.format == GL_RG) internalFormat = GL_RG8;
+
+    glActiveTexture(GL_TEXTURE0 + texUnit);
+    glBindTexture(GL_TEXTURE_2D, m_TextureIds[texUnit]);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, plane.width, plane.height);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+    m_TexFormat[texUnit] = plane.format;
+    m_TexWidth[texUnit] = plane.width;
+    m_TexHeight[texUnit] = plane.height;
+}
+
+void TextureUploader::UploadPlane(int texUnit, const TexturePlane &plane, const void *pixels)
+{
+    //行宽按 linesize 指定, 跳过每行末尾的对齐填充
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, plane.lineSize / plane.pixelSize);
+    glActiveTexture(GL_TEXTURE0 + texUnit);
+    glBindTexture(GL_TEXTURE_2D, m_TextureIds[texUnit]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane.width, plane.height, plane.format, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+}
+
+bool TextureUploader::UploadPlanesByPbo(const TexturePlane *texPlanes, int planeCount)
+{
+    GLsizeiptr offsets[TEXTURE_NUM];
+    GLsizeiptr totalSize = 0;
+    for (int i = 0; i < planeCount; ++i) {
+        offsets[i] = totalSize;
+        totalSize += static_cast<GLsizeiptr>(texPlanes[i].lineSize) * texPlanes[i].height;
+    }
+
+    if(m_PboIds[0] == GL_NONE)
+        glGenBuffers(PBO_RING_SIZE, m_PboIds);
+
+    int index = m_PboIndex;
+    m_PboIndex = (m_PboIndex + 1) % PBO_RING_SIZE;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PboIds[index]);
+    if(m_PboSize[index] < totalSize) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+        m_PboSize[index] = totalSize;
+    }
+
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    if(m_PboFences[index] != nullptr) {
+        //这个缓冲区上一次的上传已经完成时可以不经同步直接映射, 否则交给驱动处理
+        GLenum result = glClientWaitSync(m_PboFences[index], 0, 0);
+        if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            access |= GL_MAP_UNSYNCHRONIZED_BIT;
+        glDeleteSync(m_PboFences[index]);
+        m_PboFences[index] = nullptr;
+    }
+
+    uint8_t *pBuffer = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalSize, access));
+    if(pBuffer == nullptr) {
+        LOGCATE("TextureUploader::UploadPlanesByPbo glMapBufferRange fail, glError=%d", glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+        return false;
+    }
+    for (int i = 0; i < planeCount; ++i) {
+        memcpy(pBuffer + offsets[i], texPlanes[i].data, static_cast<size_t>(texPlanes[i].lineSize) * texPlanes[i].height);
+    }
+    if(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+        LOGCATE("TextureUploader::UploadPlanesByPbo glUnmapBuffer fail");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+        return false;
+    }
+
+    //绑定 PBO 时 pixels 为缓冲区内的偏移, glTexSubImage2D 不等待拷贝完成就返回
+    for (int i = 0; i < planeCount; ++i) {
+        UploadPlane(i, texPlanes[i], reinterpret_cast<const void *>(offsets[i]));
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+    m_PboFences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+
+void TextureUploader::DeletePbos()
+{
+    for (int i = 0; i < PBO_RING_SIZE; ++i)
+    {
+        if(m_PboFences[i] != nullptr)
+            glDeleteSync(m_PboFences[i]);
+        m_PboFences[i] = nullptr;
+        m_PboSize[i] = 0;
+    }
+    if(m_PboIds[0] != GL_NONE)
+        glDeleteBuffers(PBO_RING_SIZE, m_PboIds);
+    for (int i = 0; i < PBO_RING_SIZE; ++i)
+    {
+        m_PboIds[i] = GL_NONE;
+    }
+    m_PboIndex = 0;
+}
+
+int TextureUploader::Upload(int format, int width, int height, uint8_t *const *planes, const int *lineSizes, int uploadMode)
+{
+    TexturePlane texPlanes[TEXTURE_NUM];
+    int planeCount = GetTexturePlanes(format, width, height, planes, lineSizes, texPlanes);
+    if(planeCount == 0)
+        return 0;
+
+    for (int i = 0; i < planeCount; ++i) {
+        EnsureTextureStorage(i, texPlanes[i]);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if(uploadMode != TEXTURE_UPLOAD_PBO || !UploadPlanesByPbo(texPlanes, planeCount)) {
+        for (int i = 0; i < planeCount; ++i) {
+            UploadPlane(i, texPlanes[i], texPlanes[i].data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return planeCount;
+}
@@ -0,0 +1,76 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_TEXTUREUPLOADER_H
+#define FFMPEGEXERCISE_TEXTUREUPLOADER_H
+
+#include <GLES3/gl3.h>
+#include <stdint.h>
+
+#define TEXTURE_NUM 3
+
+//纹理上传方式, 默认直接上传. PBO 方式在 GL 线程上多一次整帧 memcpy, TextureUploadBenchmark 在 llvmpipe 上
+//I420 1080p 直接上传 0.43ms, PBO 1.1ms(其中 memcpy 0.36ms); 4K 分别为 3.1ms 和 6.0ms(memcpy 2.5ms),
+//拷贝没有换来收益. 只作为在真机上对比的选项保留, 用 VideoGLRender::GetAverageUploadTime 比较
+#define TEXTURE_UPLOAD_DIRECT   0 //glTexSubImage2D 直接从内存同步上传
+#define TEXTURE_UPLOAD_PBO      1 //拷贝到 PBO 环再上传, 用 fence 判断缓冲区是否可以复用
+#define PBO_RING_SIZE           3
+
+//一个纹理对应的图像平面
+struct TexturePlane
+{
+    GLenum format;
+    int width;
+    int height;
+    int pixelSize;
+    const uint8_t *data;
+    int lineSize;
+};
+
+//把 RGBA/NV21/NV12/I420 图像的各个平面上传到 TEXTURE0 ~ TEXTURE2, 只依赖 GLES3, 只在 GL 线程调用
+class TextureUploader
+{
+public:
+    //新的 GL 上下文中重新创建纹理, 先释放旧的纹理和 PBO
+    void OnContextCreated();
+    //释放纹理和 PBO, 需要 GL 上下文仍然有效
+    void Release();
+    //返回上传的平面数, 格式不支持时返回 0
+    int Upload(int format, int width, int height, uint8_t *const *planes, const int *lineSizes, int uploadMode);
+
+    //texUnit 已经分配了存储, 可以绑定
+    bool HasTexture(int texUnit) {
+        return m_TexFormat[texUnit] != GL_NONE;
+    }
+
+    GLuint GetTextureId(int texUnit) {
+        return m_TextureIds[texUnit];
+    }
+
+    static int GetTexturePlanes(int format, int width, int height, uint8_t *const *planes,
+                                const int *lineSizes, TexturePlane *texPlanes);
+
+private:
+    void CreateTexture(int texUnit);
+    void DeleteTextures();
+    void EnsureTextureStorage(int texUnit, const TexturePlane &plane);
+    void UploadPlane(int texUnit, const TexturePlane &plane, const void *pixels);
+    //PBO 映射失败时返回 false, 调用者改为直接上传
+    bool UploadPlanesByPbo(const TexturePlane *texPlanes, int planeCount);
+    //删除 PBO 环和未完成的 fence
+    void DeletePbos();
+
+    GLuint m_TextureIds[TEXTURE_NUM] = {GL_NONE};
+    //纹理当前的存储, 用 glTexStorage2D 分配, 只在尺寸或格式变化时重新分配
+    GLenum m_TexFormat[TEXTURE_NUM] = {GL_NONE};
+    int m_TexWidth[TEXTURE_NUM] = {0};
+    int m_TexHeight[TEXTURE_NUM] = {0};
+
+    GLuint m_PboIds[PBO_RING_SIZE] = {GL_NONE};
+    GLsizeiptr m_PboSize[PBO_RING_SIZE] = {0};
+    GLsync m_PboFences[PBO_RING_SIZE] = {nullptr};
+    int m_PboIndex = 0;
+};
+
+#endif //FFMPEGEXERCISE_TEXTUREUPLOADER_H
@@ -6,6 +6,11 @@
 #include "GLUtils.h"
 #include <gtc/matrix_transform.hpp>
 
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/time.h>
+};
+
 VideoGLRender* VideoGLRender::s_Instance = nullptr;
 std::mutex VideoGLRender::m_Mutex;
 
@@ -21,7 +26,8 @@ static char vShaderStr[] =
         "   gl_Position = u_MVPMatrix * a_position;\n"
         "}";
 
-static char fShaderStr[] =
+//片段着色器按 IMAGE_FORMAT_XXX 生成不同的版本, 避免每个像素都按格式分支
+static const char fShaderHeader[] =
         "#version 300 es\n"
         "precision highp float;\n"
         "in vec2 v_texCoord;\n"
@@ -29,55 +35,53 @@ static char fShaderStr[] =
         "uniform sampler2D s_texture0;\n"
         "uniform sampler2D s_texture1;\n"
         "uniform sampler2D s_texture2;\n"
-        "uniform int u_nImgType;// 1:RGBA, 2:NV21, 3:NV12, 4:I420\n"
-        "\n"
+        "vec4 YuvToRgba(vec3 yuv)\n"
+        "{\n"
+        "    highp vec3 rgb = mat3(1.0,       1.0,     1.0,\n"
+        "                          0.0, \t-0.344, \t1.770,\n"
+        "                          1.403,  -0.714,     0.0) * yuv;\n"
+        "    return vec4(rgb, 1.0);\n"
+        "}\n";
+
+static const char fShaderRgbaMain[] =
+        "void main()\n"
+        "{\n"
+        "    outColor = texture(s_texture0, v_texCoord);\n"
+        "}";
+
+//UV 交错存放在 RG 纹理中, NV21 为 VU 顺序
+static const char fShaderNv21Main[] =
         "void main()\n"
         "{\n"
-        "\n"
-        "    if(u_nImgType == 1) //RGBA\n"
-        "    {\n"
-        "        outColor = texture(s_texture0, v_texCoord);\n"
-        "    }\n"
-        "    else if(u_nImgType == 2) //NV21\n"
-        "    {\n"
-        "        vec3 yuv;\n"
-        "        yuv.x = texture(s_texture0, v_texCoord).r;\n"
-        "        yuv.y = texture(s_texture1, v_texCoord).a - 0.5;\n"
-        "        yuv.z = texture(s_texture1, v_texCoord).r - 0.5;\n"
-        "        highp vec3 rgb = mat3(1.0,       1.0,     1.0,\n"
-        "        0.0, \t-0.344, \t1.770,\n"
-        "        1.403,  -0.714,     0.0) * yuv;\n"
-        "        outColor = vec4(rgb, 1.0);\n"
-        "\n"
-        "    }\n"
-        "    else if(u_nImgType == 3) //NV12\n"
-        "    {\n"
-        "        vec3 yuv;\n"
-        "        yuv.x = texture(s_texture0, v_texCoord).r;\n"
-        "        yuv.y = texture(s_texture1, v_texCoord).r - 0.5;\n"
-        "        yuv.z = texture(s_texture1, v_texCoord).a - 0.5;\n"
-        "        highp vec3 rgb = mat3(1.0,       1.0,     1.0,\n"
-        "        0.0, \t-0.344, \t1.770,\n"
-        "        1.403,  -0.714,     0.0) * yuv;\n"
-        "        outColor = vec4(rgb, 1.0);\n"
-        "    }\n"
-        "    else if(u_nImgType == 4) //I420\n"
-        "    {\n"
-        "        vec3 yuv;\n"
-        "        yuv.x = texture(s_texture0, v_texCoord).r;\n"
-        "        yuv.y = texture(s_texture1, v_texCoord).r - 0.5;\n"
-        "        yuv.z = texture(s_texture2, v_texCoord).r - 0.5;\n"
-        "        highp vec3 rgb = mat3(1.0,       1.0,     1.0,\n"
-        "                              0.0, \t-0.344, \t1.770,\n"
-        "                              1.403,  -0.714,     0.0) * yuv;\n"
-        "        outColor = vec4(rgb, 1.0);\n"
-        "    }\n"
-        "    else\n"
-        "    {\n"
-        "        outColor = vec4(1.0);\n"
-        "    }\n"
+        "    vec3 yuv;\n"
+        "    yuv.x = texture(s_texture0, v_texCoord).r;\n"
+        "    vec2 vu = texture(s_texture1, v_texCoord).rg;\n"
+        "    yuv.y = vu.y - 0.5;\n"
+        "    yuv.z = vu.x - 0.5;\n"
+        "    outColor = YuvToRgba(yuv);\n"
         "}";
 
+static const char fShaderNv12Main[] =
+        "void main()\n"
+        "{\n"
+        "    vec3 yuv;\n"
+        "    yuv.x = texture(s_texture0, v_texCoord).r;\n"
+        "    yuv.yz = texture(s_texture1, v_texCoord).rg - 0.5;\n"
+        "    outColor = YuvToRgba(yuv);\n"
+        "}";
+
+static const char fShaderI420Main[] =
+        "void main()\n"
+        "{\n"
+        "    vec3 yuv;\n"
+        "    yuv.x = texture(s_texture0, v_texCoord).r;\n"
+        "    yuv.y = texture(s_texture1, v_texCoord).r - 0.5;\n"
+        "    yuv.z = texture(s_texture2, v_texCoord).r - 0.5;\n"
+        "    outColor = YuvToRgba(yuv);\n"
+        "}";
+
+static const char *s_SamplerNames[TEXTURE_NUM] = {"s_texture0", "s_texture1", "s_texture2"};
+
 GLfloat verticesCoords[] = {
         -1.0f,  1.0f, 0.0f,  // Position 0
         -1.0f, -1.0f, 0.0f,  // Position 1
@@ -95,12 +99,18 @@ GLfloat textureCoords[] = {
 GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
 
 VideoGLRender::VideoGLRender():VideoRender(VIDEO_GL_RENDER){
-
+    for (int i = 0; i < FRAME_SLOT_NUM; ++i) {
+        m_FrameSlots[i] = av_frame_alloc();
+        m_SlotFormat[i] = 0;
+    }
 }
 
 VideoGLRender::~VideoGLRender()
 {
     NativeImageUtil::FreeNativeImage(&m_RenderImage);
+    for (int i = 0; i < FRAME_SLOT_NUM; ++i) {
+        av_frame_free(&m_FrameSlots[i]);
+    }
 }
 
 void VideoGLRender::Init(int width, int height, int *dstSize)
@@ -115,12 +125,23 @@ void VideoGLRender::Init(int width, int height, int *dstSize)
     UpdateMVPMatrix(0,0,1.0f,1.0f);
 }
 
+void VideoGLRender::OnVideoSizeChanged(int videoWidth, int videoHeight, int *dstSize)
+{
+    //纹理在上传时按帧的尺寸和格式重建, 这里不需要重新初始化, 保留当前的变换矩阵
+    LOGCATE("VideoGLRender::OnVideoSizeChanged [w, h]=[%d, %d]", videoWidth, videoHeight);
+    if(dstSize != nullptr)
+    {
+        dstSize[0] = videoWidth;
+        dstSize[1] = videoHeight;
+    }
+}
+
 void VideoGLRender::RenderVideoFrame(NativeImage *pImage)
 {
     if(pImage == nullptr || pImage->ppPlane[0] == nullptr)
         return;
     std::unique_lock<std::mutex> lock(m_Mutex);
-    if (pImage->width != m_RenderImage.width || pImage->height != m_RenderImage.height) {
+    if (pImage->width != m_RenderImage.width || pImage->height != m_RenderImage.height || pImage->format != m_RenderImage.format) {
         if (m_RenderImage.ppPlane[0] != nullptr) {
             NativeImageUtil::FreeNativeImage(&m_RenderImage);
         }
@@ -132,6 +153,130 @@ void VideoGLRender::RenderVideoFrame(NativeImage *pImage)
     }
 
     NativeImageUtil::CopyNativeImage(pImage, &m_RenderImage);
+    m_ImageFresh = true;
+
+    std::unique_lock<std::mutex> slotLock(m_SlotMutex);
+    m_UseFrameSlot = false;
+}
+
+bool VideoGLRender::RenderVideoFrame(AVFrame *frame, int format)
+{
+    if(frame == nullptr || frame->data[0] == nullptr)
+        return false;
+
+    int planeCount = 0;
+    switch (format) {
+        case IMAGE_FORMAT_RGBA: planeCount = 1; break;
+        case IMAGE_FORMAT_NV21:
+        case IMAGE_FORMAT_NV12: planeCount = 2; break;
+        case IMAGE_FORMAT_I420: planeCount = 3; break;
+        default: return false;
+    }
+    //GL_UNPACK_ROW_LENGTH 不支持倒序的行
+    for (int i = 0; i < planeCount; ++i) {
+        if(frame->data[i] == nullptr || frame->linesize[i] <= 0)
+            return false;
+    }
+
+    std::unique_lock<std::mutex> writeLock(m_WriteMutex);
+    //写入槽位只属于解码线程, 引用计数 +1, 不拷贝像素
+    AVFrame *slotFrame = m_FrameSlots[m_WriteSlot];
+    av_frame_unref(slotFrame);
+    if(av_frame_ref(slotFrame, frame) < 0) {
+        LOGCATE("VideoGLRender::RenderVideoFrame av_frame_ref fail");
+        return false;
+    }
+    m_SlotFormat[m_WriteSlot] = format;
+
+    std::unique_lock<std::mutex> slotLock(m_SlotMutex);
+    std::swap(m_WriteSlot, m_ReadySlot);
+    m_SlotFresh = true;
+    m_UseFrameSlot = true;
+    return true;
+}
+
+bool VideoGLRender::RequestRender()
+{
+    std::unique_lock<std::mutex> lock(m_SlotMutex);
+    if(m_RenderRequested)
+        return false;
+    m_RenderRequested = true;
+    return true;
+}
+
+bool VideoGLRender::AcquireDrawFrame(bool &useFrameSlot)
+{
+    std::unique_lock<std::mutex> lock(m_SlotMutex);
+    //之后提交的帧需要重新请求重绘
+    m_RenderRequested = false;
+    useFrameSlot = m_UseFrameSlot;
+    if(!m_SlotFresh)
+        return false;
+    //上一次绘制的帧换回 m_ReadySlot, 由解码线程下一次写入时释放
+    std::swap(m_DrawSlot, m_ReadySlot);
+    m_SlotFresh = false;
+    return true;
+}
+
+void VideoGLRender::UploadPlanes(int format, int width, int height, uint8_t *const *planes, const int *lineSizes)
+{
+    int64_t startTime = av_gettime_relative();
+    int uploadMode = m_UploadMode;
+    if(m_TextureUploader.Upload(format, width, height, planes, lineSizes, uploadMode) == 0)
+        return;
+
+    //统计渲染线程上提交上传的耗时, 切换上传方式之后重新统计
+    if(uploadMode != m_StatUploadMode) {
+        m_StatUploadMode = uploadMode;
+        m_StatUploadTime = 0;
+        m_StatUploadCount = 0;
+    }
+    m_StatUploadTime += av_gettime_relative() - startTime;
+    if(++m_StatUploadCount == UPLOAD_STAT_INTERVAL) {
+        m_AvgUploadTime = m_StatUploadTime / m_StatUploadCount;
+        LOGCATE("VideoGLRender::UploadPlanes mode=%d, [w, h]=[%d, %d], avg upload time=%ldus",
+                uploadMode, width, height, m_AvgUploadTime);
+        m_StatUploadTime = 0;
+        m_StatUploadCount = 0;
+    }
+}
+
+VideoGLRender::ProgramInfo *VideoGLRender::GetProgram(int format)
+{
+    const char *pMainSource = nullptr;
+    switch (format) {
+        case IMAGE_FORMAT_RGBA: pMainSource = fShaderRgbaMain; break;
+        case IMAGE_FORMAT_NV21: pMainSource = fShaderNv21Main; break;
+        case IMAGE_FORMAT_NV12: pMainSource = fShaderNv12Main; break;
+        case IMAGE_FORMAT_I420: pMainSource = fShaderI420Main; break;
+        default: return nullptr;
+    }
+
+    ProgramInfo &info = m_Programs[format];
+    if(info.program != GL_NONE)
+        return &info;
+    if(info.failed)
+        return nullptr;
+
+    //第一次用到这个格式时才创建(优先从磁盘缓存加载), 之后只查表
+    std::string fragSource = std::string(fShaderHeader) + pMainSource;
+    info.program = GLUtils::CreateProgramWithCache(vShaderStr, fragSource.c_str());
+    if(info.program == GL_NONE) {
+        LOGCATE("VideoGLRender::GetProgram create program fail, format=%d", format);
+        info.failed = true;
+        return nullptr;
+    }
+
+    //uniform 的位置只查询一次, 采样器绑定的纹理单元固定不变, 创建时设置一次
+    info.mvpMatrixLoc = glGetUniformLocation(info.program, "u_MVPMatrix");
+    info.mvpMatrixSet = false;
+    glUseProgram(info.program);
+    for (int i = 0; i < TEXTURE_NUM; ++i) {
+        GLint samplerLoc = glGetUniformLocation(info.program, s_SamplerNames[i]);
+        if(samplerLoc >= 0)
+            glUniform1i(samplerLoc, i);
+    }
+    return &info;
 }
 
 void VideoGLRender::UnInit() {
@@ -223,24 +368,13 @@ void VideoGLRender::UpdateMVPMatrix(TransformMatrix *pTransformMatrix) {
 
 void VideoGLRender::OnSurfaceCreated()
 {
-    m_ProgramObj = GLUtils::CreateProgram(vShaderStr,fShaderStr);
-    if (!m_ProgramObj)
+    //新的 GL 上下文中旧的 program 都已失效, 用到时重新创建
+    for (int i = 0; i < IMAGE_FORMAT_NUM; ++i)
     {
-        LOGCATE("VideoGLRender::OnSurfaceCreated create program fail");
-        return;
+        m_Programs[i] = ProgramInfo();
     }
 
-    glGenTextures(TEXTURE_NUM, m_TextureIds);
-    for (int i = 0; i < TEXTURE_NUM ; ++i)
-    {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_TextureIds[i]);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, GL_NONE);
-    }
+    m_TextureUploader.OnContextCreated();
 
     // Generate VBO Ids and load the VBOs with data
     glGenBuffers(3, m_VboIds);
@@ -271,6 +405,8 @@ void VideoGLRender::OnSurfaceCreated()
     glBindVertexArray(GL_NONE);
 
     m_TouchXY = vec2(0.5f, 0.5f);
+    //新的纹理需要重新上传当前帧
+    m_TextureDirty = true;
 }
 
 void VideoGLRender::OnSurfaceChanged(int w, int h)
@@ -284,95 +420,58 @@ void VideoGLRender::OnSurfaceChanged(int w, int h)
 
 void VideoGLRender::OnDrawFrame() {
     glClear(GL_COLOR_BUFFER_BIT);
-    if(m_ProgramObj == GL_NONE|| m_RenderImage.ppPlane[0] == nullptr) return;
-    LOGCATE("VideoGLRender::OnDrawFrame [w, h]=[%d, %d], format=%d", m_RenderImage.width, m_RenderImage.height, m_RenderImage.format);
-    m_FrameIndex++;
-
-//    if(m_FrameIndex == 2)
-//        NativeImageUtil::DumpNativeImage(&m_RenderImage, "/sdcard", "2222");
-
-    // upload image data
-    std::unique_lock<std::mutex> lock(m_Mutex);
-    switch (m_RenderImage.format)
-    {
-        case IMAGE_FORMAT_RGBA:
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_RenderImage.width, m_RenderImage.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_RenderImage.ppPlane[0]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-            break;
-        case IMAGE_FORMAT_NV21:
-        case IMAGE_FORMAT_NV12:
-            //upload Y plane data
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_RenderImage.width,
-                         m_RenderImage.height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                         m_RenderImage.ppPlane[0]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-            //update UV plane data
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, m_RenderImage.width >> 1,
-                         m_RenderImage.height >> 1, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
-                         m_RenderImage.ppPlane[1]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-            break;
-        case IMAGE_FORMAT_I420:
-            //upload Y plane data
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_RenderImage.width,
-                         m_RenderImage.height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                         m_RenderImage.ppPlane[0]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-            //update U plane data
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_RenderImage.width >> 1,
-                         m_RenderImage.height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                         m_RenderImage.ppPlane[1]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-            //update V plane data
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, m_TextureIds[2]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_RenderImage.width >> 1,
-                         m_RenderImage.height >> 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                         m_RenderImage.ppPlane[2]);
-            glBindTexture(GL_TEXTURE_2D, GL_NONE);
-            break;
-        default:
-            break;
+    //surface 还没有创建
+    if(m_VaoId == GL_NONE) return;
+
+    bool useFrameSlot = false;
+    bool frameAcquired = AcquireDrawFrame(useFrameSlot);
+
+    int width, height, format;
+    if(useFrameSlot) {
+        AVFrame *frame = m_FrameSlots[m_DrawSlot];
+        if(frame->data[0] == nullptr) return;
+        width = frame->width;
+        height = frame->height;
+        format = m_SlotFormat[m_DrawSlot];
+        //纹理保留着上一次上传的内容, 只有新帧才需要上传
+        if(frameAcquired || m_TextureDirty)
+            UploadPlanes(format, width, height, frame->data, frame->linesize);
+        m_TextureDirty = false;
+    } else {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if(m_RenderImage.ppPlane[0] == nullptr) return;
+        width = m_RenderImage.width;
+        height = m_RenderImage.height;
+        format = m_RenderImage.format;
+        if(m_ImageFresh || m_TextureDirty)
+            UploadPlanes(format, width, height, m_RenderImage.ppPlane, m_RenderImage.pLineSize);
+        m_ImageFresh = false;
+        m_TextureDirty = false;
     }
-    lock.unlock();
+    LOGCATE("VideoGLRender::OnDrawFrame [w, h]=[%d, %d], format=%d", width, height, format);
+    m_FrameIndex++;
 
+    ProgramInfo *program = GetProgram(format);
+    if(program == nullptr) return;
 
     // Use the program object
-    glUseProgram (m_ProgramObj);
+    glUseProgram (program->program);
 
     glBindVertexArray(m_VaoId);
 
-    GLUtils::setMat4(m_ProgramObj, "u_MVPMatrix", m_MVPMatrix);
+    //uniform 的值保存在 program 中, 只有变化时才需要重新设置
+    if(!program->mvpMatrixSet || program->mvpMatrix != m_MVPMatrix) {
+        glUniformMatrix4fv(program->mvpMatrixLoc, 1, GL_FALSE, &m_MVPMatrix[0][0]);
+        program->mvpMatrix = m_MVPMatrix;
+        program->mvpMatrixSet = true;
+    }
 
     for (int i = 0; i < TEXTURE_NUM; ++i) {
+        if(!m_TextureUploader.HasTexture(i)) continue;
         glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_TextureIds[i]);
-        char samplerName[64] = {0};
-        sprintf(samplerName, "s_texture%d", i);
-        GLUtils::setInt(m_ProgramObj, samplerName, i);
+        glBindTexture(GL_TEXTURE_2D, m_TextureUploader.GetTextureId(i));
     }
 
-    //float time = static_cast<float>(fmod(m_FrameIndex, 60) / 50);
-    //GLUtils::setFloat(m_ProgramObj, "u_Time", time);
-
-    float offset = (sin(m_FrameIndex * MATH_PI / 40) + 1.0f) / 2.0f;
-    GLUtils::setFloat(m_ProgramObj, "u_Offset", offset);
-    GLUtils::setVec2(m_ProgramObj, "u_TexSize", vec2(m_RenderImage.width, m_RenderImage.height));
-    GLUtils::setInt(m_ProgramObj, "u_nImgType", m_RenderImage.format);
-
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (const void *)0);
 
 }
@@ -390,6 +489,12 @@ VideoGLRender *VideoGLRender::GetInstance(){
     return s_Instance;
 }
 
+long VideoGLRender::GetInstanceAverageUploadTime()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return s_Instance != nullptr ? s_Instance->GetAverageUploadTime() : 0;
+}
+
 void VideoGLRender::ReleaseInstance()
 {
     if(s_Instance != nullptr)
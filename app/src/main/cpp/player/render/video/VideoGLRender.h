@@ -12,23 +12,45 @@
 #include <detail/type_mat4x4.hpp>
 #include <vec2.hpp>
 #include <BaseGLRender.h>
+#include "TextureUploader.h"
 
 using namespace glm;
 
 #define MATH_PI 3.1415926535897932384626433832802
-#define TEXTURE_NUM 3
+//解码线程写入, 最新帧, GL 线程上传 三个槽位
+#define FRAME_SLOT_NUM 3
+
+//每上传多少帧统计一次平均耗时
+#define UPLOAD_STAT_INTERVAL    120
+
+//按 IMAGE_FORMAT_XXX 索引 program
+#define IMAGE_FORMAT_NUM        (IMAGE_FORMAT_I420 + 1)
 
 class VideoGLRender: public VideoRender,public BaseGLRender
 {
 public:
     virtual void Init(int width,int height,int* dstSize);
     virtual void RenderVideoFrame(NativeImage* pImage);
+    virtual bool RenderVideoFrame(AVFrame *frame, int format);
     virtual void UnInit();
+    virtual void OnVideoSizeChanged(int videoWidth, int videoHeight, int *dstSize);
+    virtual bool RequestRender();
 
     virtual void OnSurfaceCreated();
     virtual void OnSurfaceChanged(int w,int h);
     virtual void OnDrawFrame();
 
+    //可以在播放过程中切换, 下一次上传时生效
+    void SetUploadMode(int uploadMode) {
+        m_UploadMode = uploadMode;
+    }
+    //渲染线程上每帧纹理上传的平均耗时(us)
+    long GetAverageUploadTime() {
+        return m_AvgUploadTime;
+    }
+    //不创建单例, 还没有创建 GL 渲染器时返回 0
+    static long GetInstanceAverageUploadTime();
+
     static VideoGLRender* GetInstance();
     static void ReleaseInstance();
 
@@ -43,13 +65,56 @@ private:
     VideoGLRender();
     virtual ~VideoGLRender();
 
+    //取出最新发布的帧, 没有新帧时返回 false, useFrameSlot 返回当前是否使用帧槽位
+    bool AcquireDrawFrame(bool &useFrameSlot);
+    //每种图像格式一个 program, 以及它的 uniform 位置和当前值
+    struct ProgramInfo
+    {
+        GLuint program = GL_NONE;
+        bool failed = false;
+        GLint mvpMatrixLoc = -1;
+        glm::mat4 mvpMatrix;
+        bool mvpMatrixSet = false;
+    };
+
+    //没有对应的 program 或者创建失败时返回 nullptr, 只在 GL 线程调用
+    ProgramInfo *GetProgram(int format);
+    void UploadPlanes(int format, int width, int height, uint8_t *const *planes, const int *lineSizes);
+
     static std::mutex m_Mutex;
     static VideoGLRender* s_Instance;
-    GLuint m_ProgramObj = GL_NONE;
-    GLuint m_TextureIds[TEXTURE_NUM];
-    GLuint m_VaoId;
+    ProgramInfo m_Programs[IMAGE_FORMAT_NUM];
+    TextureUploader m_TextureUploader;
+    GLuint m_VaoId = GL_NONE;
     GLuint m_VboIds[3];
     NativeImage m_RenderImage;
+    //m_RenderImage 有未上传的新内容, 用 m_Mutex 保护
+    bool m_ImageFresh = false;
+
+    //三缓冲的帧槽位: 解码线程只访问 m_WriteSlot, GL 线程只访问 m_DrawSlot,
+    //两者通过 m_ReadySlot 交换, m_SlotMutex 只在交换下标时持有
+    AVFrame *m_FrameSlots[FRAME_SLOT_NUM];
+    int m_SlotFormat[FRAME_SLOT_NUM];
+    int m_WriteSlot = 0;
+    int m_ReadySlot = 1;
+    int m_DrawSlot = 2;
+    bool m_SlotFresh = false;
+    //已经请求重绘, 等待 OnDrawFrame 处理
+    bool m_RenderRequested = false;
+    //最近一次提交的是 AVFrame 还是 NativeImage
+    bool m_UseFrameSlot = false;
+    std::mutex m_SlotMutex;
+    //串行化多个生产者, 无缝切换时前后两个解码器可能同时提交
+    std::mutex m_WriteMutex;
+    //只在 GL 线程访问
+    bool m_TextureDirty = false;
+
+    volatile int m_UploadMode = TEXTURE_UPLOAD_DIRECT;
+
+    int m_StatUploadMode = TEXTURE_UPLOAD_DIRECT;
+    int64_t m_StatUploadTime = 0;
+    int m_StatUploadCount = 0;
+    volatile long m_AvgUploadTime = 0;
     glm::mat4 m_MVPMatrix;
 
     int m_FrameIndex;
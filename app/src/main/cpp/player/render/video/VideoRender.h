@@ -11,6 +11,8 @@
 
 #include "ImageDef.h"
 
+struct AVFrame;
+
 class VideoRender {
 public:
     VideoRender(int type){
@@ -19,7 +21,21 @@ public:
     virtual ~VideoRender(){}
     virtual void Init(int videoWidth, int videoHeight, int *dstSize) = 0;
     virtual void RenderVideoFrame(NativeImage *pImage) = 0;
+    //零拷贝渲染解码帧, 渲染器持有 frame 的引用, format 为 IMAGE_FORMAT_XXX.
+    //不支持时返回 false, 调用者退回到 NativeImage 拷贝的方式
+    virtual bool RenderVideoFrame(AVFrame *frame, int format) {
+        return false;
+    }
     virtual void UnInit() = 0;
+    //解码过程中视频尺寸改变, 默认重新初始化. 可以直接适应新尺寸的渲染器只需要返回 dstSize
+    virtual void OnVideoSizeChanged(int videoWidth, int videoHeight, int *dstSize) {
+        Init(videoWidth, videoHeight, dstSize);
+    }
+    //提交新的一帧之后调用, 返回 true 时需要通知上层请求重绘.
+    //上一次的请求还没有被处理时返回 false, 避免重复请求
+    virtual bool RequestRender() {
+        return false;
+    }
 
     int GetRenderType() {
         return m_RenderType;
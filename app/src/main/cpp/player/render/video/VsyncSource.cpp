@@ -0,0 +1,76 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "VsyncSource.h"
+#include <chrono>
+#include "LogUtil.h"
+
+void VsyncPeriodEstimator::Reset()
+{
+    m_LastVsyncTime = -1;
+    m_IntervalCount = 0;
+    m_IntervalIndex = 0;
+    m_Period = DEFAULT_VSYNC_PERIOD;
+}
+
+void VsyncPeriodEstimator::OnVsync(int64_t vsyncTime)
+{
+    int64_t interval = m_LastVsyncTime >= 0 ? vsyncTime - m_LastVsyncTime : 0;
+    m_LastVsyncTime = vsyncTime;
+    if(interval <= 0 || interval > VSYNC_MAX_INTERVAL)
+        return;
+
+    m_Intervals[m_IntervalIndex] = interval;
+    m_IntervalIndex = (m_IntervalIndex + 1) % VSYNC_PERIOD_WINDOW;
+    if(m_IntervalCount < VSYNC_PERIOD_WINDOW)
+        m_IntervalCount++;
+
+    int64_t base = m_Intervals[0];
+    for (int i = 1; i < m_IntervalCount; ++i)
+    {
+        if(m_Intervals[i] < base)
+            base = m_Intervals[i];
+    }
+
+    //掉帧造成的间隔不参与平均
+    int64_t sum = 0;
+    int count = 0;
+    for (int i = 0; i < m_IntervalCount; ++i)
+    {
+        if(m_Intervals[i] < base * 3 / 2)
+        {
+            sum += m_Intervals[i];
+            count++;
+        }
+    }
+    m_Period = sum / count;
+}
+
+ChoreographerVsyncSource *ChoreographerVsyncSource::GetInstance()
+{
+    static ChoreographerVsyncSource s_Instance;
+    return &s_Instance;
+}
+
+void ChoreographerVsyncSource::OnVsync(int64_t frameTimeNanos)
+{
+    int64_t vsyncTime = frameTimeNanos / 1000;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_PeriodEstimator.OnVsync(vsyncTime);
+    m_VsyncTime = vsyncTime;
+    m_VsyncCount++;
+    m_Cond.notify_all();
+}
+
+bool ChoreographerVsyncSource::WaitForVsync(int64_t timeout, int64_t &vsyncTime, int64_t &vsyncPeriod)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    uint64_t vsyncCount = m_VsyncCount;
+    if(!m_Cond.wait_for(lock, std::chrono::microseconds(timeout), [&]{ return m_VsyncCount != vsyncCount; }))
+        return false;
+
+    vsyncTime = m_VsyncTime;
+    vsyncPeriod = m_PeriodEstimator.GetPeriod();
+    return true;
+}
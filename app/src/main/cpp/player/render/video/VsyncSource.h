@@ -0,0 +1,75 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_VSYNCSOURCE_H
+#define FFMPEGEXERCISE_VSYNCSOURCE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+
+//没有测量到刷新周期时假定 60Hz
+#define DEFAULT_VSYNC_PERIOD 16667 //us
+//估计刷新周期时参考最近多少个 vsync 间隔
+#define VSYNC_PERIOD_WINDOW 16
+//超过该值的间隔认为是界面不可见造成的中断, 不参与估计
+#define VSYNC_MAX_INTERVAL 100000 //us
+
+//显示刷新(vsync)的时间源, 视频按 vsync 选择送显的帧.
+//时间单位为 us, 与 av_gettime_relative 同一时基(CLOCK_MONOTONIC), 测试时可以替换为模拟的时间源
+class VsyncSource
+{
+public:
+    virtual ~VsyncSource() {}
+
+    //阻塞到下一次 vsync, 返回该 vsync 的时间和刷新周期. 超过 timeout 没有 vsync 时返回 false
+    virtual bool WaitForVsync(int64_t timeout, int64_t &vsyncTime, int64_t &vsyncPeriod) = 0;
+};
+
+//由相邻 vsync 的间隔估计刷新周期.
+//窗口内的最小间隔作为基准, 掉帧只会让间隔变成周期的整数倍, 不影响基准; 小于 1.5 倍基准的间隔取平均得到周期.
+//刷新率降低(如 60Hz 切换到 30Hz)时旧的间隔移出窗口后基准随之改变, 不会因为新的间隔都被当作掉帧而停在 16.7ms
+class VsyncPeriodEstimator
+{
+public:
+    void Reset();
+
+    //vsyncTime 单位为 us
+    void OnVsync(int64_t vsyncTime);
+
+    int64_t GetPeriod()
+    {
+        return m_Period;
+    }
+
+private:
+    int64_t m_LastVsyncTime = -1;
+    int64_t m_Intervals[VSYNC_PERIOD_WINDOW] = {0};
+    int m_IntervalCount = 0;
+    int m_IntervalIndex = 0;
+    int64_t m_Period = DEFAULT_VSYNC_PERIOD;
+};
+
+//由 Java 层 Choreographer.FrameCallback 推送 vsync 的时间源, 界面不可见时没有 vsync
+class ChoreographerVsyncSource : public VsyncSource
+{
+public:
+    static ChoreographerVsyncSource *GetInstance();
+
+    //frameTimeNanos 为 System.nanoTime 时基, 即 CLOCK_MONOTONIC
+    void OnVsync(int64_t frameTimeNanos);
+
+    virtual bool WaitForVsync(int64_t timeout, int64_t &vsyncTime, int64_t &vsyncPeriod);
+
+private:
+    ChoreographerVsyncSource() {}
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Cond;
+    int64_t m_VsyncTime = -1;
+    VsyncPeriodEstimator m_PeriodEstimator;
+    uint64_t m_VsyncCount = 0;
+};
+
+#endif //FFMPEGEXERCISE_VSYNCSOURCE_H
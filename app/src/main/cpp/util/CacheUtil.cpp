@@ -0,0 +1,75 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "CacheUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "LogUtil.h"
+
+char CacheUtil::s_CacheDir[CACHE_DIR_MAX_PATH] = {0};
+std::mutex CacheUtil::s_Mutex;
+
+void CacheUtil::SetCacheDir(const char *cacheDir)
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    if(cacheDir == nullptr)
+    {
+        s_CacheDir[0] = '\0';
+        return;
+    }
+    strncpy(s_CacheDir, cacheDir, CACHE_DIR_MAX_PATH - 1);
+    s_CacheDir[CACHE_DIR_MAX_PATH - 1] = '\0';
+    LOGCATE("CacheUtil::SetCacheDir cacheDir=%s", s_CacheDir);
+}
+
+bool CacheUtil::GetFileCachePath(const char *url, const char *suffix, char *path, int size)
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    if(s_CacheDir[0] == '\0' || url == nullptr)
+        return false;
+
+    struct stat fileStat;
+    if(stat(url, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+        return false;
+
+    //文件标识: 路径 + 大小 + 修改时间
+    int64_t fileSize = fileStat.st_size;
+    int64_t modifyTime = fileStat.st_mtime;
+    uint64_t key = Hash(url, strlen(url));
+    key = Hash(&fileSize, sizeof(fileSize), key);
+    key = Hash(&modifyTime, sizeof(modifyTime), key);
+
+    int ret = snprintf(path, size, "%s/%016llx%s", s_CacheDir, (unsigned long long)key, suffix);
+    return ret > 0 && ret < size;
+}
+
+bool CacheUtil::GetCachePath(const char *key, const char *suffix, char *path, int size)
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    if(s_CacheDir[0] == '\0' || key == nullptr)
+        return false;
+
+    uint64_t hash = Hash(key, strlen(key));
+    int ret = snprintf(path, size, "%s/%016llx%s", s_CacheDir, (unsigned long long)hash, suffix);
+    return ret > 0 && ret < size;
+}
+
+void CacheUtil::GetCacheDir(char *cacheDir, int size)
+{
+    std::unique_lock<std::mutex> lock(s_Mutex);
+    snprintf(cacheDir, size, "%s", s_CacheDir);
+}
+
+uint64_t CacheUtil::Hash(const void *data, int length, uint64_t seed)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed;
+    for (int i = 0; i < length; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
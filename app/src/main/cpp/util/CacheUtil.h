@@ -0,0 +1,36 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_CACHEUTIL_H
+#define FFMPEGEXERCISE_CACHEUTIL_H
+
+#include <stdint.h>
+#include <mutex>
+
+#define CACHE_DIR_MAX_PATH 1024
+
+//本地缓存文件(关键帧索引等)的路径管理, 缓存目录由 Java 层设置
+class CacheUtil {
+public:
+    static void SetCacheDir(const char *cacheDir);
+
+    //根据文件路径、大小和修改时间生成缓存文件路径, 文件变化后自动失效.
+    //非本地文件或者没有设置缓存目录时返回 false
+    static bool GetFileCachePath(const char *url, const char *suffix, char *path, int size);
+
+    //根据任意 key(例如网络地址) 生成缓存文件路径, 没有设置缓存目录时返回 false
+    static bool GetCachePath(const char *key, const char *suffix, char *path, int size);
+
+    //没有设置时返回空字符串
+    static void GetCacheDir(char *cacheDir, int size);
+
+    //FNV-1a
+    static uint64_t Hash(const void *data, int length, uint64_t seed = 14695981039346656037ULL);
+
+private:
+    static char s_CacheDir[CACHE_DIR_MAX_PATH];
+    static std::mutex s_Mutex;
+};
+
+#endif //FFMPEGEXERCISE_CACHEUTIL_H
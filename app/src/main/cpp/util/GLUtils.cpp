@@ -7,6 +7,22 @@
 #include <stdlib.h>
 #include <cstring>
 #include <GLES2/gl2ext.h>
+#include <stdio.h>
+#include <vector>
+#include "CacheUtil.h"
+
+//program 二进制缓存文件头, 后面紧跟 length 字节的二进制
+struct ProgramBinaryHeader
+{
+    char magic[4];
+    int32_t version;
+    uint64_t keyHash;
+    uint32_t binaryFormat;
+    int32_t length;
+};
+
+static const char PROGRAM_BINARY_MAGIC[4] = {'G', 'L', 'P', 'B'};
+#define PROGRAM_BINARY_VERSION 1
 
 GLuint GLUtils::LoadShader(GLenum shaderType, const char *pSource)
 {
@@ -41,7 +57,7 @@ GLuint GLUtils::LoadShader(GLenum shaderType, const char *pSource)
     return shader;
 }
 
-GLuint GLUtils::CreateProgram(const char *pVertexShaderSource, const char *pFragShaderSource, GLuint &vertexShaderHandle, GLuint &fragShaderHandle)
+GLuint GLUtils::CreateProgram(const char *pVertexShaderSource, const char *pFragShaderSource, GLuint &vertexShaderHandle, GLuint &fragShaderHandle, bool binaryRetrievable)
 {
     GLuint program = 0;
     FUN_BEGIN_TIME("GLUtils::CreateProgram")
@@ -57,6 +73,8 @@ GLuint GLUtils::CreateProgram(const char *pVertexShaderSource, const char *pFrag
         CheckGLError("glAttachShader");
         glAttachShader(program, fragShaderHandle);
         CheckGLError("glAttachShader");
+        if (binaryRetrievable)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(program);
         GLint linkStatus = GL_FALSE;
         glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
@@ -169,3 +187,139 @@ GLuint GLUtils::CreateProgram(const char *pVertexShaderSource, const char *pFrag
     GLuint vertexShaderHandle, fragShaderHandle;
     return CreateProgram(pVertexShaderSource, pFragShaderSource, vertexShaderHandle, fragShaderHandle);
 }
+
+GLuint GLUtils::CreateProgramWithCache(const char *pVertexShaderSource, const char *pFragShaderSource)
+{
+    char path[1024] = {0};
+    uint64_t keyHash = 0;
+    if (!GetProgramCachePath(pVertexShaderSource, pFragShaderSource, path, sizeof(path), keyHash))
+        return CreateProgram(pVertexShaderSource, pFragShaderSource);
+
+    GLuint program = LoadProgramBinary(path, keyHash);
+    if (program)
+        return program;
+
+    GLuint vertexShaderHandle, fragShaderHandle;
+    program = CreateProgram(pVertexShaderSource, pFragShaderSource, vertexShaderHandle, fragShaderHandle, true);
+    if (program)
+        SaveProgramBinary(program, path, keyHash);
+    return program;
+}
+
+bool GLUtils::GetProgramCachePath(const char *pVertexShaderSource, const char *pFragShaderSource,
+                                  char *path, int size, uint64_t &keyHash)
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0)
+        return false;
+
+    //驱动升级之后旧的二进制不能再用, key 中包含驱动的标识
+    const char *renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    uint64_t sourceHash = CacheUtil::Hash(pVertexShaderSource, strlen(pVertexShaderSource));
+    sourceHash = CacheUtil::Hash(pFragShaderSource, strlen(pFragShaderSource), sourceHash);
+
+    char key[512] = {0};
+    snprintf(key, sizeof(key), "%s|%s|%016llx", renderer ? renderer : "", version ? version : "",
+             (unsigned long long)sourceHash);
+    keyHash = CacheUtil::Hash(key, strlen(key));
+    return CacheUtil::GetCachePath(key, ".glbin", path, size);
+}
+
+GLuint GLUtils::LoadProgramBinary(const char *path, uint64_t keyHash)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return 0;
+
+    GLuint program = 0;
+    FUN_BEGIN_TIME("GLUtils::LoadProgramBinary")
+    do{
+        ProgramBinaryHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1)
+            break;
+
+        if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != PROGRAM_BINARY_VERSION || header.keyHash != keyHash || header.length <= 0)
+        {
+            LOGCATE("GLUtils::LoadProgramBinary invalid header. path=%s", path);
+            break;
+        }
+
+        std::vector<uint8_t> binary(header.length);
+        if (fread(&binary[0], 1, header.length, file) != (size_t)header.length)
+        {
+            LOGCATE("GLUtils::LoadProgramBinary truncated. path=%s", path);
+            break;
+        }
+
+        program = glCreateProgram();
+        if (!program)
+            break;
+
+        //驱动可以拒绝任何二进制, 此时按链接失败处理, 调用者重新编译
+        glProgramBinary(program, header.binaryFormat, &binary[0], header.length);
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus != GL_TRUE)
+        {
+            LOGCATE("GLUtils::LoadProgramBinary glProgramBinary fail. path=%s", path);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }while (false);
+    FUN_END_TIME("GLUtils::LoadProgramBinary")
+
+    fclose(file);
+    if (!program)
+        remove(path);
+    LOGCATE("GLUtils::LoadProgramBinary program = %d", program);
+    return program;
+}
+
+void GLUtils::SaveProgramBinary(GLuint program, const char *path, uint64_t keyHash)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<uint8_t> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &length, &binaryFormat, &binary[0]);
+    if (length <= 0)
+    {
+        LOGCATE("GLUtils::SaveProgramBinary glGetProgramBinary fail");
+        return;
+    }
+
+    char tmpPath[1024] = {0};
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *file = fopen(tmpPath, "wb");
+    if (file == nullptr)
+    {
+        LOGCATE("GLUtils::SaveProgramBinary fopen fail. path=%s", tmpPath);
+        return;
+    }
+
+    ProgramBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_BINARY_VERSION;
+    header.keyHash = keyHash;
+    header.binaryFormat = binaryFormat;
+    header.length = length;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success = success && fwrite(&binary[0], 1, length, file) == (size_t)length;
+    success = fclose(file) == 0 && success;
+
+    if (!success || rename(tmpPath, path) != 0)
+    {
+        LOGCATE("GLUtils::SaveProgramBinary write fail. path=%s", path);
+        remove(tmpPath);
+        return;
+    }
+    LOGCATE("GLUtils::SaveProgramBinary path=%s, length=%d", path, length);
+}
@@ -13,12 +13,18 @@ class GLUtils {
 public:
     static GLuint LoadShader(GLenum shaderType, const char *pSource);
 
+    //binaryRetrievable 为 true 时链接之后可以用 glGetProgramBinary 取出二进制
     static GLuint CreateProgram(const char *pVertexShaderSource, const char *pFragShaderSource,
                                 GLuint &vertexShaderHandle,
-                                GLuint &fragShaderHandle);
+                                GLuint &fragShaderHandle,
+                                bool binaryRetrievable = false);
 
     static GLuint CreateProgram(const char *pVertexShaderSource, const char *pFragShaderSource);
 
+    //优先加载磁盘上缓存的 program 二进制, 缓存以着色器源码和驱动的 GL_RENDERER/GL_VERSION 为 key,
+    //没有缓存或者加载失败时从源码编译并写入缓存. 没有设置缓存目录时等同于 CreateProgram
+    static GLuint CreateProgramWithCache(const char *pVertexShaderSource, const char *pFragShaderSource);
+
     static GLuint CreateProgramWithFeedback(
             const char *pVertexShaderSource,
             const char *pFragShaderSource,
@@ -29,6 +35,14 @@ public:
 
     static void DeleteProgram(GLuint &program);
 
+private:
+    static bool GetProgramCachePath(const char *pVertexShaderSource, const char *pFragShaderSource,
+                                    char *path, int size, uint64_t &keyHash);
+    static GLuint LoadProgramBinary(const char *path, uint64_t keyHash);
+    static void SaveProgramBinary(GLuint program, const char *path, uint64_t keyHash);
+
+public:
+
     static void CheckGLError(const char *pGLOperation);
 
     static void setBool(GLuint programId, const std::string &name, bool value) {
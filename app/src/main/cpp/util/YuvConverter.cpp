@@ -0,0 +1,261 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include "YuvConverter.h"
+#include "ImageDef.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_CONVERTER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_CONVERTER_SSE2
+#endif
+
+//一次处理的像素数, 行尾不足的部分用标量实现
+#define YUV_CONVERTER_BLOCK 16
+
+//Q6 定点系数: R = Y' + vr*V', G = Y' - ug*U' - vg*V', B = Y' + ub*U', Y' = (Y - yOffset) * yCoef
+struct YuvCoefficients
+{
+    int16_t yOffset;
+    int16_t yCoef;
+    int16_t vr;
+    int16_t ug;
+    int16_t vg;
+    int16_t ub;
+};
+
+//[colorSpace][colorRange]
+static const YuvCoefficients s_Coefficients[2][2] = {
+        {{16, 75, 102, 25, 52, 129}, {0, 64, 90, 22, 46, 113}},  //BT.601
+        {{16, 75, 115, 14, 34, 135}, {0, 64, 101, 12, 30, 119}}, //BT.709
+};
+
+//标量实现按 SIMD 的 16 位饱和运算取整, 保证各个实现的输出一致
+static inline int Saturate16(int value)
+{
+    return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+static inline uint8_t ClampShift(int value)
+{
+    value >>= 6;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+//uvStep 为 1 时 U/V 是两个独立的平面(I420), 为 2 时是交错存放的一个平面(NV12/NV21)
+static void ConvertRowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                             uint8_t *dst, int start, int width, const YuvCoefficients &c)
+{
+    for (int x = start; x < width; ++x)
+    {
+        int uvIndex = (x >> 1) * uvStep;
+        int ys = (y[x] - c.yOffset) * c.yCoef + 32;
+        int us = u[uvIndex] - 128;
+        int vs = v[uvIndex] - 128;
+        uint8_t *pixel = dst + x * 4;
+        pixel[0] = ClampShift(Saturate16(ys + c.vr * vs));
+        pixel[1] = ClampShift(Saturate16(Saturate16(ys - c.ug * us) - c.vg * vs));
+        pixel[2] = ClampShift(Saturate16(ys + c.ub * us));
+        pixel[3] = 255;
+    }
+}
+
+#if defined(YUV_CONVERTER_NEON)
+
+static inline void ConvertHalfNeon(uint8x8_t y, uint8x8_t u, uint8x8_t v, const YuvCoefficients &c,
+                                   uint8x8_t &r, uint8x8_t &g, uint8x8_t &b)
+{
+    int16x8_t ys = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y)), vdupq_n_s16(c.yOffset));
+    ys = vaddq_s16(vmulq_n_s16(ys, c.yCoef), vdupq_n_s16(32));
+    int16x8_t us = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u)), vdupq_n_s16(128));
+    int16x8_t vs = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(128));
+
+    r = vqshrun_n_s16(vqaddq_s16(ys, vmulq_n_s16(vs, c.vr)), 6);
+    g = vqshrun_n_s16(vqsubq_s16(vqsubq_s16(ys, vmulq_n_s16(us, c.ug)), vmulq_n_s16(vs, c.vg)), 6);
+    b = vqshrun_n_s16(vqaddq_s16(ys, vmulq_n_s16(us, c.ub)), 6);
+}
+
+static int ConvertRowSimd(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                          uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    int x = 0;
+    for (; x + YUV_CONVERTER_BLOCK <= width; x += YUV_CONVERTER_BLOCK)
+    {
+        uint8x16_t y16 = vld1q_u8(y + x);
+        uint8x8_t u8, v8;
+        if(uvStep == 1)
+        {
+            u8 = vld1_u8(u + x / 2);
+            v8 = vld1_u8(v + x / 2);
+        }
+        else
+        {
+            //NV12 时 u 指向 UV 平面, NV21 时 v 指向 VU 平面, 交错的两个通道按地址先后区分
+            const uint8_t *uv = u < v ? u : v;
+            uint8x8x2_t chroma = vld2_u8(uv + x);
+            u8 = u < v ? chroma.val[0] : chroma.val[1];
+            v8 = u < v ? chroma.val[1] : chroma.val[0];
+        }
+        //每个色度样本对应水平两个像素
+        uint8x8x2_t uu = vzip_u8(u8, u8);
+        uint8x8x2_t vv = vzip_u8(v8, v8);
+
+        uint8x8_t rLo, gLo, bLo, rHi, gHi, bHi;
+        ConvertHalfNeon(vget_low_u8(y16), uu.val[0], vv.val[0], c, rLo, gLo, bLo);
+        ConvertHalfNeon(vget_high_u8(y16), uu.val[1], vv.val[1], c, rHi, gHi, bHi);
+
+        uint8x16x4_t rgba;
+        rgba.val[0] = vcombine_u8(rLo, rHi);
+        rgba.val[1] = vcombine_u8(gLo, gHi);
+        rgba.val[2] = vcombine_u8(bLo, bHi);
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    return x;
+}
+
+#elif defined(YUV_CONVERTER_SSE2)
+
+static inline __m128i ConvertChannelSse2(__m128i lo, __m128i hi)
+{
+    return _mm_packus_epi16(_mm_srai_epi16(lo, 6), _mm_srai_epi16(hi, 6));
+}
+
+static int ConvertRowSimd(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                          uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yOffset = _mm_set1_epi16(c.yOffset);
+    const __m128i yCoef = _mm_set1_epi16(c.yCoef);
+    const __m128i round = _mm_set1_epi16(32);
+    const __m128i uvOffset = _mm_set1_epi16(128);
+    const __m128i vr = _mm_set1_epi16(c.vr);
+    const __m128i ug = _mm_set1_epi16(c.ug);
+    const __m128i vg = _mm_set1_epi16(c.vg);
+    const __m128i ub = _mm_set1_epi16(c.ub);
+    const __m128i lowByteMask = _mm_set1_epi16(0x00FF);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+    int x = 0;
+    for (; x + YUV_CONVERTER_BLOCK <= width; x += YUV_CONVERTER_BLOCK)
+    {
+        __m128i y16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+        __m128i u8, v8;
+        if(uvStep == 1)
+        {
+            u8 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2)), zero);
+            v8 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2)), zero);
+        }
+        else
+        {
+            //NV12 时 u 指向 UV 平面, NV21 时 v 指向 VU 平面, 交错的两个通道按地址先后区分
+            const uint8_t *uv = u < v ? u : v;
+            __m128i chroma = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + x));
+            __m128i first = _mm_and_si128(chroma, lowByteMask);
+            __m128i second = _mm_srli_epi16(chroma, 8);
+            u8 = u < v ? first : second;
+            v8 = u < v ? second : first;
+        }
+        __m128i us = _mm_sub_epi16(u8, uvOffset);
+        __m128i vs = _mm_sub_epi16(v8, uvOffset);
+        //每个色度样本对应水平两个像素
+        __m128i usLo = _mm_unpacklo_epi16(us, us), usHi = _mm_unpackhi_epi16(us, us);
+        __m128i vsLo = _mm_unpacklo_epi16(vs, vs), vsHi = _mm_unpackhi_epi16(vs, vs);
+
+        __m128i ysLo = _mm_sub_epi16(_mm_unpacklo_epi8(y16, zero), yOffset);
+        __m128i ysHi = _mm_sub_epi16(_mm_unpackhi_epi8(y16, zero), yOffset);
+        ysLo = _mm_add_epi16(_mm_mullo_epi16(ysLo, yCoef), round);
+        ysHi = _mm_add_epi16(_mm_mullo_epi16(ysHi, yCoef), round);
+
+        __m128i r = ConvertChannelSse2(_mm_adds_epi16(ysLo, _mm_mullo_epi16(vsLo, vr)),
+                                       _mm_adds_epi16(ysHi, _mm_mullo_epi16(vsHi, vr)));
+        __m128i g = ConvertChannelSse2(_mm_subs_epi16(_mm_subs_epi16(ysLo, _mm_mullo_epi16(usLo, ug)), _mm_mullo_epi16(vsLo, vg)),
+                                       _mm_subs_epi16(_mm_subs_epi16(ysHi, _mm_mullo_epi16(usHi, ug)), _mm_mullo_epi16(vsHi, vg)));
+        __m128i b = ConvertChannelSse2(_mm_adds_epi16(ysLo, _mm_mullo_epi16(usLo, ub)),
+                                       _mm_adds_epi16(ysHi, _mm_mullo_epi16(usHi, ub)));
+
+        //R G B A 交错存放
+        __m128i rgLo = _mm_unpacklo_epi8(r, g), rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, alpha), baHi = _mm_unpackhi_epi8(b, alpha);
+        __m128i *out = reinterpret_cast<__m128i *>(dst + x * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+    return x;
+}
+
+#else
+
+static int ConvertRowSimd(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                          uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    return 0;
+}
+
+#endif
+
+bool YuvConverter::ConvertToRgba(int format, uint8_t *const *planes, const int *lineSizes, int width, int height,
+                                 int colorSpace, int colorRange, uint8_t *dst, int dstLineSize, int flags)
+{
+    if(width <= 0 || height <= 0 || planes[0] == nullptr || planes[1] == nullptr)
+        return false;
+
+    const YuvCoefficients &c = s_Coefficients[colorSpace == YUV_COLOR_SPACE_BT709 ? 1 : 0]
+                                             [colorRange == YUV_COLOR_RANGE_FULL ? 1 : 0];
+    int uvStep;
+    int uOffset = 0, vOffset = 0;
+    switch (format)
+    {
+        case IMAGE_FORMAT_I420:
+            if(planes[2] == nullptr) return false;
+            uvStep = 1;
+            break;
+        case IMAGE_FORMAT_NV12:
+            uvStep = 2;
+            vOffset = 1;
+            break;
+        case IMAGE_FORMAT_NV21:
+            uvStep = 2;
+            uOffset = 1;
+            break;
+        default:
+            return false;
+    }
+
+    for (int row = 0; row < height; ++row)
+    {
+        const uint8_t *y = planes[0] + row * lineSizes[0];
+        const uint8_t *u, *v;
+        if(uvStep == 1)
+        {
+            u = planes[1] + (row >> 1) * lineSizes[1];
+            v = planes[2] + (row >> 1) * lineSizes[2];
+        }
+        else
+        {
+            const uint8_t *uv = planes[1] + (row >> 1) * lineSizes[1];
+            u = uv + uOffset;
+            v = uv + vOffset;
+        }
+        uint8_t *out = dst + row * dstLineSize;
+        int x = (flags & YUV_CONVERT_FLAG_SCALAR) ? 0 : ConvertRowSimd(y, u, v, uvStep, out, width, c);
+        ConvertRowScalar(y, u, v, uvStep, out, x, width, c);
+    }
+    return true;
+}
+
+const char *YuvConverter::GetImplName()
+{
+#if defined(YUV_CONVERTER_NEON)
+    return "neon";
+#elif defined(YUV_CONVERTER_SSE2)
+    return "sse2";
+#else
+    return "c";
+#endif
+}
@@ -0,0 +1,35 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#ifndef FFMPEGEXERCISE_YUVCONVERTER_H
+#define FFMPEGEXERCISE_YUVCONVERTER_H
+
+#include <stdint.h>
+
+//YUV 到 RGB 的转换矩阵
+#define YUV_COLOR_SPACE_BT601   0
+#define YUV_COLOR_SPACE_BT709   1
+
+//limited: Y 16~235, UV 16~240; full: 0~255
+#define YUV_COLOR_RANGE_LIMITED 0
+#define YUV_COLOR_RANGE_FULL    1
+
+//ConvertToRgba 的 flags
+#define YUV_CONVERT_FLAG_SCALAR 0x01 //只使用标量实现, 用于对比测试
+
+//不缩放的 I420/NV12/NV21 -> RGBA 转换, ARM 上使用 NEON, x86 上使用 SSE2, 其他平台为标量实现.
+//三种实现使用相同的 Q6 定点运算, 输出逐字节一致
+class YuvConverter
+{
+public:
+    //format 为 IMAGE_FORMAT_I420/NV12/NV21, 其他格式返回 false.
+    //planes/lineSizes 与 AVFrame 的 data/linesize 含义相同, 宽高为奇数时色度按向下取整的位置采样
+    static bool ConvertToRgba(int format, uint8_t *const *planes, const int *lineSizes, int width, int height,
+                              int colorSpace, int colorRange, uint8_t *dst, int dstLineSize, int flags = 0);
+
+    //当前使用的实现, 用于日志
+    static const char *GetImplName();
+};
+
+#endif //FFMPEGEXERCISE_YUVCONVERTER_H
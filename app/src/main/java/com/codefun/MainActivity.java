@@ -15,6 +15,7 @@ import android.os.Build;
 import android.os.Bundle;
 import android.os.Environment;
 import android.util.Log;
+import android.view.Choreographer;
 import android.view.LayoutInflater;
 import android.view.Menu;
 import android.view.MenuItem;
@@ -39,12 +40,14 @@ import static com.codefun.media.FFMediaPlayer.MEDIA_PARAM_VIDEO_WIDTH;
 import static com.codefun.media.FFMediaPlayer.MSG_DECODER_DONE;
 import static com.codefun.media.FFMediaPlayer.MSG_DECODER_INIT_ERROR;
 import static com.codefun.media.FFMediaPlayer.MSG_DECODER_READY;
+import static com.codefun.media.FFMediaPlayer.MSG_MEDIA_ITEM_CHANGED;
+import static com.codefun.media.FFMediaPlayer.MSG_VIDEO_SIZE_CHANGED;
 import static com.codefun.media.FFMediaPlayer.MSG_DECODING_TIME;
 import static com.codefun.media.FFMediaPlayer.MSG_REQUEST_RENDER;
 import static com.codefun.media.FFMediaPlayer.VIDEO_GL_RENDER;
 
 public class MainActivity extends AppCompatActivity implements GLSurfaceView.Renderer,
-                    FFMediaPlayer.EventCallback,MyGLSurfaceView.OnGestureCallback{
+                    FFMediaPlayer.EventCallback,MyGLSurfaceView.OnGestureCallback,Choreographer.FrameCallback{
 
     private static final String TAG = "MainActivity";
     private static final String[] REQUEST_PERMISSIONS = {
@@ -82,13 +85,17 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
         mGLSurfaceView.setEGLContextClientVersion(3);
         mGLSurfaceView.setRenderer(this);
         mGLSurfaceView.addOnGestureCallback(this);
-        mGLSurfaceView.setRenderMode(GLSurfaceView.RENDERMODE_CONTINUOUSLY);
+        //只在 native 层提交新的一帧时重绘
+        mGLSurfaceView.setRenderMode(GLSurfaceView.RENDERMODE_WHEN_DIRTY);
 
         mSeekBar = findViewById(R.id.seek_bar);
         mSeekBar.setOnSeekBarChangeListener(new SeekBar.OnSeekBarChangeListener() {
             @Override
             public void onProgressChanged(SeekBar seekBar, int i, boolean b) {
-
+                //拖动过程中只做关键帧预览, 连续的请求在 native 层合并
+                if(b && mMediaPlayer != null) {
+                    mMediaPlayer.seekToPosition(i, FFMediaPlayer.SEEK_MODE_PREVIEW);
+                }
             }
 
             @Override
@@ -100,15 +107,17 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
             public void onStopTrackingTouch(SeekBar seekBar) {
                 Log.d(TAG, "onStopTrackingTouch() called with: progress = [" + seekBar.getProgress() + "]");
                 if(mMediaPlayer != null) {
-                    mMediaPlayer.seekToPosition(mSeekBar.getProgress());
+                    mMediaPlayer.seekToPosition(mSeekBar.getProgress(), FFMediaPlayer.SEEK_MODE_EXACT);
                     mIsTouch = false;
                 }
             }
         });
 
+        FFMediaPlayer.setCacheDir(getCacheDir().getAbsolutePath());
         mMediaPlayer = new FFMediaPlayer();
         mMediaPlayer.addEventCallback(this);
         mMediaPlayer.init(mVideoPath,FFMediaPlayer.VIDEO_RENDER_OPENGL,null);
+        mMediaPlayer.prepare();
     }
 
     @Override
@@ -123,11 +132,13 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
         if(mMediaPlayer != null){
             mMediaPlayer.play();
         }
+        Choreographer.getInstance().postFrameCallback(this);
     }
 
     @Override
     protected void onPause() {
         super.onPause();
+        Choreographer.getInstance().removeFrameCallback(this);
         if(mMediaPlayer != null)
             mMediaPlayer.pause();
     }
@@ -166,8 +177,20 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
         FFMediaPlayer.native_OnDrawFrame(VIDEO_GL_RENDER);
     }
 
+    @Override
+    public void doFrame(long frameTimeNanos) {
+        //界面可见时每个 vsync 通知 native 层
+        FFMediaPlayer.onVsync(frameTimeNanos);
+        Choreographer.getInstance().postFrameCallback(this);
+    }
+
     @Override
     public void onPlayerEvent(final int msgType, final float msgValue) {
+        //requestRender 是线程安全的, 不需要切换到 UI 线程
+        if(msgType == MSG_REQUEST_RENDER) {
+            mGLSurfaceView.requestRender();
+            return;
+        }
         runOnUiThread(new Runnable() {
             @Override
             public void run() {
@@ -175,12 +198,13 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
                     case MSG_DECODER_INIT_ERROR:
                         break;
                     case MSG_DECODER_READY:
+                    case MSG_MEDIA_ITEM_CHANGED:
                         onDecoderReady();
                         break;
-                    case MSG_DECODER_DONE:
+                    case MSG_VIDEO_SIZE_CHANGED:
+                        updateAspectRatio();
                         break;
-                    case MSG_REQUEST_RENDER:
-                        mGLSurfaceView.requestRender();
+                    case MSG_DECODER_DONE:
                         break;
                     case MSG_DECODING_TIME:
                         if(!mIsTouch)
@@ -194,10 +218,7 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
     }
 
     private void onDecoderReady(){
-        int videoWidth = (int) mMediaPlayer.getMediaParams(MEDIA_PARAM_VIDEO_WIDTH);
-        int videoHeight = (int) mMediaPlayer.getMediaParams(MEDIA_PARAM_VIDEO_HEIGHT);
-        if(videoHeight * videoWidth != 0)
-            mGLSurfaceView.setAspectRatio(videoWidth,videoHeight);
+        updateAspectRatio();
 
         int duration = (int) mMediaPlayer.getMediaParams(MEDIA_PARAM_VIDEO_DURATION);
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.O) {
@@ -206,14 +227,24 @@ public class MainActivity extends AppCompatActivity implements GLSurfaceView.Ren
         mSeekBar.setMax(duration);
     }
 
+    private void updateAspectRatio(){
+        int videoWidth = (int) mMediaPlayer.getMediaParams(MEDIA_PARAM_VIDEO_WIDTH);
+        int videoHeight = (int) mMediaPlayer.getMediaParams(MEDIA_PARAM_VIDEO_HEIGHT);
+        if(videoHeight * videoWidth != 0)
+            mGLSurfaceView.setAspectRatio(videoWidth,videoHeight);
+    }
+
     @Override
     public void onGesture(int xRotateAngle, int yRotateAngle, float scale) {
         FFMediaPlayer.native_SetGesture(VIDEO_GL_RENDER, xRotateAngle, yRotateAngle, scale);
+        //RENDERMODE_WHEN_DIRTY 下暂停时也要重绘, 变换才能立即生效
+        mGLSurfaceView.requestRender();
     }
 
     @Override
     public void onTouchLoc(float touchX, float touchY) {
         FFMediaPlayer.native_SetTouchLoc(VIDEO_GL_RENDER, touchX, touchY);
+        mGLSurfaceView.requestRender();
     }
 
     @Override
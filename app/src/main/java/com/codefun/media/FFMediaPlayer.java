@@ -1,5 +1,6 @@
 package com.codefun.media;
 
+import android.graphics.Bitmap;
 import android.view.Surface;
 
 public class FFMediaPlayer {
@@ -16,10 +17,46 @@ public class FFMediaPlayer {
     public static final int MSG_DECODER_DONE            = 2;
     public static final int MSG_REQUEST_RENDER          = 3;
     public static final int MSG_DECODING_TIME           = 4;
+    public static final int MSG_DECODER_COMPLETE        = 5;
+    public static final int MSG_MEDIA_ITEM_CHANGED      = 6;
+    public static final int MSG_VIDEO_SIZE_CHANGED      = 7;
 
     public static final int MEDIA_PARAM_VIDEO_WIDTH     = 0x0001;
     public static final int MEDIA_PARAM_VIDEO_HEIGHT    = 0x0002;
     public static final int MEDIA_PARAM_VIDEO_DURATION  = 0x0003;
+    public static final int MEDIA_PARAM_VIDEO_DECODE_FPS = 0x0004;
+    public static final int MEDIA_PARAM_AUDIO_DECODE_FPS = 0x0005;
+    public static final int MEDIA_PARAM_BUFFERED_BYTES  = 0x0006;
+    public static final int MEDIA_PARAM_BUFFERED_DURATION = 0x0007;
+    public static final int MEDIA_PARAM_TIME_TO_FIRST_FRAME = 0x0008;
+    public static final int MEDIA_PARAM_TEXTURE_UPLOAD_TIME = 0x0009;
+    public static final int MEDIA_PARAM_CADENCE_ERROR   = 0x000A;
+    //可以通过 setMediaParams 设置, 需要在 prepare/play 之前调用, 播放列表后续条目沿用
+    public static final int MEDIA_PARAM_VIDEO_FRAME_QUEUE_SIZE = 0x000B;
+    public static final int MEDIA_PARAM_READ_AHEAD_BUFFER_SIZE = 0x000C;
+    public static final int MEDIA_PARAM_READ_AHEAD_LOW_WATERMARK = 0x000D;
+    public static final int MEDIA_PARAM_READ_AHEAD_HIGH_WATERMARK = 0x000E;
+
+    public static final int MEDIA_TYPE_VIDEO            = 0;
+    public static final int MEDIA_TYPE_AUDIO            = 1;
+
+    public static final int DECODER_THREAD_AUTO         = 0;
+    public static final int DECODER_THREAD_FRAME        = 1;
+    public static final int DECODER_THREAD_SLICE        = 2;
+
+    public static final int SEEK_MODE_EXACT             = 0;
+    public static final int SEEK_MODE_PREVIEW           = 1;
+
+    //与 native 层 MIN_PLAYBACK_SPEED/MAX_PLAYBACK_SPEED 一致
+    public static final float MIN_PLAYBACK_SPEED        = 0.25f;
+    public static final float MAX_PLAYBACK_SPEED        = 4.0f;
+
+    //与 native 层 THUMBNAIL_WIDTH 一致
+    public static final int THUMBNAIL_WIDTH             = 160;
+
+    //与 native 层 TEXTURE_UPLOAD_XXX 一致
+    public static final int TEXTURE_UPLOAD_DIRECT       = 0;
+    public static final int TEXTURE_UPLOAD_PBO          = 1;
 
     public static final int VIDEO_RENDER_OPENGL         = 0;
     public static final int VIDEO_RENDER_ANWINDOW       = 1;
@@ -33,6 +70,17 @@ public class FFMediaPlayer {
         mNativePlayerHandle = native_Init(url, videoRenderType);
     }
 
+    //播放列表的下一个条目, 后台预先打开和解码, 当前条目播放完成后无缝切换并回调 MSG_MEDIA_ITEM_CHANGED.
+    //一般在收到 MSG_MEDIA_ITEM_CHANGED 之后设置再下一个条目
+    public void setNextDataSource(String url) {
+        native_SetNextDataSource(mNativePlayerHandle, url);
+    }
+
+    //异步准备, 第一帧画面送显并且音频缓冲填满后回调 MSG_DECODER_READY, 之后 play 可以立即出画出声
+    public void prepare() {
+        native_Prepare(mNativePlayerHandle);
+    }
+
     public void play() {
         native_Play(mNativePlayerHandle);
     }
@@ -42,7 +90,17 @@ public class FFMediaPlayer {
     }
 
     public void seekToPosition(float position) {
-        native_SeekToPosition(mNativePlayerHandle, position);
+        seekToPosition(position, SEEK_MODE_EXACT);
+    }
+
+    //拖动进度条时使用 SEEK_MODE_PREVIEW, 松手后使用 SEEK_MODE_EXACT
+    public void seekToPosition(float position, int seekMode) {
+        native_SeekToPosition(mNativePlayerHandle, position, seekMode);
+    }
+
+    //倍速播放, 音频变速不变调, 视频按倍速抽帧
+    public void setPlaybackSpeed(float speed) {
+        native_SetPlaybackSpeed(mNativePlayerHandle, speed);
     }
 
     public void stop() {
@@ -53,6 +111,40 @@ public class FFMediaPlayer {
         native_UnInit(mNativePlayerHandle);
     }
 
+    //threadCount 为 0 时按 CPU 核数自动选择, 需要在 play 之前调用
+    public void setDecoderThreadPolicy(int mediaType, int threadType, int threadCount) {
+        native_SetDecoderThreadPolicy(mNativePlayerHandle, mediaType, threadType, threadCount);
+    }
+
+    //拖动进度条时的缩略图, 由后台线程预先解码关键帧, 未命中时返回 null
+    public Bitmap getThumbnail(float position) {
+        int[] pixels = native_GetThumbnail(mNativePlayerHandle, position);
+        if(pixels == null || pixels.length == 0)
+            return null;
+        return Bitmap.createBitmap(pixels, THUMBNAIL_WIDTH, pixels.length / THUMBNAIL_WIDTH, Bitmap.Config.ARGB_8888);
+    }
+
+    //关键帧索引等缓存文件的保存目录, 需要在 init 之前调用
+    public static void setCacheDir(String cacheDir) {
+        native_SetCacheDir(cacheDir);
+    }
+
+    //网络文件磁盘缓存的总容量上限, 超出后按最近使用时间淘汰
+    public static void setMediaCacheBudget(long bytes) {
+        native_SetMediaCacheBudget(bytes);
+    }
+
+    //视频纹理的上传方式, 播放过程中可以切换. 默认 TEXTURE_UPLOAD_DIRECT,
+    //TEXTURE_UPLOAD_PBO 多一次拷贝, 只用于在设备上对比上传耗时
+    public static void setTextureUploadMode(int uploadMode) {
+        native_SetTextureUploadMode(uploadMode);
+    }
+
+    //Choreographer.FrameCallback 的 frameTimeNanos, 视频按 vsync 选择送显的帧
+    public static void onVsync(long frameTimeNanos) {
+        native_OnVsync(frameTimeNanos);
+    }
+
     public void addEventCallback(EventCallback callback) {
         mEventCallback = callback;
     }
@@ -61,6 +153,10 @@ public class FFMediaPlayer {
         return native_GetMediaParams(mNativePlayerHandle, paramType);
     }
 
+    public void setMediaParams(int paramType, long value) {
+        native_SetMediaParams(mNativePlayerHandle, paramType, value);
+    }
+
     private void playerEventCallback(int msgType, float msgValue) {
         if(mEventCallback != null)
             mEventCallback.onPlayerEvent(msgType, msgValue);
@@ -69,9 +165,15 @@ public class FFMediaPlayer {
 
     private native long native_Init(String url,int renderType);
 
+    private native void native_SetNextDataSource(long playHandle, String url);
+
+    private native void native_Prepare(long playHandle);
+
     private native void native_Play(long playHandle);
 
-    private native void native_SeekToPosition(long playHandle,float position);
+    private native void native_SeekToPosition(long playHandle,float position,int seekMode);
+
+    private native void native_SetPlaybackSpeed(long playHandle, float speed);
 
     private native void native_Pause(long playHandle);
 
@@ -81,6 +183,20 @@ public class FFMediaPlayer {
 
     private native long native_GetMediaParams(long playHandle,int paramType);
 
+    private native void native_SetMediaParams(long playHandle,int paramType,long value);
+
+    private native void native_SetDecoderThreadPolicy(long playHandle,int mediaType,int threadType,int threadCount);
+
+    private native int[] native_GetThumbnail(long playHandle,float position);
+
+    private static native void native_SetCacheDir(String cacheDir);
+
+    private static native void native_SetMediaCacheBudget(long bytes);
+
+    private static native void native_SetTextureUploadMode(int uploadMode);
+
+    private static native void native_OnVsync(long frameTimeNanos);
+
     //gl Render
     public static   native void native_OnSurfaceCreated(int renderType);
 
@@ -0,0 +1,157 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include "FrameScheduler.h"
+
+//模拟的帧率, 以 num/den 表示, 23.976 为 24000/1001
+struct FrameRate
+{
+    int num;
+    int den;
+};
+
+struct CadenceResult
+{
+    //每个送显帧在屏幕上停留的 vsync 数
+    std::vector<int> holdVsyncs;
+    int presented = 0;
+    int repeated = 0;
+    int dropped = 0;
+    //与 FrameScheduler 无关的独立计算, 送显帧 pts 与上屏时间的平均偏差(us)
+    long cadenceError = 0;
+};
+
+//第 index 帧的时间戳(us), 与 DecoderBase::GetFrameTimeStampUs 一样取整到 us
+static int64_t GetFrameTime(const FrameRate &rate, int index)
+{
+    return index * 1000000LL * rate.den / rate.num;
+}
+
+//按 DecoderBase::VsyncSync 的流程驱动 FrameScheduler: 当前帧没有到期时重复上一帧,
+//下一帧在同一个 vsync 上也已经到期时丢弃当前帧. 模拟一个完整的统计周期, 第一帧的 pts 与第一个 vsync 对齐
+static CadenceResult RunCadence(FrameScheduler &scheduler, const FrameRate &rate, int refreshRate)
+{
+    CadenceResult result;
+    int64_t period = 1000000LL / refreshRate;
+    int frameIndex = 0;
+    int lastPresentedVsync = -1;
+    int64_t totalError = 0;
+    for (int vsync = 0; vsync < FRAME_SCHEDULER_STAT_VSYNC_COUNT; ++vsync)
+    {
+        int64_t displayTime = vsync * 1000000LL / refreshRate;
+        scheduler.BeginVsync(displayTime, period);
+        if(!scheduler.IsDue(GetFrameTime(rate, frameIndex)))
+        {
+            scheduler.EndVsync();
+            result.repeated++;
+            continue;
+        }
+
+        while (scheduler.IsDue(GetFrameTime(rate, frameIndex + 1)))
+        {
+            scheduler.OnFrameDropped();
+            result.dropped++;
+            frameIndex++;
+        }
+
+        int64_t frameTime = GetFrameTime(rate, frameIndex);
+        scheduler.OnFramePresented(frameTime);
+        scheduler.EndVsync();
+        totalError += llabs(frameTime - displayTime);
+        result.presented++;
+        if(lastPresentedVsync >= 0)
+            result.holdVsyncs.push_back(vsync - lastPresentedVsync);
+        lastPresentedVsync = vsync;
+        frameIndex++;
+    }
+    result.cadenceError = result.presented > 0 ? static_cast<long>(totalError / result.presented) : 0;
+    return result;
+}
+
+class FrameSchedulerCadenceTest : public ::testing::TestWithParam<std::tuple<FrameRate, int>>
+{
+};
+
+TEST_P(FrameSchedulerCadenceTest, StableCadence)
+{
+    FrameRate rate = std::get<0>(GetParam());
+    int refreshRate = std::get<1>(GetParam());
+    FrameScheduler scheduler;
+    CadenceResult result = RunCadence(scheduler, rate, refreshRate);
+
+    //每帧停留 floor(R/f) 或 ceil(R/f) 个 vsync, 不会丢帧
+    int minHold = refreshRate * rate.den / rate.num;
+    int maxHold = (refreshRate * rate.den + rate.num - 1) / rate.num;
+    ASSERT_FALSE(result.holdVsyncs.empty());
+    for (size_t i = 0; i < result.holdVsyncs.size(); ++i)
+    {
+        EXPECT_GE(result.holdVsyncs[i], minHold) << "frame " << i;
+        EXPECT_LE(result.holdVsyncs[i], maxHold) << "frame " << i;
+    }
+
+    //送显帧数与统计周期内的内容时长一致
+    double expectedFrames = FRAME_SCHEDULER_STAT_VSYNC_COUNT * 1.0 * rate.num / rate.den / refreshRate;
+    EXPECT_NEAR(expectedFrames, result.presented, 1.0);
+    EXPECT_EQ(0, result.dropped);
+    EXPECT_EQ(FRAME_SCHEDULER_STAT_VSYNC_COUNT, result.presented + result.repeated);
+
+    //统计周期结束后 FrameScheduler 报告的结果与模拟一致
+    EXPECT_EQ(result.presented, scheduler.GetPresentCount());
+    EXPECT_EQ(result.repeated, scheduler.GetRepeatCount());
+    EXPECT_EQ(result.dropped, scheduler.GetDropCount());
+    EXPECT_EQ(result.cadenceError, scheduler.GetCadenceError());
+    //每帧都落在离它最近的 vsync 上, 偏差不超过半个周期
+    EXPECT_LE(scheduler.GetCadenceError(), 1000000L / refreshRate / 2);
+}
+
+INSTANTIATE_TEST_CASE_P(ContentOnDisplay, FrameSchedulerCadenceTest,
+                        ::testing::Combine(::testing::Values(FrameRate{24000, 1001}, FrameRate{24, 1}, FrameRate{25, 1}),
+                                           ::testing::Values(60, 90, 120)));
+
+TEST(FrameSchedulerTest, ThreeTwoPulldownAt60Hz)
+{
+    FrameScheduler scheduler;
+    CadenceResult result = RunCadence(scheduler, FrameRate{24, 1}, 60);
+
+    //24fps 在 60Hz 上严格交替停留 3 个和 2 个 vsync
+    ASSERT_GT(result.holdVsyncs.size(), 2u);
+    for (size_t i = 0; i + 1 < result.holdVsyncs.size(); ++i)
+    {
+        EXPECT_EQ(5, result.holdVsyncs[i] + result.holdVsyncs[i + 1]) << "frame " << i;
+    }
+    EXPECT_EQ(120, scheduler.GetPresentCount());
+    EXPECT_EQ(180, scheduler.GetRepeatCount());
+    EXPECT_EQ(0, scheduler.GetDropCount());
+}
+
+TEST(FrameSchedulerTest, NtscFilmBreaksPulldownRarely)
+{
+    FrameScheduler scheduler;
+    CadenceResult result = RunCadence(scheduler, FrameRate{24000, 1001}, 60);
+
+    //23.976fps 比 24fps 每 1000 帧多出一个 vsync, 一个统计周期内 3:2 节奏最多被打断一次
+    int breaks = 0;
+    for (size_t i = 0; i + 1 < result.holdVsyncs.size(); ++i)
+    {
+        if(result.holdVsyncs[i] + result.holdVsyncs[i + 1] != 5)
+            breaks++;
+    }
+    EXPECT_LE(breaks, 1);
+}
+
+TEST(FrameSchedulerTest, DropsWhenContentFasterThanDisplay)
+{
+    FrameScheduler scheduler;
+    CadenceResult result = RunCadence(scheduler, FrameRate{60, 1}, 30);
+
+    //60fps 在 30Hz 上每个 vsync 显示一帧, 丢弃一帧
+    EXPECT_EQ(FRAME_SCHEDULER_STAT_VSYNC_COUNT, scheduler.GetPresentCount());
+    EXPECT_EQ(0, scheduler.GetRepeatCount());
+    EXPECT_NEAR(FRAME_SCHEDULER_STAT_VSYNC_COUNT, scheduler.GetDropCount(), 1);
+    EXPECT_EQ(result.cadenceError, scheduler.GetCadenceError());
+}
@@ -0,0 +1,282 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ReadAheadIO.h"
+
+#define TEST_FILE_SIZE   (4 * 1024 * 1024)
+#define TEST_READ_SIZE   (64 * 1024)
+#define TEST_BUFFER_SIZE (1024 * 1024)
+
+//本地 http 服务, 支持 Range 请求, 可以限速和在第一个连接上模拟断线
+class LocalHttpServer
+{
+public:
+    LocalHttpServer(const std::vector<uint8_t> &content) : m_Content(content) {}
+
+    ~LocalHttpServer()
+    {
+        Stop();
+    }
+
+    bool Start()
+    {
+        m_ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if(m_ListenFd < 0)
+            return false;
+
+        int reuse = 1;
+        setsockopt(m_ListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t length = sizeof(addr);
+        if(bind(m_ListenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_ListenFd, 8) != 0 ||
+           getsockname(m_ListenFd, (sockaddr *)&addr, &length) != 0)
+            return false;
+
+        m_Port = ntohs(addr.sin_port);
+        m_AcceptThread = std::thread(&LocalHttpServer::AcceptLoop, this);
+        return true;
+    }
+
+    void Stop()
+    {
+        m_Stop = true;
+        if(m_ListenFd >= 0)
+        {
+            shutdown(m_ListenFd, SHUT_RDWR);
+            close(m_ListenFd);
+            m_ListenFd = -1;
+        }
+        if(m_AcceptThread.joinable())
+            m_AcceptThread.join();
+        for (size_t i = 0; i < m_Connections.size(); ++i)
+            m_Connections[i].join();
+        m_Connections.clear();
+    }
+
+    std::string GetUrl()
+    {
+        char url[64];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d/media.bin", m_Port);
+        return url;
+    }
+
+    //每发送 chunkSize 字节等待 delayMs, 模拟慢速网络
+    void SetThrottle(int chunkSize, int delayMs)
+    {
+        m_ChunkSize = chunkSize;
+        m_DelayMs = delayMs;
+    }
+
+    //第一个连接发送 bytes 字节的响应体后断开
+    void SetDropAfter(int64_t bytes)
+    {
+        m_DropAfter = bytes;
+    }
+
+    int GetRequestCount()
+    {
+        return m_RequestCount;
+    }
+
+    int64_t GetBytesSent()
+    {
+        return m_BytesSent;
+    }
+
+private:
+    void AcceptLoop()
+    {
+        while (!m_Stop)
+        {
+            int fd = accept(m_ListenFd, nullptr, nullptr);
+            if(fd < 0)
+                break;
+            m_Connections.push_back(std::thread(&LocalHttpServer::Serve, this, fd));
+        }
+    }
+
+    void Serve(int fd)
+    {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos)
+        {
+            ssize_t ret = recv(fd, buffer, sizeof(buffer), 0);
+            if(ret <= 0)
+            {
+                close(fd);
+                return;
+            }
+            request.append(buffer, ret);
+        }
+        int requestIndex = m_RequestCount++;
+
+        int64_t size = static_cast<int64_t>(m_Content.size());
+        int64_t start = 0;
+        size_t range = request.find("Range: bytes=");
+        if(range != std::string::npos)
+            start = atoll(request.c_str() + range + strlen("Range: bytes="));
+
+        char header[256];
+        if(range != std::string::npos)
+        {
+            snprintf(header, sizeof(header),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\nContent-Range: bytes %lld-%lld/%lld\r\n"
+                     "Accept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n\r\n",
+                     (long long)(size - start), (long long)start, (long long)(size - 1), (long long)size);
+        }
+        else
+        {
+            snprintf(header, sizeof(header),
+                     "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\nAccept-Ranges: bytes\r\n"
+                     "Content-Type: application/octet-stream\r\n\r\n", (long long)size);
+        }
+
+        int64_t limit = size;
+        if(requestIndex == 0 && m_DropAfter >= 0)
+            limit = std::min(size, start + m_DropAfter);
+
+        bool success = send(fd, header, strlen(header), MSG_NOSIGNAL) == (ssize_t)strlen(header);
+        for (int64_t position = start; success && position < limit && !m_Stop;)
+        {
+            int length = static_cast<int>(std::min<int64_t>(m_ChunkSize, limit - position));
+            ssize_t ret = send(fd, &m_Content[position], length, MSG_NOSIGNAL);
+            if(ret <= 0)
+                break;
+            position += ret;
+            m_BytesSent += ret;
+            if(m_DelayMs > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(m_DelayMs));
+        }
+        close(fd);
+    }
+
+    const std::vector<uint8_t> &m_Content;
+    int m_ListenFd = -1;
+    int m_Port = 0;
+    int m_ChunkSize = 64 * 1024;
+    int m_DelayMs = 0;
+    int64_t m_DropAfter = -1;
+    std::atomic<int> m_RequestCount{0};
+    std::atomic<int64_t> m_BytesSent{0};
+    std::atomic<bool> m_Stop{false};
+    std::thread m_AcceptThread;
+    std::vector<std::thread> m_Connections;
+};
+
+class ReadAheadIOTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        avformat_network_init();
+        m_Content.resize(TEST_FILE_SIZE);
+        for (size_t i = 0; i < m_Content.size(); ++i)
+            m_Content[i] = static_cast<uint8_t>((i * 131) ^ (i >> 13));
+    }
+
+    void TearDown() override
+    {
+        avformat_network_deinit();
+    }
+
+    //按 TEST_READ_SIZE 读完整个文件, 返回读取到的内容
+    std::vector<uint8_t> ReadAll(AVIOContext *avio, LocalHttpServer &server, int *readsDuringRefill)
+    {
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> buffer(TEST_READ_SIZE);
+        for(;;)
+        {
+            int ret = avio_read(avio, &buffer[0], TEST_READ_SIZE);
+            if(ret <= 0)
+                break;
+            //服务端还没有发送完, 说明读取和后台填充在同时进行
+            if(readsDuringRefill && server.GetBytesSent() < TEST_FILE_SIZE)
+                (*readsDuringRefill)++;
+            data.insert(data.end(), buffer.begin(), buffer.begin() + ret);
+        }
+        return data;
+    }
+
+    std::vector<uint8_t> m_Content;
+};
+
+TEST_F(ReadAheadIOTest, ReadsWhileRefilling)
+{
+    LocalHttpServer server(m_Content);
+    //4MB 大约 250ms 发送完
+    server.SetThrottle(32 * 1024, 2);
+    ASSERT_TRUE(server.Start());
+
+    ReadAheadIO io(server.GetUrl().c_str(), TEST_BUFFER_SIZE);
+    io.SetWatermarks(256 * 1024, 512 * 1024);
+    ASSERT_EQ(0, io.Open(nullptr));
+
+    int readsDuringRefill = 0;
+    std::vector<uint8_t> data = ReadAll(io.GetAVIOContext(), server, &readsDuringRefill);
+    io.Close();
+
+    ASSERT_EQ(m_Content.size(), data.size());
+    EXPECT_TRUE(data == m_Content);
+    EXPECT_GT(readsDuringRefill, 1);
+}
+
+TEST_F(ReadAheadIOTest, ResumesAfterConnectionDrop)
+{
+    LocalHttpServer server(m_Content);
+    server.SetThrottle(32 * 1024, 1);
+    //第一个连接在 1MB 多一点的位置断开, 不在读取块的边界上
+    server.SetDropAfter(1024 * 1024 + 1000);
+    ASSERT_TRUE(server.Start());
+
+    ReadAheadIO io(server.GetUrl().c_str(), TEST_BUFFER_SIZE);
+    ASSERT_EQ(0, io.Open(nullptr));
+
+    std::vector<uint8_t> data = ReadAll(io.GetAVIOContext(), server, nullptr);
+    io.Close();
+
+    //重新请求之后从断开的位置继续, 读者收不到错误
+    ASSERT_EQ(m_Content.size(), data.size());
+    EXPECT_TRUE(data == m_Content);
+    EXPECT_GE(server.GetRequestCount(), 2);
+}
+
+TEST_F(ReadAheadIOTest, SeekOutsideWindowAfterDrop)
+{
+    LocalHttpServer server(m_Content);
+    server.SetDropAfter(512 * 1024);
+    ASSERT_TRUE(server.Start());
+
+    ReadAheadIO io(server.GetUrl().c_str(), TEST_BUFFER_SIZE);
+    ASSERT_EQ(0, io.Open(nullptr));
+    AVIOContext *avio = io.GetAVIOContext();
+
+    std::vector<uint8_t> buffer(TEST_READ_SIZE);
+    ASSERT_EQ(TEST_READ_SIZE, avio_read(avio, &buffer[0], TEST_READ_SIZE));
+    EXPECT_EQ(0, memcmp(&buffer[0], &m_Content[0], TEST_READ_SIZE));
+
+    int64_t target = 3 * 1024 * 1024 + 17;
+    ASSERT_EQ(target, avio_seek(avio, target, SEEK_SET));
+    ASSERT_EQ(TEST_READ_SIZE, avio_read(avio, &buffer[0], TEST_READ_SIZE));
+    EXPECT_EQ(0, memcmp(&buffer[0], &m_Content[target], TEST_READ_SIZE));
+    io.Close();
+}
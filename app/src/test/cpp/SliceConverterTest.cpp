@@ -0,0 +1,154 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <random>
+#include <vector>
+#include "SliceConverter.h"
+
+//生成带随机内容的帧, linesize 由 av_frame_get_buffer 按 32 字节对齐
+static AVFrame *AllocFrame(AVPixelFormat format, int width, int height, unsigned int seed)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    if(av_frame_get_buffer(frame, 32) < 0)
+    {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    std::mt19937 random(seed);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    for (int i = 0; i < 4 && frame->data[i] != nullptr; ++i)
+    {
+        int rows = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        for (size_t j = 0; j < static_cast<size_t>(frame->linesize[i]) * rows; ++j)
+            frame->data[i][j] = static_cast<uint8_t>(random());
+    }
+    return frame;
+}
+
+class RgbaBuffer
+{
+public:
+    RgbaBuffer(int width, int height) : m_Width(width), m_Height(height),
+                                        m_Data(static_cast<size_t>(width) * height * 4, 0)
+    {
+        m_Planes[0] = &m_Data[0];
+        m_Planes[1] = m_Planes[2] = m_Planes[3] = nullptr;
+        m_LineSizes[0] = width * 4;
+        m_LineSizes[1] = m_LineSizes[2] = m_LineSizes[3] = 0;
+    }
+
+    uint8_t *const *GetPlanes()
+    {
+        return m_Planes;
+    }
+
+    const int *GetLineSizes()
+    {
+        return m_LineSizes;
+    }
+
+    //与 other 第一个不同的行号, 相同时返回 -1
+    int FindFirstDiffRow(const RgbaBuffer &other) const
+    {
+        for (int y = 0; y < m_Height; ++y)
+        {
+            if(memcmp(&m_Data[y * m_Width * 4], &other.m_Data[y * m_Width * 4], m_Width * 4) != 0)
+                return y;
+        }
+        return -1;
+    }
+
+private:
+    int m_Width;
+    int m_Height;
+    std::vector<uint8_t> m_Data;
+    uint8_t *m_Planes[4];
+    int m_LineSizes[4];
+};
+
+//一个 SwsContext 整帧转换的结果, 作为没有接缝的参考
+static void ConvertWhole(AVFrame *frame, int dstWidth, int dstHeight, RgbaBuffer &dst)
+{
+    SwsContext *context = sws_getContext(frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                         dstWidth, dstHeight, AV_PIX_FMT_RGBA, SWS_FAST_BILINEAR,
+                                         nullptr, nullptr, nullptr);
+    ASSERT_TRUE(context != nullptr);
+    sws_scale(context, frame->data, frame->linesize, 0, frame->height, dst.GetPlanes(), dst.GetLineSizes());
+    sws_freeContext(context);
+}
+
+struct SeamCase
+{
+    AVPixelFormat format;
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+    //期望拆分条带
+    bool banded;
+};
+
+//swscale 路径上拆分条带转换的结果与整帧转换逐字节一致, 条带边界上没有接缝
+TEST(SliceConverterTest, SwscaleHasNoSeams)
+{
+    static const SeamCase cases[] = {
+            //垂直缩放: 整帧转换
+            {AV_PIX_FMT_YUV420P, 1280, 720, 1920, 1080, false},
+            {AV_PIX_FMT_YUV420P, 1920, 1080, 640, 360, false},
+            {AV_PIX_FMT_YUV444P, 1920, 1080, 1280, 720, false},
+            //垂直不缩放但有色度下采样, 色度的垂直插值会跨条带: 整帧转换
+            {AV_PIX_FMT_YUV420P, 1280, 720, 1920, 720, false},
+            {AV_PIX_FMT_YUV420P10LE, 1920, 1080, 1920, 1080, false},
+            //垂直不缩放且没有色度下采样: 按条带转换
+            {AV_PIX_FMT_YUV444P, 1280, 720, 1920, 720, true},
+            {AV_PIX_FMT_YUV444P, 1920, 1080, 1920, 1080, true},
+            {AV_PIX_FMT_BGRA, 1920, 1080, 1280, 1080, true},
+    };
+
+    SliceConverter converter(SWS_FAST_BILINEAR, MAX_CONVERT_THREADS);
+    unsigned int seed = 1;
+    for (const SeamCase &c : cases)
+    {
+        SCOPED_TRACE(testing::Message() << av_get_pix_fmt_name(c.format) << " [" << c.srcWidth << ", " << c.srcHeight
+                                        << "] -> [" << c.dstWidth << ", " << c.dstHeight << "]");
+        AVFrame *frame = AllocFrame(c.format, c.srcWidth, c.srcHeight, seed++);
+        ASSERT_TRUE(frame != nullptr);
+
+        RgbaBuffer banded(c.dstWidth, c.dstHeight), whole(c.dstWidth, c.dstHeight);
+        ASSERT_EQ(0, converter.Convert(frame, c.dstWidth, c.dstHeight, AV_PIX_FMT_RGBA,
+                                       banded.GetPlanes(), banded.GetLineSizes(), CONVERT_FLAG_NO_SIMD));
+        EXPECT_EQ(c.banded, converter.GetBandCount() > 1);
+        ConvertWhole(frame, c.dstWidth, c.dstHeight, whole);
+        EXPECT_EQ(-1, banded.FindFirstDiffRow(whole));
+        av_frame_free(&frame);
+    }
+}
+
+//YuvConverter 按行取样, 拆分条带与不拆分的结果一致
+TEST(SliceConverterTest, YuvConverterBandsMatchWholeFrame)
+{
+    static const AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_NV21};
+    SliceConverter converter(SWS_FAST_BILINEAR, MAX_CONVERT_THREADS);
+    SliceConverter wholeConverter(SWS_FAST_BILINEAR, 1);
+    unsigned int seed = 100;
+    for (AVPixelFormat format : formats)
+    {
+        AVFrame *frame = AllocFrame(format, 1917, 1077, seed++);
+        ASSERT_TRUE(frame != nullptr);
+        //奇数宽高, 条带边界仍然对齐到色度行
+        RgbaBuffer banded(1917, 1077), whole(1917, 1077);
+        ASSERT_EQ(1, converter.Convert(frame, 1917, 1077, AV_PIX_FMT_RGBA, banded.GetPlanes(), banded.GetLineSizes()));
+        EXPECT_GT(converter.GetBandCount(), 1);
+        ASSERT_EQ(1, wholeConverter.Convert(frame, 1917, 1077, AV_PIX_FMT_RGBA, whole.GetPlanes(), whole.GetLineSizes()));
+        EXPECT_EQ(1, wholeConverter.GetBandCount());
+        EXPECT_EQ(-1, banded.FindFirstDiffRow(whole)) << av_get_pix_fmt_name(format);
+        av_frame_free(&frame);
+    }
+}
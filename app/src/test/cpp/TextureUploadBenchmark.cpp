@@ -0,0 +1,222 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <benchmark/benchmark.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "ImageDef.h"
+#include "TextureUploader.h"
+
+//TextureUploader 直接上传与经由 PBO 环上传的耗时, 在无窗口的 EGL pbuffer 上运行, 主机上一般是 llvmpipe:
+//  TextureUploadBenchmark --benchmark_filter=BM_TextureUpload
+//finish 为 0 时只统计 GL 线程上 Upload 本身的耗时(渲染线程被占用的时间), 每次上传之后在计时之外 glFinish,
+//为 1 时统计 Upload + glFinish, 即上传真正完成的耗时
+static EGLDisplay s_Display = EGL_NO_DISPLAY;
+static EGLContext s_Context = EGL_NO_CONTEXT;
+static EGLSurface s_Surface = EGL_NO_SURFACE;
+
+//没有窗口系统时使用 Mesa 的 surfaceless 平台
+static EGLDisplay GetDisplay()
+{
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(extensions != nullptr && strstr(extensions, "EGL_MESA_platform_surfaceless") != nullptr)
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if(getPlatformDisplay != nullptr)
+            return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool CreateGLContext()
+{
+    s_Display = GetDisplay();
+    if(s_Display == EGL_NO_DISPLAY || !eglInitialize(s_Display, nullptr, nullptr))
+    {
+        fprintf(stderr, "eglInitialize fail, eglError=0x%x\n", eglGetError());
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if(!eglChooseConfig(s_Display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        fprintf(stderr, "eglChooseConfig fail, eglError=0x%x\n", eglGetError());
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+    s_Surface = eglCreatePbufferSurface(s_Display, config, surfaceAttribs);
+    const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    s_Context = eglCreateContext(s_Display, config, EGL_NO_CONTEXT, contextAttribs);
+    if(s_Surface == EGL_NO_SURFACE || s_Context == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(s_Display, s_Surface, s_Surface, s_Context))
+    {
+        fprintf(stderr, "create pbuffer context fail, eglError=0x%x\n", eglGetError());
+        return false;
+    }
+    fprintf(stderr, "GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+    return true;
+}
+
+static void DestroyGLContext()
+{
+    if(s_Display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(s_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(s_Context != EGL_NO_CONTEXT)
+        eglDestroyContext(s_Display, s_Context);
+    if(s_Surface != EGL_NO_SURFACE)
+        eglDestroySurface(s_Display, s_Surface);
+    eglTerminate(s_Display);
+}
+
+//解码输出的一帧, linesize 按 64 字节对齐, 与 FFmpeg 解码输出一致
+class SourceFrame
+{
+public:
+    SourceFrame(int format, int width, int height, uint8_t seed)
+    {
+        int chromaWidth = format == IMAGE_FORMAT_I420 ? width / 2 : width;
+        m_LineSizes[0] = (width + 63) & ~63;
+        m_LineSizes[1] = (chromaWidth + 63) & ~63;
+        m_LineSizes[2] = format == IMAGE_FORMAT_I420 ? m_LineSizes[1] : 0;
+        int rows[3] = {height, height / 2, height / 2};
+        for (int i = 0; i < 3; ++i)
+        {
+            m_Data[i].resize(static_cast<size_t>(m_LineSizes[i]) * rows[i]);
+            for (size_t j = 0; j < m_Data[i].size(); ++j)
+                m_Data[i][j] = static_cast<uint8_t>(j * 7 + seed);
+            m_Planes[i] = m_Data[i].empty() ? nullptr : &m_Data[i][0];
+        }
+    }
+
+    uint8_t *const *GetPlanes()
+    {
+        return m_Planes;
+    }
+
+    const int *GetLineSizes()
+    {
+        return m_LineSizes;
+    }
+
+    size_t GetSize() const
+    {
+        return m_Data[0].size() + m_Data[1].size() + m_Data[2].size();
+    }
+
+private:
+    std::vector<uint8_t> m_Data[3];
+    uint8_t *m_Planes[3];
+    int m_LineSizes[3];
+};
+
+static void BM_TextureUpload(benchmark::State &state)
+{
+    int format = static_cast<int>(state.range(0));
+    int width = static_cast<int>(state.range(1));
+    int height = static_cast<int>(state.range(2));
+    int mode = static_cast<int>(state.range(3));
+    bool finish = state.range(4) != 0;
+
+    //解码线程每次送来的都是新内容, 轮流上传几帧
+    std::vector<SourceFrame> frames;
+    for (int i = 0; i < PBO_RING_SIZE + 1; ++i)
+        frames.emplace_back(format, width, height, static_cast<uint8_t>(i));
+
+    TextureUploader uploader;
+    uploader.OnContextCreated();
+    //第一次上传分配纹理存储和 PBO, 不计入耗时
+    for (size_t i = 0; i < frames.size(); ++i)
+        uploader.Upload(format, width, height, frames[i].GetPlanes(), frames[i].GetLineSizes(), mode);
+    glFinish();
+
+    size_t index = 0;
+    for (auto _ : state)
+    {
+        SourceFrame &frame = frames[index++ % frames.size()];
+        auto start = std::chrono::steady_clock::now();
+        uploader.Upload(format, width, height, frame.GetPlanes(), frame.GetLineSizes(), mode);
+        if(finish)
+            glFinish();
+        auto end = std::chrono::steady_clock::now();
+        if(!finish)
+            glFinish();
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+    }
+    if(glGetError() != GL_NO_ERROR)
+        state.SkipWithError("glError");
+    uploader.Release();
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * frames[0].GetSize()));
+    state.SetLabel(mode == TEXTURE_UPLOAD_PBO ? "pbo" : "direct");
+}
+
+BENCHMARK(BM_TextureUpload)
+        ->ArgNames({"format", "width", "height", "mode", "finish"})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {1920}, {1080},
+                       {TEXTURE_UPLOAD_DIRECT, TEXTURE_UPLOAD_PBO}, {0, 1}})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {3840}, {2160},
+                       {TEXTURE_UPLOAD_DIRECT, TEXTURE_UPLOAD_PBO}, {0, 1}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseManualTime();
+
+//PBO 路径在 GL 线程上多出的一次拷贝: 把同样的平面 memcpy 到一块缓冲区
+static void BM_PlaneCopy(benchmark::State &state)
+{
+    int format = static_cast<int>(state.range(0));
+    int width = static_cast<int>(state.range(1));
+    int height = static_cast<int>(state.range(2));
+    SourceFrame frame(format, width, height, 0);
+    std::vector<uint8_t> buffer(frame.GetSize());
+    int rows[3] = {height, height / 2, height / 2};
+
+    for (auto _ : state)
+    {
+        size_t offset = 0;
+        for (int i = 0; i < 3 && frame.GetPlanes()[i] != nullptr; ++i)
+        {
+            size_t size = static_cast<size_t>(frame.GetLineSizes()[i]) * rows[i];
+            memcpy(&buffer[offset], frame.GetPlanes()[i], size);
+            offset += size;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * frame.GetSize()));
+}
+
+BENCHMARK(BM_PlaneCopy)
+        ->ArgNames({"format", "width", "height"})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {1920}, {1080}})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {3840}, {2160}})
+        ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    //benchmark 在主线程上运行, GL 上下文在主线程上创建一次
+    if(!CreateGLContext())
+    {
+        DestroyGLContext();
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    DestroyGLContext();
+    return 0;
+}
@@ -0,0 +1,74 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include "VsyncSource.h"
+
+//按 refreshRate 送入 count 个 vsync, skipEvery 不为 0 时每 skipEvery 个 vsync 丢掉一个, 模拟掉帧
+static int64_t FeedVsyncs(VsyncPeriodEstimator &estimator, int64_t startTime, int refreshRate, int count, int skipEvery = 0)
+{
+    int64_t period = 1000000LL / refreshRate;
+    int64_t vsyncTime = startTime;
+    for (int i = 0; i < count; ++i)
+    {
+        vsyncTime += period;
+        if(skipEvery > 0 && i % skipEvery == skipEvery - 1)
+            continue;
+        estimator.OnVsync(vsyncTime);
+    }
+    return vsyncTime;
+}
+
+TEST(VsyncPeriodEstimatorTest, DefaultsTo60Hz)
+{
+    VsyncPeriodEstimator estimator;
+    EXPECT_EQ(DEFAULT_VSYNC_PERIOD, estimator.GetPeriod());
+}
+
+TEST(VsyncPeriodEstimatorTest, SettlesOnDisplayRate)
+{
+    const int refreshRates[] = {30, 60, 90, 120};
+    for (int refreshRate : refreshRates)
+    {
+        VsyncPeriodEstimator estimator;
+        FeedVsyncs(estimator, 0, refreshRate, 4 * VSYNC_PERIOD_WINDOW);
+        EXPECT_NEAR(1000000 / refreshRate, estimator.GetPeriod(), 2) << refreshRate << "Hz";
+    }
+}
+
+TEST(VsyncPeriodEstimatorTest, IgnoresMissedVsyncs)
+{
+    VsyncPeriodEstimator estimator;
+    //60Hz 上每 4 个 vsync 掉一个, 33ms 的间隔不影响估计
+    FeedVsyncs(estimator, 0, 60, 20 * VSYNC_PERIOD_WINDOW, 4);
+    EXPECT_NEAR(16667, estimator.GetPeriod(), 2);
+}
+
+TEST(VsyncPeriodEstimatorTest, FollowsRefreshRateSwitch)
+{
+    VsyncPeriodEstimator estimator;
+    int64_t vsyncTime = FeedVsyncs(estimator, 0, 60, 4 * VSYNC_PERIOD_WINDOW);
+    EXPECT_NEAR(16667, estimator.GetPeriod(), 2);
+
+    //切换到 30Hz 之后一个窗口内跟上, 不会停在 16.7ms
+    vsyncTime = FeedVsyncs(estimator, vsyncTime, 30, VSYNC_PERIOD_WINDOW);
+    EXPECT_NEAR(33333, estimator.GetPeriod(), 2);
+
+    //切换回更高的刷新率时立即跟上
+    vsyncTime = FeedVsyncs(estimator, vsyncTime, 120, 2);
+    EXPECT_NEAR(8333, estimator.GetPeriod(), 2);
+
+    FeedVsyncs(estimator, vsyncTime, 90, 4 * VSYNC_PERIOD_WINDOW);
+    EXPECT_NEAR(11111, estimator.GetPeriod(), 2);
+}
+
+TEST(VsyncPeriodEstimatorTest, SkipsPauseInVsyncs)
+{
+    VsyncPeriodEstimator estimator;
+    int64_t vsyncTime = FeedVsyncs(estimator, 0, 60, 4 * VSYNC_PERIOD_WINDOW);
+    //界面不可见一段时间之后恢复, 中断的间隔不参与估计
+    FeedVsyncs(estimator, vsyncTime + 2000000, 60, 2);
+    EXPECT_NEAR(16667, estimator.GetPeriod(), 2);
+}
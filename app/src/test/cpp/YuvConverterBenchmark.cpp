@@ -0,0 +1,51 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <vector>
+#include "ImageDef.h"
+#include "YuvConverter.h"
+
+//YuvConverter 的 SIMD 实现与标量实现在 1080p/4K 上的单线程转换耗时:
+//  YuvConverterBenchmark --benchmark_filter=BM_ConvertToRgba
+static void BM_ConvertToRgba(benchmark::State &state)
+{
+    int format = static_cast<int>(state.range(0));
+    int width = static_cast<int>(state.range(1));
+    int height = static_cast<int>(state.range(2));
+    int flags = static_cast<int>(state.range(3));
+
+    //linesize 按 64 字节对齐, 与 FFmpeg 解码输出一致
+    int yLineSize = (width + 63) & ~63;
+    int chromaWidth = format == IMAGE_FORMAT_I420 ? width / 2 : width;
+    int chromaLineSize = (chromaWidth + 63) & ~63;
+    std::vector<uint8_t> yPlane(static_cast<size_t>(yLineSize) * height, 128);
+    std::vector<uint8_t> uPlane(static_cast<size_t>(chromaLineSize) * height / 2, 100);
+    std::vector<uint8_t> vPlane(static_cast<size_t>(chromaLineSize) * height / 2, 150);
+    for (size_t i = 0; i < yPlane.size(); ++i)
+        yPlane[i] = static_cast<uint8_t>(i * 7);
+
+    uint8_t *planes[3] = {&yPlane[0], &uPlane[0], format == IMAGE_FORMAT_I420 ? &vPlane[0] : nullptr};
+    int lineSizes[3] = {yLineSize, chromaLineSize, format == IMAGE_FORMAT_I420 ? chromaLineSize : 0};
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+
+    for (auto _ : state)
+    {
+        YuvConverter::ConvertToRgba(format, planes, lineSizes, width, height, YUV_COLOR_SPACE_BT709,
+                                    YUV_COLOR_RANGE_LIMITED, &rgba[0], width * 4, flags);
+        benchmark::DoNotOptimize(rgba.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+    state.SetLabel(flags & YUV_CONVERT_FLAG_SCALAR ? "c" : YuvConverter::GetImplName());
+}
+
+BENCHMARK(BM_ConvertToRgba)
+        ->ArgNames({"format", "width", "height", "flags"})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {1920}, {1080}, {0, YUV_CONVERT_FLAG_SCALAR}})
+        ->ArgsProduct({{IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12}, {3840}, {2160}, {0, YUV_CONVERT_FLAG_SCALAR}})
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,356 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+#include "ImageDef.h"
+#include "YuvConverter.h"
+
+#ifdef YUV_CONVERTER_TEST_SWSCALE
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+//与浮点参考实现的最大误差, Q6 定点系数的舍入误差在 Y 接近上限时最大
+#define REFERENCE_TOLERANCE 3
+//swscale 使用自己的定点表, 与浮点参考也有误差, 两者相加
+#define SWSCALE_TOLERANCE   (REFERENCE_TOLERANCE + 2)
+//目标图像每行末尾的填充, 用于检查没有越界写入
+#define DST_PADDING         12
+#define DST_GUARD           0xCD
+
+//按 AVFrame 的布局分配的 YUV 图像, 每个平面的 linesize 带有 padding 字节的填充
+struct YuvImage
+{
+    int format;
+    int width;
+    int height;
+    std::vector<uint8_t> planeData[3];
+    uint8_t *planes[3];
+    int lineSizes[3];
+};
+
+static void AllocImage(YuvImage &image, int format, int width, int height, int padding)
+{
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    int planeCount = format == IMAGE_FORMAT_I420 ? 3 : 2;
+    for (int i = 0; i < 3; ++i)
+    {
+        if(i >= planeCount)
+        {
+            image.planeData[i].clear();
+            image.planes[i] = nullptr;
+            image.lineSizes[i] = 0;
+            continue;
+        }
+        int rowBytes = i == 0 ? width : (format == IMAGE_FORMAT_I420 ? chromaWidth : chromaWidth * 2);
+        int rows = i == 0 ? height : chromaHeight;
+        image.lineSizes[i] = rowBytes + padding;
+        //最后一行也按 linesize 分配, 与 av_frame_get_buffer 一致
+        image.planeData[i].assign(static_cast<size_t>(image.lineSizes[i]) * rows, 0);
+        image.planes[i] = &image.planeData[i][0];
+    }
+}
+
+static void FillRandom(YuvImage &image, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    for (int i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < image.planeData[i].size(); ++j)
+            image.planeData[i][j] = static_cast<uint8_t>(random());
+    }
+}
+
+//(x, y) 像素对应的 Y/U/V, 色度按向下取整的位置采样
+static void GetYuv(const YuvImage &image, int x, int y, int &Y, int &U, int &V)
+{
+    Y = image.planes[0][y * image.lineSizes[0] + x];
+    const uint8_t *chroma = image.planes[1] + (y / 2) * image.lineSizes[1];
+    switch (image.format)
+    {
+        case IMAGE_FORMAT_I420:
+            U = chroma[x / 2];
+            V = image.planes[2][(y / 2) * image.lineSizes[2] + x / 2];
+            break;
+        case IMAGE_FORMAT_NV12:
+            U = chroma[x / 2 * 2];
+            V = chroma[x / 2 * 2 + 1];
+            break;
+        default:
+            V = chroma[x / 2 * 2];
+            U = chroma[x / 2 * 2 + 1];
+            break;
+    }
+}
+
+static uint8_t ClampRound(double value)
+{
+    value = floor(value + 0.5);
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+//浮点参考实现, 系数来自 BT.601/BT.709 的定义
+static void ReferenceYuvToRgb(int Y, int U, int V, int colorSpace, int colorRange, uint8_t rgb[3])
+{
+    double kr = colorSpace == YUV_COLOR_SPACE_BT709 ? 0.2126 : 0.299;
+    double kb = colorSpace == YUV_COLOR_SPACE_BT709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double y, u, v;
+    if(colorRange == YUV_COLOR_RANGE_FULL)
+    {
+        y = Y;
+        u = (U - 128) * 255.0 / 254.0;
+        v = (V - 128) * 255.0 / 254.0;
+    }
+    else
+    {
+        y = (Y - 16) * 255.0 / 219.0;
+        u = (U - 128) * 255.0 / 224.0;
+        v = (V - 128) * 255.0 / 224.0;
+    }
+    u *= 2 * (1 - kb);
+    v *= 2 * (1 - kr);
+    rgb[0] = ClampRound(y + v);
+    rgb[1] = ClampRound(y - (kb * u + kr * v) / kg);
+    rgb[2] = ClampRound(y + u);
+}
+
+class RgbaImage
+{
+public:
+    RgbaImage(int width, int height) : m_Width(width), m_Height(height), m_LineSize(width * 4 + DST_PADDING),
+                                       m_Data(static_cast<size_t>(m_LineSize) * height, DST_GUARD) {}
+
+    uint8_t *GetData()
+    {
+        return &m_Data[0];
+    }
+
+    int GetLineSize()
+    {
+        return m_LineSize;
+    }
+
+    const uint8_t *GetPixel(int x, int y) const
+    {
+        return &m_Data[y * m_LineSize + x * 4];
+    }
+
+    //每行末尾的填充没有被写入
+    bool IsPaddingIntact() const
+    {
+        for (int y = 0; y < m_Height; ++y)
+        {
+            for (int x = m_Width * 4; x < m_LineSize; ++x)
+            {
+                if(m_Data[y * m_LineSize + x] != DST_GUARD)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    int m_Width;
+    int m_Height;
+    int m_LineSize;
+    std::vector<uint8_t> m_Data;
+};
+
+static bool Convert(const YuvImage &image, int colorSpace, int colorRange, RgbaImage &rgba, int flags)
+{
+    return YuvConverter::ConvertToRgba(image.format, const_cast<uint8_t *const *>(image.planes), image.lineSizes,
+                                       image.width, image.height, colorSpace, colorRange,
+                                       rgba.GetData(), rgba.GetLineSize(), flags);
+}
+
+static const int s_Formats[] = {IMAGE_FORMAT_I420, IMAGE_FORMAT_NV12, IMAGE_FORMAT_NV21};
+//覆盖 SIMD 块(16 像素)内外的奇偶宽度, 以及只有一行/一列的情况
+static const int s_Widths[] = {1, 2, 3, 15, 16, 17, 31, 33, 64, 101};
+static const int s_Heights[] = {1, 2, 3, 7, 16};
+static const int s_Paddings[] = {0, 5, 32};
+
+TEST(YuvConverterTest, RejectsUnsupportedInput)
+{
+    YuvImage image;
+    AllocImage(image, IMAGE_FORMAT_I420, 16, 16, 0);
+    RgbaImage rgba(16, 16);
+    EXPECT_FALSE(YuvConverter::ConvertToRgba(IMAGE_FORMAT_RGBA, image.planes, image.lineSizes, 16, 16,
+                                             YUV_COLOR_SPACE_BT601, YUV_COLOR_RANGE_LIMITED, rgba.GetData(), rgba.GetLineSize()));
+    EXPECT_FALSE(YuvConverter::ConvertToRgba(IMAGE_FORMAT_I420, image.planes, image.lineSizes, 0, 16,
+                                             YUV_COLOR_SPACE_BT601, YUV_COLOR_RANGE_LIMITED, rgba.GetData(), rgba.GetLineSize()));
+    image.planes[2] = nullptr;
+    EXPECT_FALSE(YuvConverter::ConvertToRgba(IMAGE_FORMAT_I420, image.planes, image.lineSizes, 16, 16,
+                                             YUV_COLOR_SPACE_BT601, YUV_COLOR_RANGE_LIMITED, rgba.GetData(), rgba.GetLineSize()));
+}
+
+//SIMD 实现与标量实现逐字节一致, 覆盖奇数宽高和带填充的 linesize
+TEST(YuvConverterTest, SimdMatchesScalar)
+{
+    unsigned int seed = 1;
+    for (int format : s_Formats)
+    for (int width : s_Widths)
+    for (int height : s_Heights)
+    for (int padding : s_Paddings)
+    for (int colorSpace = YUV_COLOR_SPACE_BT601; colorSpace <= YUV_COLOR_SPACE_BT709; ++colorSpace)
+    for (int colorRange = YUV_COLOR_RANGE_LIMITED; colorRange <= YUV_COLOR_RANGE_FULL; ++colorRange)
+    {
+        SCOPED_TRACE(testing::Message() << "format=" << format << " [w, h]=[" << width << ", " << height
+                                        << "] padding=" << padding << " colorSpace=" << colorSpace
+                                        << " colorRange=" << colorRange << " impl=" << YuvConverter::GetImplName());
+        YuvImage image;
+        AllocImage(image, format, width, height, padding);
+        FillRandom(image, seed++);
+
+        RgbaImage simd(width, height), scalar(width, height);
+        ASSERT_TRUE(Convert(image, colorSpace, colorRange, simd, 0));
+        ASSERT_TRUE(Convert(image, colorSpace, colorRange, scalar, YUV_CONVERT_FLAG_SCALAR));
+        EXPECT_TRUE(simd.IsPaddingIntact());
+        EXPECT_TRUE(scalar.IsPaddingIntact());
+        for (int y = 0; y < height; ++y)
+        {
+            ASSERT_EQ(0, memcmp(simd.GetPixel(0, y), scalar.GetPixel(0, y), width * 4)) << "row " << y;
+        }
+    }
+}
+
+//带填充和奇数尺寸的随机图像, 每个像素与浮点参考的误差不超过 REFERENCE_TOLERANCE
+TEST(YuvConverterTest, MatchesReferenceOnOddSizes)
+{
+    unsigned int seed = 100;
+    for (int format : s_Formats)
+    for (int width : s_Widths)
+    for (int height : s_Heights)
+    for (int colorSpace = YUV_COLOR_SPACE_BT601; colorSpace <= YUV_COLOR_SPACE_BT709; ++colorSpace)
+    for (int colorRange = YUV_COLOR_RANGE_LIMITED; colorRange <= YUV_COLOR_RANGE_FULL; ++colorRange)
+    {
+        YuvImage image;
+        AllocImage(image, format, width, height, 7);
+        FillRandom(image, seed++);
+        RgbaImage rgba(width, height);
+        ASSERT_TRUE(Convert(image, colorSpace, colorRange, rgba, 0));
+
+        for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            int Y, U, V;
+            GetYuv(image, x, y, Y, U, V);
+            uint8_t expected[3];
+            ReferenceYuvToRgb(Y, U, V, colorSpace, colorRange, expected);
+            const uint8_t *pixel = rgba.GetPixel(x, y);
+            for (int c = 0; c < 3; ++c)
+            {
+                ASSERT_LE(abs(pixel[c] - expected[c]), REFERENCE_TOLERANCE)
+                    << "format=" << format << " [w, h]=[" << width << ", " << height << "] (" << x << ", " << y
+                    << ") channel=" << c << " yuv=(" << Y << ", " << U << ", " << V << ")";
+            }
+            ASSERT_EQ(255, pixel[3]);
+        }
+    }
+}
+
+//所有 Y/U/V 组合与浮点参考的误差, 一帧 512x512 覆盖一个 V 值下所有的 Y/U
+TEST(YuvConverterTest, MatchesReferenceForAllYuvValues)
+{
+    const int size = 512;
+    YuvImage image;
+    AllocImage(image, IMAGE_FORMAT_I420, size, size, 0);
+    for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+        image.planes[0][y * image.lineSizes[0] + x] = static_cast<uint8_t>(x / 2);
+    for (int y = 0; y < size / 2; ++y)
+        memset(image.planes[1] + y * image.lineSizes[1], y, size / 2);
+
+    RgbaImage rgba(size, size);
+    for (int colorSpace = YUV_COLOR_SPACE_BT601; colorSpace <= YUV_COLOR_SPACE_BT709; ++colorSpace)
+    for (int colorRange = YUV_COLOR_RANGE_LIMITED; colorRange <= YUV_COLOR_RANGE_FULL; ++colorRange)
+    {
+        int maxError = 0;
+        for (int V = 0; V < 256; ++V)
+        {
+            memset(image.planes[2], V, image.planeData[2].size());
+            ASSERT_TRUE(Convert(image, colorSpace, colorRange, rgba, 0));
+            for (int U = 0; U < 256; ++U)
+            for (int Y = 0; Y < 256; ++Y)
+            {
+                uint8_t expected[3];
+                ReferenceYuvToRgb(Y, U, V, colorSpace, colorRange, expected);
+                const uint8_t *pixel = rgba.GetPixel(Y * 2, U * 2);
+                for (int c = 0; c < 3; ++c)
+                {
+                    int error = abs(pixel[c] - expected[c]);
+                    if(error > maxError)
+                        maxError = error;
+                }
+            }
+        }
+        EXPECT_LE(maxError, REFERENCE_TOLERANCE) << "colorSpace=" << colorSpace << " colorRange=" << colorRange;
+    }
+}
+
+#ifdef YUV_CONVERTER_TEST_SWSCALE
+
+static AVPixelFormat GetAVPixelFormat(int format)
+{
+    switch (format)
+    {
+        case IMAGE_FORMAT_NV12: return AV_PIX_FMT_NV12;
+        case IMAGE_FORMAT_NV21: return AV_PIX_FMT_NV21;
+        default: return AV_PIX_FMT_YUV420P;
+    }
+}
+
+//与 swscale 的不缩放转换对比. 奇数尺寸时 swscale 走通用缩放路径, 色度的取样位置与这里不同, 只对比偶数尺寸
+TEST(YuvConverterTest, MatchesSwscale)
+{
+    static const int widths[] = {16, 64, 102};
+    static const int heights[] = {2, 16, 36};
+    unsigned int seed = 1000;
+    for (int format : s_Formats)
+    for (int width : widths)
+    for (int height : heights)
+    for (int colorSpace = YUV_COLOR_SPACE_BT601; colorSpace <= YUV_COLOR_SPACE_BT709; ++colorSpace)
+    for (int colorRange = YUV_COLOR_RANGE_LIMITED; colorRange <= YUV_COLOR_RANGE_FULL; ++colorRange)
+    {
+        SCOPED_TRACE(testing::Message() << "format=" << format << " [w, h]=[" << width << ", " << height
+                                        << "] colorSpace=" << colorSpace << " colorRange=" << colorRange);
+        YuvImage image;
+        AllocImage(image, format, width, height, 9);
+        FillRandom(image, seed++);
+        RgbaImage rgba(width, height), expected(width, height);
+        ASSERT_TRUE(Convert(image, colorSpace, colorRange, rgba, 0));
+
+        SwsContext *context = sws_getContext(width, height, GetAVPixelFormat(format), width, height, AV_PIX_FMT_RGBA,
+                                             SWS_POINT, nullptr, nullptr, nullptr);
+        ASSERT_TRUE(context != nullptr);
+        const int *coefficients = sws_getCoefficients(colorSpace == YUV_COLOR_SPACE_BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+        sws_setColorspaceDetails(context, coefficients, colorRange == YUV_COLOR_RANGE_FULL ? 1 : 0,
+                                 coefficients, 1, 0, 1 << 16, 1 << 16);
+        uint8_t *dst[4] = {expected.GetData(), nullptr, nullptr, nullptr};
+        int dstLineSize[4] = {expected.GetLineSize(), 0, 0, 0};
+        sws_scale(context, image.planes, image.lineSizes, 0, height, dst, dstLineSize);
+        sws_freeContext(context);
+
+        for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        for (int c = 0; c < 3; ++c)
+        {
+            ASSERT_LE(abs(rgba.GetPixel(x, y)[c] - expected.GetPixel(x, y)[c]), SWSCALE_TOLERANCE)
+                << "(" << x << ", " << y << ") channel=" << c;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,38 @@
+//
+// Created by pcl on 2021/5/24.
+//
+
+//主机测试用的 android/log.h, 设置环境变量 NATIVE_TEST_LOG 时输出到 stderr
+#ifndef FFMPEGEXERCISE_TEST_ANDROID_LOG_H
+#define FFMPEGEXERCISE_TEST_ANDROID_LOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+enum {
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+};
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+    static const bool enabled = getenv("NATIVE_TEST_LOG") != nullptr;
+    if(!enabled)
+        return 0;
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s: ", tag);
+    int ret = vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return ret;
+}
+
+#endif //FFMPEGEXERCISE_TEST_ANDROID_LOG_H